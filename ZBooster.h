@@ -21,7 +21,7 @@
 	#define ZBOOSTER_RGBLED_BLUE P2_0
 	#define ZBOOSTER_BUTTON_SWITCH2 P1_6
 #endif
-#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM____) 
+#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM__) 
 	#define ZBOOSTER_RGBLED_RED PA_6
 	#define ZBOOSTER_RGBLED_GREEN PA_4
 	#define ZBOOSTER_RGBLED_BLUE PB_2
@@ -3,17 +3,21 @@
 #include "ZigBee.h"
 #include <stdint.h>
 #include <inttypes.h>
+#include <string.h>
 
-#include "utility/HAL.h"
+#include "utility/hal.h"
 #include "utility/utilities.h"
 #include "utility/module_errors.h"
 #include "utility/zm_phy_spi.h"
+#include "utility/zm_phy_uart.h"
 #include "utility/module.h"
 #include "utility/module_utilities.h"
 #include "utility/application_configuration.h"
 #include "utility/af.h"
 #include "utility/zdo.h"
 #include "utility/module_commands.h"
+#include "utility/address_cache.h"
+#include "utility/timer_wheel.h"
 
 // Union to convert mac address into 64bit number. Useful for quick comparisons and moving data type
 
@@ -22,6 +26,9 @@ moduleResult_t result = MODULE_SUCCESS;
 
 #ifndef __MSP430G2553
 void (*ZigBeeClass::user_onReceive)(void);
+void (*ZigBeeClass::user_onSendProgress)(uint16_t sent, uint16_t total);
+void (*ZigBeeClass::user_onReceiveChunk)(uint16_t index, uint8_t* data, uint8_t length);
+void (*ZigBeeClass::user_onBegin)(int result);
 #endif
 
 ZigBeeClass::ZigBeeClass(){
@@ -33,6 +40,19 @@ ZigBeeClass::ZigBeeClass(){
 #endif
 	config=DEFAULT_MODULE_CONFIGURATION_COORDINATOR;
 	afSetAckMode(AF_MAC_ACK);
+	memset(txLength, 0, sizeof(txLength));
+	txSelected=0;
+	rxIndex=0;
+	_received.data=rxBuffer;
+	_received.dataLength=0;
+#ifndef __MSP430G2553
+	_receiveMode=RECEIVE_POLLED;
+	_deviceInfoValid=0;
+	_receiveBuffer=NULL;
+	_receiveBufferSize=0;
+	_handlerCount=0;
+	memset(_handlerSlots, 0, sizeof(_handlerSlots));
+#endif
 	#if defined(__MSP430G2553)
 		hal.mrstPin=P2_7;
 		hal.mrdyPin=P2_0;
@@ -48,7 +68,7 @@ ZigBeeClass::ZigBeeClass(){
 		hal.mrdyPin=P2_7;
 		hal.srdyPin=P4_1;
 	#endif
-	#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM____) 
+	#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM__) 
 		hal.mrstPin=PE_0;
 		hal.mrdyPin=PA_5;
 		hal.srdyPin=PA_7;
@@ -64,13 +84,51 @@ ZigBeeClass::ZigBeeClass(){
 		hal.mrstPin=18;
 		hal.mrdyPin=8;
 		hal.srdyPin=10;
-	#endif	
+	#endif
+	#if defined(ZIGBEE_HOST)
+		hal.mrstPin=HOST_MRST_PIN;
+		hal.mrdyPin=HOST_MRDY_PIN;
+		hal.srdyPin=HOST_SRDY_PIN;
+	#endif
 }
 #ifndef __MSP430G2553
 void ZigBeeClass::onReceive( void (*function)(void) )
 {
 	user_onReceive = function;
-	attachInterrupt(hal.srdyPin,user_onReceive,FALLING);
+	if (_receiveMode!=RECEIVE_INTERRUPT && moduleGetTransport()->srdy)
+		attachInterrupt(hal.srdyPin,user_onReceive,FALLING);
+}
+
+// Fetches everything the module has waiting into the receive queue, then lets the user know
+void ZigBeeClass::srdyInterrupt(void)
+{
+	moduleServiceReceive();
+	if (user_onReceive) user_onReceive();
+}
+
+void ZigBeeClass::receiveMode(uint8_t mode){
+	_receiveMode=mode;
+	attachSrdyInterrupt();
+}
+
+// sendMessage() calls this when the module stops answering, even after a SPI reset
+uint8_t ZigBeeClass::recover(){
+	uint8_t step=::moduleRecover();
+	ZigBee.attachSrdyInterrupt();	// moduleReset() borrowed the pin
+	ZigBee._deviceInfoValid=0;
+	return step;
+}
+
+// Puts back whichever SRDY interrupt the receive mode and onReceive() call for; moduleReset() borrows the pin while the module boots
+void ZigBeeClass::attachSrdyInterrupt(){
+	if (!moduleGetTransport()->srdy)	// over UART the pin isn't connected to anything
+		return;
+	if (_receiveMode==RECEIVE_INTERRUPT)
+		attachInterrupt(hal.srdyPin,srdyInterrupt,FALLING);
+	else if (user_onReceive)
+		attachInterrupt(hal.srdyPin,user_onReceive,FALLING);
+	else
+		detachInterrupt(hal.srdyPin);
 }
 #endif
 /******************** SET HARDWARE CONFIGURATIONS ****************************/
@@ -87,6 +145,21 @@ void ZigBeeClass::srdyPin(uint8_t pin){
 void ZigBeeClass::spiModule(uint8_t module){
 	hal.spiModule=module;
 }
+#ifndef __MSP430G2553
+void ZigBeeClass::spiClockDivider(uint8_t divider){
+	hal.spiClockDivider=divider;
+	halSpiClearClockDivider();	// forget the calibrated one; begin() sets up the SPI port with it
+}
+uint32_t ZigBeeClass::spiClock(){
+	return halSpiClockHz();
+}
+uint16_t ZigBeeClass::spiErrors(){
+	return ::moduleSpiCalibrationErrors();
+}
+void ZigBeeClass::uart(Stream& port){
+	moduleSetTransport(::moduleUartTransport(&port));
+}
+#endif
 
 
 /********************************** MODULE METHODS ********************************/
@@ -97,21 +170,46 @@ int ZigBeeClass::begin(uint8_t deviceType) {
 }
 
 int ZigBeeClass::begin() {
+#ifndef __MSP430G2553
+	// The module is reset during startup; don't let the SRDY interrupt talk to it until it's back up
+	if (_receiveMode==RECEIVE_INTERRUPT) detachInterrupt(hal.srdyPin);
+#endif
 	halInit();
-    moduleInit();
-	moduleReset();
+    moduleInit();	// start() resets the module
+#ifndef __MSP430G2553
+	::addressCacheClear();	// may be joining a different network
+#endif
 	start();
+#ifndef __MSP430G2553
+	if (result==MODULE_SUCCESS) {
+		moduleSetRecoveryHandler(NULL);	// a round trip failing at too fast a clock isn't a reason to reset the module
+		::moduleCalibrateSpi();
+		moduleSetRecoveryHandler(recover);
+	}
+	attachSrdyInterrupt();
+	_deviceInfoValid=0;
+#endif
+	return result;
 }
 
 int ZigBeeClass::reconnect() {
 	uint16_t tempOptions = config.startupOptions;
 	config.startupOptions=0;
+#ifndef __MSP430G2553
+	if (_receiveMode==RECEIVE_INTERRUPT) detachInterrupt(hal.srdyPin);
+#endif
 	start();
+#ifndef __MSP430G2553
+	attachSrdyInterrupt();
+	_deviceInfoValid=0;
+#endif
 	config.startupOptions=tempOptions;
+	return result;
 }
 
 int ZigBeeClass::start(){
-	index=0;
+	txLength[txSelected]=0;
+	rxIndex=0;
 #ifdef __MSP430G2553
 	if ((result = startModule(&config, &application)) != MODULE_SUCCESS)
 #else
@@ -122,21 +220,80 @@ int ZigBeeClass::start(){
         printf("\n\rModule start unsuccessful. Error Code 0x%02X.", result);
     }else{
 		printf("\n\rSuccess!\n\r"); 
+#ifndef __MSP430G2553
+		moduleSetRecoveryHandler(recover);
+#endif
+	}
+	return result;
+}
+
+#ifndef __MSP430G2553
+int ZigBeeClass::beginAsync(uint8_t deviceType) {
+	config.deviceType=deviceType;
+	return beginAsync();
+}
+
+int ZigBeeClass::beginAsync() {
+	// The SRDY interrupt stays off until poll() has the module on the network
+	if (_receiveMode==RECEIVE_INTERRUPT) detachInterrupt(hal.srdyPin);
+	halInit();
+	moduleInit();
+	::addressCacheClear();
+	txLength[txSelected]=0;
+	rxIndex=0;
+	if ((result = startModuleAsync(&config, application)) != MODULE_SUCCESS)
+		attachSrdyInterrupt();
+	return result;
+}
+
+int ZigBeeClass::poll() {
+	uint8_t step=::startModuleProgress();
+	if (step==START_STEP_IDLE || step>=START_STEP_DONE) {
+		::timerService(millis());
+		if (::afPendingSends()) ::afServiceDataConfirms();
+		if (_handlerCount) {	// without handlers, messages are left for receive()
+			uint8_t count;
+			for (count=0; count<POLL_MAX_MESSAGES && moduleHasMessageWaiting(); count++)
+				receiveNow(0);
+		}
+		return ::startModulePoll();	// the result of the last startup
+	}
+	int startResult=::startModulePoll();
+	if (startResult==OPERATION_PENDING)
+		return startResult;
+	result=startResult;
+	attachSrdyInterrupt();
+	_deviceInfoValid=0;
+	if (result != MODULE_SUCCESS) {
+		printf("\n\rModule start unsuccessful. Error Code 0x%02X.", result);
+	} else {
+		printf("\n\rSuccess!\n\r");
+		moduleSetRecoveryHandler(recover);
 	}
+	if (user_onBegin) user_onBegin(result);
 	return result;
 }
 
+uint8_t ZigBeeClass::startupStep() {
+	return ::startModuleProgress();
+}
+
+void ZigBeeClass::onBegin( void (*function)(int result) ) {
+	user_onBegin = function;
+}
+#endif
+
 
 int ZigBeeClass::bindcast(){
-	result=afSendDataExtended(DEFAULT_ENDPOINT, DEFAULT_ENDPOINT, NULL, DESTINATION_ADDRESS_MODE_NONE, INFO_MESSAGE_CLUSTER, buffer, index);
-	index=0;
+	result=afSendDataExtended(endpoint(), endpoint(), NULL, DESTINATION_ADDRESS_MODE_NONE, INFO_MESSAGE_CLUSTER, txBuffer[txSelected], txLength[txSelected]);
+	txLength[txSelected]=0;
 	return result;
 }
 
 int ZigBeeClass::bindcast(uint8_t toEndpoint, uint8_t fromEndpoint, uint16_t cluster){
 //	uint8_t destinationAddress[8];
-	result=afSendDataExtended(toEndpoint, fromEndpoint, NULL, DESTINATION_ADDRESS_MODE_NONE, cluster, buffer, index);
-	index=0;
+	result=afSendDataExtended(toEndpoint, fromEndpoint, NULL, DESTINATION_ADDRESS_MODE_NONE, cluster, txBuffer[txSelected], txLength[txSelected]);
+	txLength[txSelected]=0;
 	return result;
 }
 
@@ -144,117 +301,354 @@ int ZigBeeClass::groupcast(uint16_t groupname){
 	uint8_t groupAddress[2];
 	groupAddress[0]=LSB(groupname);
 	groupAddress[1]=MSB(groupname);
-	result=afSendDataExtended(DEFAULT_ENDPOINT, DEFAULT_ENDPOINT, groupAddress, DESTINATION_ADDRESS_MODE_GROUP, INFO_MESSAGE_CLUSTER, buffer, index);
-	index=0;
+	result=afSendDataExtended(endpoint(), endpoint(), groupAddress, DESTINATION_ADDRESS_MODE_GROUP, INFO_MESSAGE_CLUSTER, txBuffer[txSelected], txLength[txSelected]);
+	txLength[txSelected]=0;
 	return result;
 }
 
 int ZigBeeClass::broadcast(){
-	result=afSendData(DEFAULT_ENDPOINT, DEFAULT_ENDPOINT, BROADCAST_ADDRESS, INFO_MESSAGE_CLUSTER, buffer, index);
-	index=0;
+	result=afSendData(endpoint(), endpoint(), BROADCAST_ADDRESS, INFO_MESSAGE_CLUSTER, txBuffer[txSelected], txLength[txSelected]);
+	txLength[txSelected]=0;
 	return result;
 }
 
 int ZigBeeClass::broadcast(uint8_t toEndpoint, uint8_t fromEndpoint, uint16_t cluster){
-	result=afSendData(toEndpoint, fromEndpoint, BROADCAST_ADDRESS, cluster, buffer, index);
-	index=0;
+	result=afSendData(toEndpoint, fromEndpoint, BROADCAST_ADDRESS, cluster, txBuffer[txSelected], txLength[txSelected]);
+	txLength[txSelected]=0;
 	return result;
 }
 
 int ZigBeeClass::send(uint16_t shortAddress){
-	result=afSendData(DEFAULT_ENDPOINT, DEFAULT_ENDPOINT, shortAddress, INFO_MESSAGE_CLUSTER, buffer, index);
-	index=0;
+	result=afSendData(endpoint(), endpoint(), shortAddress, INFO_MESSAGE_CLUSTER, txBuffer[txSelected], txLength[txSelected]);
+	txLength[txSelected]=0;
 	return result;
 }
 
 int ZigBeeClass::send(uint16_t shortAddress, uint8_t toEndpoint, uint8_t fromEndpoint, uint16_t cluster){
-	result=afSendData(toEndpoint, fromEndpoint, shortAddress, cluster, buffer, index);
-	index=0;
+	result=afSendData(toEndpoint, fromEndpoint, shortAddress, cluster, txBuffer[txSelected], txLength[txSelected]);
+	txLength[txSelected]=0;
+	return result;
+}
+
+#ifndef __MSP430G2553
+int ZigBeeClass::sendAsync(uint16_t shortAddress){
+	return sendAsync(shortAddress, endpoint(), endpoint(), INFO_MESSAGE_CLUSTER);
+}
+
+int ZigBeeClass::sendAsync(uint16_t shortAddress, uint8_t toEndpoint, uint8_t fromEndpoint, uint16_t cluster){
+	uint8_t transaction;
+	result=afSendDataAsync(toEndpoint, fromEndpoint, shortAddress, cluster, txBuffer[txSelected], txLength[txSelected], &transaction);
+	txLength[txSelected]=0;
+	if (result != MODULE_SUCCESS) return -1;
+	return transaction;
+}
+
+uint8_t ZigBeeClass::sendStatus(uint8_t transaction){
+	return afGetSendStatus(transaction);
+}
+
+void ZigBeeClass::onSendComplete( void (*function)(uint8_t transaction, uint8_t status) ){
+	afSetDataConfirmCallback(function);
+}
+
+void ZigBeeClass::maxPendingSends(uint8_t count){
+	afSetMaxPendingSends(count);
+}
+
+uint8_t ZigBeeClass::pendingSends(){
+	return afPendingSends();
+}
+
+/** Data source for the streamed send(): reads from the Stream, waiting up to its timeout */
+static uint8_t streamSource(void* context, uint16_t index, uint8_t* destination, uint8_t length){
+	return ((Stream*) context)->readBytes((char*) destination, length);
+}
+
+void ZigBeeClass::streamProgress(void* context, uint16_t sent, uint16_t total){
+	if (user_onSendProgress) user_onSendProgress(sent, total);
+}
+
+int ZigBeeClass::send(uint16_t shortAddress, Stream& source, uint16_t length){
+	return send(shortAddress, endpoint(), endpoint(), INFO_MESSAGE_CLUSTER, source, length);
+}
+
+int ZigBeeClass::send(uint16_t shortAddress, uint8_t toEndpoint, uint8_t fromEndpoint, uint16_t cluster, Stream& source, uint16_t length){
+	uint8_t address[8];
+	address[0]=LSB(shortAddress);
+	address[1]=MSB(shortAddress);
+	result=afSendDataStream(toEndpoint, fromEndpoint, address, DESTINATION_ADDRESS_MODE_SHORT, cluster, length, streamSource, &source, streamProgress);
 	return result;
 }
 
+void ZigBeeClass::onSendProgress( void (*function)(uint16_t sent, uint16_t total) ){
+	user_onSendProgress = function;
+}
+#endif
+
 int permit(uint16_t destAddress, uint8_t permitseconds){
 	return zdoManagementPermitJoinRequest(destAddress, permitseconds, 0);
 }
 
 int ZigBeeClass::receive(){
-	receive(0);
+	return receive(0);
 }
 
 int ZigBeeClass::receive(uint16_t messageType){
+#ifndef __MSP430G2553
+	if (_receiveMode!=RECEIVE_INTERRUPT)	// queued messages are already here, no need to wait
+#endif
     delay(50);
+	return receiveNow(messageType);
+}
+
+// Loads the next message, if there is one, without waiting for it. In RECEIVE_INTERRUPT mode that's the oldest
+// queued one, or once the queue is empty one the interrupt left in the module when the queue filled up: SRDY is
+// still low for those, so moduleHasMessageWaiting() sees them and getMessage() fetches them directly
+int ZigBeeClass::receiveNow(uint16_t messageType){
 	if(moduleHasMessageWaiting()){
 		getMessage();
 		if (zmBuf[SRSP_LENGTH_FIELD] > 0){
-			receivedType=(CONVERT_TO_INT(zmBuf[SRSP_CMD_LSB_FIELD], zmBuf[SRSP_CMD_MSB_FIELD]));
-			if (receivedType!=messageType && messageType!=0) return 0;
+			_received.dataLength=0;
+			_received.type=(CONVERT_TO_INT(zmBuf[SRSP_CMD_LSB_FIELD], zmBuf[SRSP_CMD_MSB_FIELD]));
+#ifndef __MSP430G2553
+			if (IS_AF_DATA_CONFIRM()) {
+				_received.transaction=AF_DATA_CONFIRM_TRANS_ID;
+				afHandleDataConfirm();		// match it to sendAsync()
+			}
+#endif
+#ifndef __MSP430G2553
+			addressCacheLearn(zmBuf);
+#endif
+			if (_received.type!=messageType && messageType!=0) {
+				// Not wanted, but a long AF_INCOMING_MSG_EXT stays in the module's store until it's retrieved: free it there
+				if (IS_AF_INCOMING_MESSAGE_EXT() && zmBuf[SRSP_LENGTH_FIELD] <= AF_INCOMING_MESSAGE_EXT_PAYLOAD_START_FIELD-SRSP_PAYLOAD_START) {
+					uint8_t timestamp[4];
+					memcpy(timestamp, zmBuf+AF_INCOMING_MESSAGE_EXT_TIMESTAMP_START_FIELD, 4);
+					retrieveExtendedMessageStream(timestamp, 0, receiveSink, this);
+				}
+				return 0;
+			}
 			if (IS_ZDO_END_DEVICE_ANNCE_IND()) {
-				receivedFromAddress=GET_ZDO_END_DEVICE_ANNCE_IND_SRC_ADDRESS();
-				receivedToAddress=GET_ZDO_END_DEVICE_ANNCE_IND_FROM_ADDRESS();
+				_received.fromAddress=GET_ZDO_END_DEVICE_ANNCE_IND_SRC_ADDRESS();
+				_received.toAddress=GET_ZDO_END_DEVICE_ANNCE_IND_FROM_ADDRESS();
 				mac_t macAddr;
 				for (int i=0; i<8; i++) {
 					macAddr.num[i]=zmBuf[ZDO_END_DEVICE_ANNCE_IND_MAC_START_FIELD+i];
 				}
-				receivedMac=macAddr.num64;
-				receivedCapabilities=zmBuf[ZDO_END_DEVICE_ANNCE_IND_CAPABILITIES_FIELD];
+				_received.mac=macAddr.num64;
+				_received.capabilities=zmBuf[ZDO_END_DEVICE_ANNCE_IND_CAPABILITIES_FIELD];
 			} else if (IS_AF_INCOMING_MESSAGE()){
 				// Load the ZM parameters
-				receivedLqi=zmBuf[AF_INCOMING_MESSAGE_LQI_FIELD];
-				receivedLength=zmBuf[AF_INCOMING_MESSAGE_PAYLOAD_LEN_FIELD];
-				receivedFromAddress=AF_INCOMING_MESSAGE_SHORT_ADDRESS();
-				receivedGroup=AF_INCOMING_MESSAGE_GROUP();
-				receivedWasBroadcast=zmBuf[AF_INCOMING_MESSAGE_WAS_BROADCAST_FIELD];
-				receivedClusterId=AF_INCOMING_MESSAGE_CLUSTER();
-				receivedFromEndpoint=zmBuf[AF_INCOMING_MESSAGE_SOURCE_EP_FIELD];
-				receivedToEndpoint=zmBuf[AF_INCOMING_MESSAGE_DESTINATION_EP_FIELD];
-				receivedTransaction=zmBuf[AF_INCOMING_MESSAGE_TIMESTAMP_FIELD];
-				receivedTimestamp=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_TIMESTAMP_FIELD];	
-				receivedTimestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_TIMESTAMP_FIELD+1]*256;
-				receivedTimestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_TIMESTAMP_FIELD+2]*65536;
-				receivedTimestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_TIMESTAMP_FIELD+3]*16777216;
+				_received.lqi=zmBuf[AF_INCOMING_MESSAGE_LQI_FIELD];
+				_received.length=zmBuf[AF_INCOMING_MESSAGE_PAYLOAD_LEN_FIELD];
+				_received.fromAddress=AF_INCOMING_MESSAGE_SHORT_ADDRESS();
+				_received.group=AF_INCOMING_MESSAGE_GROUP();
+				_received.wasBroadcast=zmBuf[AF_INCOMING_MESSAGE_WAS_BROADCAST_FIELD];
+				_received.cluster=AF_INCOMING_MESSAGE_CLUSTER();
+				_received.fromEndpoint=zmBuf[AF_INCOMING_MESSAGE_SOURCE_EP_FIELD];
+				_received.toEndpoint=zmBuf[AF_INCOMING_MESSAGE_DESTINATION_EP_FIELD];
+				_received.transaction=zmBuf[AF_INCOMING_MESSAGE_TIMESTAMP_FIELD];
+				_received.timestamp=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_TIMESTAMP_FIELD];	
+				_received.timestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_TIMESTAMP_FIELD+1]*256;
+				_received.timestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_TIMESTAMP_FIELD+2]*65536;
+				_received.timestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_TIMESTAMP_FIELD+3]*16777216;
 				// Load the Message
-				for ( int i=0;i<receivedLength;i++){
-					buffer[i]=zmBuf[AF_INCOMING_MESSAGE_PAYLOAD_START_FIELD+i];
-				}
+				_received.data=rxBuffer;
+				_received.dataLength=(_received.length<MAX_MESSAGE_SIZE)?_received.length:MAX_MESSAGE_SIZE;
+				receiveSink(this, 0, zmBuf+AF_INCOMING_MESSAGE_PAYLOAD_START_FIELD, _received.length);
 			} else if (IS_AF_INCOMING_MESSAGE_EXT()){
 				// Load the ZM parameters
-				receivedLqi=zmBuf[AF_INCOMING_MESSAGE_EXT_LQI_FIELD];
-				receivedLength=AF_INCOMING_MESSAGE_EXT_LENGTH();
-				receivedFromAddress=AF_INCOMING_MESSAGE_EXT_SHORT_ADDRESS();
-				receivedGroup=AF_INCOMING_MESSAGE_EXT_GROUP();
-				receivedWasBroadcast=zmBuf[AF_INCOMING_MESSAGE_EXT_WAS_BROADCAST_FIELD];
-				receivedClusterId=AF_INCOMING_MESSAGE_EXT_CLUSTER();
-				receivedFromEndpoint=zmBuf[AF_INCOMING_MESSAGE_EXT_SOURCE_EP_FIELD];
-				receivedToEndpoint=zmBuf[AF_INCOMING_MESSAGE_EXT_DESTINATION_EP_FIELD];
-				receivedTimestamp=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_EXT_TIMESTAMP_START_FIELD];	
-				receivedTimestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_EXT_TIMESTAMP_START_FIELD+1]*256;
-				receivedTimestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_EXT_TIMESTAMP_START_FIELD+2]*65536;
-				receivedTimestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_EXT_TIMESTAMP_START_FIELD+3]*16777216;				
-				// Load the Message
-				for ( int i=0;i<receivedLength;i++){
-					buffer[i]=zmBuf[AF_INCOMING_MESSAGE_EXT_PAYLOAD_START_FIELD+i];
-				}
+				_received.lqi=zmBuf[AF_INCOMING_MESSAGE_EXT_LQI_FIELD];
+				_received.length=AF_INCOMING_MESSAGE_EXT_LENGTH();
+				_received.fromAddress=AF_INCOMING_MESSAGE_EXT_SHORT_ADDRESS();
+				_received.group=AF_INCOMING_MESSAGE_EXT_GROUP();
+				_received.wasBroadcast=zmBuf[AF_INCOMING_MESSAGE_EXT_WAS_BROADCAST_FIELD];
+				_received.cluster=AF_INCOMING_MESSAGE_EXT_CLUSTER();
+				_received.fromEndpoint=zmBuf[AF_INCOMING_MESSAGE_EXT_SOURCE_EP_FIELD];
+				_received.toEndpoint=zmBuf[AF_INCOMING_MESSAGE_EXT_DESTINATION_EP_FIELD];
+				_received.timestamp=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_EXT_TIMESTAMP_START_FIELD];	
+				_received.timestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_EXT_TIMESTAMP_START_FIELD+1]*256;
+				_received.timestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_EXT_TIMESTAMP_START_FIELD+2]*65536;
+				_received.timestamp+=(uint32_t) zmBuf[AF_INCOMING_MESSAGE_EXT_TIMESTAMP_START_FIELD+3]*16777216;				
+				receiveExtended();
 			} else if (IS_AF_DATA_CONFIRM()){
 			} 
-		}
+		} else
+			return 0;	// nothing was loaded: don't dispatch the previous message again
 	}else
 		return 0;
-	index=0;
-	return receivedType;
+	rxIndex=0;
+#ifndef __MSP430G2553
+	dispatch();
+#endif
+	return _received.type;
+}
+
+/** Loads the payload of the AF_INCOMING_MSG_EXT in zmBuf. Short ones come with it; long ones are kept
+by the module until retrieved, and are always freed there even if they don't fit anywhere here. */
+void ZigBeeClass::receiveExtended(){
+	uint16_t capacity=MAX_MESSAGE_SIZE;
+	uint16_t wanted;
+	_received.data=rxBuffer;
+#ifndef __MSP430G2553
+	if (_receiveBuffer!=NULL){
+		_received.data=_receiveBuffer;
+		capacity=_receiveBufferSize;
+	}
+#endif
+	_received.dataLength=(_received.length<capacity)?_received.length:capacity;
+	wanted=_received.dataLength;
+#ifndef __MSP430G2553
+	if (user_onReceiveChunk) wanted=_received.length;
+#endif
+	if (zmBuf[SRSP_LENGTH_FIELD] > AF_INCOMING_MESSAGE_EXT_PAYLOAD_START_FIELD-SRSP_PAYLOAD_START){	// payload included
+		receiveSink(this, 0, zmBuf+AF_INCOMING_MESSAGE_EXT_PAYLOAD_START_FIELD, wanted);
+		return;
+	}
+	uint8_t timestamp[4];
+	memcpy(timestamp, zmBuf+AF_INCOMING_MESSAGE_EXT_TIMESTAMP_START_FIELD, 4);
+	result=retrieveExtendedMessageStream(timestamp, wanted, receiveSink, this);
+	if (result != MODULE_SUCCESS) _received.dataLength=0;
+}
+
+void ZigBeeClass::receiveSink(void* context, uint16_t index, uint8_t* data, uint8_t length){
+	ZigBeeClass* zb=(ZigBeeClass*) context;
+#ifndef __MSP430G2553
+	if (user_onReceiveChunk) user_onReceiveChunk(index, data, length);
+#endif
+	if (index<zb->_received.dataLength){
+		uint16_t count=zb->_received.dataLength-index;
+		memcpy(zb->_received.data+index, data, (count<length)?count:length);
+	}
+}
+
+#ifndef __MSP430G2553
+void ZigBeeClass::receiveBuffer(uint8_t* buffer, uint16_t size){
+	_receiveBuffer=buffer;
+	_receiveBufferSize=size;
+}
+
+void ZigBeeClass::onReceiveChunk( void (*function)(uint16_t index, uint8_t* data, uint8_t length) ){
+	user_onReceiveChunk=function;
+}
+
+// Extended messages are handled as INCOMING_DATA, and only incoming data has an endpoint and cluster
+#define HANDLER_TYPE(type)	(((type)==AF_INCOMING_MSG_EXT)?AF_INCOMING_MSG:(type))
+
+/** Finds where (type, endpoint, cluster) is in _handlerSlots, or the free slot where it would go.
+The table is never more than half full, so there always is one. */
+uint8_t ZigBeeClass::handlerSlot(uint16_t type, uint8_t endpoint, uint16_t cluster){
+	uint16_t hash=type ^ (cluster<<3) ^ (cluster>>5) ^ ((uint16_t) endpoint<<7) ^ endpoint;
+	uint8_t slot=(hash ^ (hash>>8)) & (MESSAGE_HANDLER_SLOTS-1);
+	while (_handlerSlots[slot]!=0){
+		struct messageHandlerEntry* entry=&_handlers[_handlerSlots[slot]-1];
+		if (entry->type==type && entry->endpoint==endpoint && entry->cluster==cluster) break;
+		slot=(slot+1) & (MESSAGE_HANDLER_SLOTS-1);
+	}
+	return slot;
+}
+
+void ZigBeeClass::indexHandlers(){
+	memset(_handlerSlots, 0, sizeof(_handlerSlots));
+	for (uint8_t i=0; i<_handlerCount; i++)
+		_handlerSlots[handlerSlot(_handlers[i].type, _handlers[i].endpoint, _handlers[i].cluster)]=i+1;
+}
+
+int ZigBeeClass::onMessage(uint16_t messageType, messageHandler handler){
+	return onMessage(messageType, ANY_ENDPOINT, ANY_CLUSTER, handler);
+}
+
+int ZigBeeClass::onMessage(uint16_t messageType, uint8_t endpoint, uint16_t cluster, messageHandler handler){
+	messageType=HANDLER_TYPE(messageType);
+	if (messageType!=AF_INCOMING_MSG){
+		endpoint=ANY_ENDPOINT;
+		cluster=ANY_CLUSTER;
+	}
+	uint8_t slot=handlerSlot(messageType, endpoint, cluster);
+	uint8_t index=_handlerSlots[slot];
+	if (handler==NULL){
+		if (index==0) return SUCCESS;
+		_handlers[index-1]=_handlers[--_handlerCount];	// move the last one into the hole and rebuild
+		indexHandlers();
+	} else if (index!=0){
+		_handlers[index-1].handler=handler;
+	} else {
+		if (_handlerCount>=MAX_MESSAGE_HANDLERS) return FAIL;
+		_handlers[_handlerCount].type=messageType;
+		_handlers[_handlerCount].endpoint=endpoint;
+		_handlers[_handlerCount].cluster=cluster;
+		_handlers[_handlerCount].handler=handler;
+		_handlerSlots[slot]=++_handlerCount;
+	}
+	return SUCCESS;
+}
+
+/** Calls the handler that best matches the message receive() just loaded, if any. At most four lookups. */
+void ZigBeeClass::dispatch(){
+	if (_handlerCount==0) return;
+	uint16_t type=HANDLER_TYPE(_received.type);
+	uint8_t index=0;
+	if (type==AF_INCOMING_MSG){
+		index=_handlerSlots[handlerSlot(type, _received.toEndpoint, _received.cluster)];
+		if (index==0) index=_handlerSlots[handlerSlot(type, _received.toEndpoint, ANY_CLUSTER)];
+		if (index==0) index=_handlerSlots[handlerSlot(type, ANY_ENDPOINT, _received.cluster)];
+	}
+	if (index==0) index=_handlerSlots[handlerSlot(type, ANY_ENDPOINT, ANY_CLUSTER)];
+	if (index!=0) _handlers[index-1].handler(_received);
+}
+#endif
+
+uint16_t ZigBeeClass::recoveries(uint8_t step){
+	return moduleRecoveries(step);
 }
 
 void ZigBeeClass::stop(){
+	moduleSetRecoveryHandler(NULL);	// the module is meant to be off
 	RADIO_OFF();
+#ifndef __MSP430G2553
+	_deviceInfoValid=0;
+#endif
+}
+
+// Returns the requested Device Information Property (LSB first), or NULL if the module couldn't be read.
+// Values are kept until the network state changes, so most calls don't talk to the module. That's noticed
+// wherever the ZDO_STATE_CHANGE_IND or SYS_RESET_IND is read, even if receive() is never called.
+uint8_t* ZigBeeClass::deviceInfo(uint8_t dip){
+#ifndef __MSP430G2553
+	if (moduleNetworkStateChanged()) _deviceInfoValid=0;
+	if (_deviceInfoValid & (1<<dip)) return _deviceInfo[dip];
+#endif
+	result = zbGetDeviceInfo(dip);
+	if (result != MODULE_SUCCESS) return NULL;
+#ifndef __MSP430G2553
+	memcpy(_deviceInfo[dip], zmBuf+SRSP_DIP_VALUE_FIELD, 8);
+	// Keep the state only once we've joined; until then it changes without us necessarily seeing the indication
+	if (dip!=DIP_STATE || _deviceInfo[dip][0]==getDeviceStateForDeviceType(config.deviceType))
+		_deviceInfoValid |= (1<<dip);
+	return _deviceInfo[dip];
+#else
+	return zmBuf+SRSP_DIP_VALUE_FIELD;
+#endif
+}
+
+int ZigBeeClass::refresh(){
+#ifndef __MSP430G2553
+	_deviceInfoValid=0;
+#endif
+	for (uint8_t dip=DIP_STATE; dip<=DIP_EXTENDED_PANID; dip++){
+		if (deviceInfo(dip)==NULL) return result;
+	}
+	return MODULE_SUCCESS;
 }
 
 uint32_t ZigBeeClass::module(uint16_t parameter){
 	if (parameter<0x0080){
-		result = zbGetDeviceInfo(0x000F & (parameter>>4) );
-		if (result != MODULE_SUCCESS) return 0xFFFFFFFF;
-		if (parameter==CHANNEL)
-			return 0x000000FF & zmBuf[SRSP_DIP_VALUE_FIELD];
+		uint8_t* value = deviceInfo(0x000F & (parameter>>4) );
+		if (value == NULL) return 0xFFFFFFFF;
+		if (parameter==CHANNEL || parameter==STATE)
+			return 0x000000FF & value[0];
 		else
-			return 0x0000FFFF & (CONVERT_TO_INT(zmBuf[SRSP_DIP_VALUE_FIELD], zmBuf[SRSP_DIP_VALUE_FIELD+1]));
+			return 0x0000FFFF & (CONVERT_TO_INT(value[0], value[1]));
 	}else if(parameter==DATETIME){
 		if ( sysGetTime()!=MODULE_SUCCESS ) return 0;
 		return((uint32_t) SYS_TIME_MSB())*65536+(uint16_t)SYS_TIME_LSB();
@@ -267,54 +661,60 @@ uint32_t ZigBeeClass::module(uint16_t parameter){
 	} else if(parameter==TEMPERATURE){
 		if (sysADC(ADC_CHANNEL_TEMPERATURE_READING,ADC_RESOLUTION_12_BIT)!=MODULE_SUCCESS) return 0;
 		return 0x0000FFFF & SYS_ADC_RESULT();
+	} else if(parameter==RESET_TIME){
+		return moduleResetTime();
 	}
+	return 0;
 }
 
 uint32_t ZigBeeClass::received(uint16_t parameter){
-	if(parameter==receivedType){
+	if(parameter==_received.type){
 		return 1;
-	} else if(parameter==AF_INCOMING_MSG && receivedType==AF_INCOMING_MSG_EXT){
+	} else if(parameter==AF_INCOMING_MSG && _received.type==AF_INCOMING_MSG_EXT){
 		return 2;
-	} else if(parameter==FROM_ADDRESS || parameter==ADDRESS){
-		return receivedFromAddress;
-	} else if(parameter==TO_ADDRESS){
-		return receivedToAddress;
-	}else if(parameter==LQI){
-		return receivedLqi;
-	}else if (parameter==FROM_ENDPOINT){
-		return receivedFromEndpoint;
-	}else if (parameter==TO_ENDPOINT){
-		return receivedToEndpoint;
-	}else if (parameter==CLUSTER_ID){
-		return receivedClusterId;
-	}else if (parameter==GROUP_ID){
-		return receivedGroup;
-	}else if(parameter==WAS_BROADCAST){
-		return receivedWasBroadcast;
-	}else if(parameter==CAPABILITIES){
-		return receivedCapabilities;
-	}else if(parameter==TRANSACTION){
-		return receivedTransaction;
-	}else if(parameter==TIMESTAMP){
-		return receivedTimestamp;
-	}else if(parameter==LENGTH){
-		return receivedLength;
-	}else if(parameter==TYPE){
-		return receivedType;
+	}
+	switch(parameter){
+	case FROM_ADDRESS:
+	case ADDRESS:
+		return _received.fromAddress;
+	case TO_ADDRESS:
+		return _received.toAddress;
+	case LQI:
+		return _received.lqi;
+	case FROM_ENDPOINT:
+		return _received.fromEndpoint;
+	case TO_ENDPOINT:
+		return _received.toEndpoint;
+	case CLUSTER_ID:
+		return _received.cluster;
+	case GROUP_ID:
+		return _received.group;
+	case WAS_BROADCAST:
+		return _received.wasBroadcast;
+	case CAPABILITIES:
+		return _received.capabilities;
+	case TRANSACTION:
+		return _received.transaction;
+	case TIMESTAMP:
+		return _received.timestamp;
+	case LENGTH:
+		return _received.length;
+	case TYPE:
+		return _received.type;
 	}
 	
 	return 0;
 }
 
 bool ZigBeeClass::connected(){
-	uint8_t tries;
-	while(result=zbGetDeviceInfo(DIP_STATE) != MODULE_SUCCESS){
+	uint8_t tries=0;
+	uint8_t* state;
+	while((state=deviceInfo(DIP_STATE)) == NULL){
 		tries++;
 		delay(50);
 		if (tries>5) return false;
 	}
-	uint8_t state=zmBuf[SRSP_DIP_VALUE_FIELD];
-	return (state==getDeviceStateForDeviceType(config.deviceType));
+	return (*state==getDeviceStateForDeviceType(config.deviceType));
 }
 
 void reversemac(uint8_t* buf){
@@ -327,11 +727,11 @@ void reversemac(uint8_t* buf){
 }
 
 int ZigBeeClass::bind(uint16_t addressname){
-	bind(address(),macAddress(),macAddress(addressname));
+	return bind(address(),macAddress(),macAddress(addressname));
 }
 
 int ZigBeeClass::unbind(uint16_t addressname){
-	unbind(address(),macAddress(),macAddress(addressname));
+	return unbind(address(),macAddress(),macAddress(addressname));
 }
 
 int ZigBeeClass::bind(uint16_t addressname, uint64_t sourceMac,uint64_t destinationMac){
@@ -340,7 +740,7 @@ int ZigBeeClass::bind(uint16_t addressname, uint64_t sourceMac,uint64_t destinat
 	reversemac(dstAddress.num);
 	srcAddress.num64=sourceMac;
 	reversemac(srcAddress.num);
-	return zdoRequestBind(addressname, srcAddress.num, DEFAULT_ENDPOINT, INFO_MESSAGE_CLUSTER, DESTINATION_ADDRESS_MODE_LONG, dstAddress.num, DEFAULT_ENDPOINT, BIND);
+	return zdoRequestBind(addressname, srcAddress.num, endpoint(), INFO_MESSAGE_CLUSTER, DESTINATION_ADDRESS_MODE_LONG, dstAddress.num, endpoint(), BIND);
 }
 
 int ZigBeeClass::unbind(uint16_t addressname, uint64_t sourceMac,uint64_t destinationMac){
@@ -349,7 +749,7 @@ int ZigBeeClass::unbind(uint16_t addressname, uint64_t sourceMac,uint64_t destin
 	reversemac(dstAddress.num);
 	srcAddress.num64=sourceMac;
 	reversemac(srcAddress.num);
-	return zdoRequestBind(addressname, srcAddress.num, DEFAULT_ENDPOINT, INFO_MESSAGE_CLUSTER, DESTINATION_ADDRESS_MODE_LONG, dstAddress.num, DEFAULT_ENDPOINT, UNBIND);
+	return zdoRequestBind(addressname, srcAddress.num, endpoint(), INFO_MESSAGE_CLUSTER, DESTINATION_ADDRESS_MODE_LONG, dstAddress.num, endpoint(), UNBIND);
 }
 
 int ZigBeeClass::bind(uint16_t addressname, uint8_t srcEndpoint, uint64_t sourceMac, uint8_t destinationEndpoint, uint64_t destinationMac, uint16_t cluster){
@@ -376,7 +776,7 @@ int ZigBeeClass::bindGroup(uint16_t addressname, uint64_t sourceMac, uint16_t gr
 	groupAddress.num[1]=MSB(groupname);
 	srcAddress.num64=sourceMac;
 	reversemac(srcAddress.num);
-	return zdoRequestBind(addressname, srcAddress.num, DEFAULT_ENDPOINT, INFO_MESSAGE_CLUSTER, DESTINATION_ADDRESS_MODE_GROUP, groupAddress.num, DEFAULT_ENDPOINT, BIND);
+	return zdoRequestBind(addressname, srcAddress.num, endpoint(), INFO_MESSAGE_CLUSTER, DESTINATION_ADDRESS_MODE_GROUP, groupAddress.num, endpoint(), BIND);
 
 }
 
@@ -386,7 +786,7 @@ int ZigBeeClass::unbindGroup(uint16_t addressname, uint64_t sourceMac, uint16_t
 	groupAddress.num[1]=MSB(groupname);
 	srcAddress.num64=sourceMac;
 	reversemac(srcAddress.num);
-	return zdoRequestBind(addressname, srcAddress.num, DEFAULT_ENDPOINT, INFO_MESSAGE_CLUSTER, DESTINATION_ADDRESS_MODE_GROUP, groupAddress.num, DEFAULT_ENDPOINT, UNBIND);
+	return zdoRequestBind(addressname, srcAddress.num, endpoint(), INFO_MESSAGE_CLUSTER, DESTINATION_ADDRESS_MODE_GROUP, groupAddress.num, endpoint(), UNBIND);
 }
 
 
@@ -437,11 +837,11 @@ uint32_t ZigBeeClass::time(){
 
 ///*
 uint64_t ZigBeeClass::macAddress(){
-	result=zbGetDeviceInfo(DIP_MAC_ADDRESS);
-	if (result != MODULE_SUCCESS) return 0;
+	uint8_t* value = deviceInfo(DIP_MAC_ADDRESS);
+	if (value == NULL) return 0;
 	mac_t a;
 	for (int i =0 ; i<8; i++){
-		a.num[i]=zmBuf[(7-i)+SRSP_DIP_VALUE_FIELD];
+		a.num[i]=value[7-i];
 	}
 	return a.num64;
 }
@@ -459,18 +859,15 @@ MACAddress ZigBeeClass::macAddress(){
 uint64_t ZigBeeClass::macAddress(uint8_t addresstype){
 	mac_t a;
 	if(addresstype==SELF || addresstype==PARENT){
-		if(addresstype==SELF)
-			result=zbGetDeviceInfo(DIP_MAC_ADDRESS);
-		else
-			result=zbGetDeviceInfo(DIP_PARENT_MAC_ADDRESS);		
-		if (result != MODULE_SUCCESS) return 0;		
+		uint8_t* value = deviceInfo((addresstype==SELF) ? DIP_MAC_ADDRESS : DIP_PARENT_MAC_ADDRESS);
+		if (value == NULL) return 0;		
 		for (int i =0 ; i<8; i++)
-			a.num[i]=zmBuf[(7-i)+SRSP_DIP_VALUE_FIELD];
+			a.num[i]=value[7-i];
 	}else if(addresstype==READ){
 		for (int i =0 ; i<8; i++)
 			a.num[i]=read(1);
 	}else if(addresstype==FROM){
-		return receivedMac;
+		return _received.mac;
 	}else{
 		return 0;
 	}
@@ -479,9 +876,28 @@ uint64_t ZigBeeClass::macAddress(uint8_t addresstype){
 
 
 uint64_t ZigBeeClass::macAddress(uint16_t address){
+	mac_t a;
+	uint8_t ieee[8];
+#ifndef __MSP430G2553
+	if (addressCacheFindIeeeAddress(address, ieee)){
+		for (int i =0 ; i<8; i++){
+			a.num[i]=ieee[7-i];
+		}
+		return a.num64;
+	}
+#endif
+	// Ask the module's address manager before asking the network
+	if (utilAddrMgrNwkAddrLookup(address, ieee) == MODULE_SUCCESS){
+#ifndef __MSP430G2553
+		addressCacheAdd(address, ieee);
+#endif
+		for (int i =0 ; i<8; i++){
+			a.num[i]=ieee[7-i];
+		}
+		return a.num64;
+	}
 	result = zdoRequestIeeeAddress(address, SINGLE_DEVICE_RESPONSE, 0);
 	if (result != MODULE_SUCCESS) return 0;
-	mac_t a;
 	uint8_t startField=SRSP_PAYLOAD_START+1;
 	for (int i =0 ; i<8; i++){
 		a.num[i]=zmBuf[(7-i)+startField];
@@ -490,27 +906,24 @@ uint64_t ZigBeeClass::macAddress(uint16_t address){
 }
 
 uint16_t ZigBeeClass::address(){
-    result = zbGetDeviceInfo(DIP_SHORT_ADDRESS);
-    if (result != MODULE_SUCCESS) return 0xFFFF;
-	return (CONVERT_TO_INT(zmBuf[SRSP_DIP_VALUE_FIELD] , zmBuf[SRSP_DIP_VALUE_FIELD+1]));
+	uint8_t* value = deviceInfo(DIP_SHORT_ADDRESS);
+	if (value == NULL) return 0xFFFF;
+	return (CONVERT_TO_INT(value[0] , value[1]));
 }
 
 uint16_t ZigBeeClass::address(uint8_t addresstype){
-	if (addresstype==SELF){
-		result = zbGetDeviceInfo(DIP_SHORT_ADDRESS);
-		if (result != MODULE_SUCCESS) return 0xFFFF;
-		return (CONVERT_TO_INT(zmBuf[SRSP_DIP_VALUE_FIELD] , zmBuf[SRSP_DIP_VALUE_FIELD+1]));
-	} else if (addresstype==PARENT){
-		result = zbGetDeviceInfo(DIP_PARENT_SHORT_ADDRESS);
-		if (result != MODULE_SUCCESS) return 0xFFFF;
-		return (CONVERT_TO_INT(zmBuf[SRSP_DIP_VALUE_FIELD] , zmBuf[SRSP_DIP_VALUE_FIELD+1]));
+	if (addresstype==SELF || addresstype==PARENT){
+		uint8_t* value = deviceInfo((addresstype==SELF) ? DIP_SHORT_ADDRESS : DIP_PARENT_SHORT_ADDRESS);
+		if (value == NULL) return 0xFFFF;
+		return (CONVERT_TO_INT(value[0] , value[1]));
 	} else if(addresstype==FROM){
-		return receivedFromAddress;
+		return _received.fromAddress;
 	} else if(addresstype==TO){
-		return receivedToAddress;
+		return _received.toAddress;
 	} else if(addresstype==READ){
 		result = read(2);
 	}
+	return result;
 }
 
 
@@ -519,6 +932,17 @@ uint16_t ZigBeeClass::address(uint64_t macAddr){
 	mac_t a;
 	a.num64=macAddr;
 	reversemac(a.num);
+	uint16_t shortAddress;
+#ifndef __MSP430G2553
+	if (addressCacheFindShortAddress(a.num, &shortAddress)) return shortAddress;
+#endif
+	// Ask the module's address manager before asking the network
+	if (utilAddrMgrExtAddrLookup(a.num, &shortAddress) == MODULE_SUCCESS){
+#ifndef __MSP430G2553
+		addressCacheAdd(shortAddress, a.num);
+#endif
+		return shortAddress;
+	}
 	uint8_t startField;
 	result=zdoNetworkAddressRequest(a.num, SINGLE_DEVICE_RESPONSE, 0);
 	startField=SRSP_PAYLOAD_START+ZDO_IEEE_ADDR_RSP_SHORT_ADDRESS_FIELD_START;
@@ -527,46 +951,65 @@ uint16_t ZigBeeClass::address(uint64_t macAddr){
 }
 
 
+#ifndef __MSP430G2553
+uint32_t ZigBeeClass::addressCacheHits(){
+	return ::addressCacheHits();
+}
+
+uint32_t ZigBeeClass::addressCacheMisses(){
+	return ::addressCacheMisses();
+}
+
+void ZigBeeClass::addressCacheClear(){
+	::addressCacheClear();
+}
+#endif
+
 uint8_t ZigBeeClass::lqi(){
-	return receivedLqi;
+	return _received.lqi;
 }
 
 uint16_t ZigBeeClass::panId(){
-    result = zbGetDeviceInfo(DIP_PANID);
-    if (result != MODULE_SUCCESS)
+	uint8_t* value = deviceInfo(DIP_PANID);
+	if (value == NULL)
 		return 0xFFFF;
 	else
-		return (CONVERT_TO_INT(zmBuf[SRSP_DIP_VALUE_FIELD], zmBuf[SRSP_DIP_VALUE_FIELD+1]));
+		return (CONVERT_TO_INT(value[0], value[1]));
 }
 
 uint8_t ZigBeeClass::channel(){
-    result = zbGetDeviceInfo(DIP_CHANNEL);
-    if (result != MODULE_SUCCESS)
+	uint8_t* value = deviceInfo(DIP_CHANNEL);
+	if (value == NULL)
 		return 0xFF;
 	else
-		return zmBuf[SRSP_DIP_VALUE_FIELD];
+		return value[0];
 }
 
 uint8_t ZigBeeClass::state(){
-    result = zbGetDeviceInfo(DIP_STATE);
-    if (result != MODULE_SUCCESS)
+	uint8_t* value = deviceInfo(DIP_STATE);
+	if (value == NULL)
 		return 0xFF;
 	else
-		return zmBuf[SRSP_DIP_VALUE_FIELD];
+		return value[0];
 }
 
 uint8_t ZigBeeClass::endpoint(){
-	return DEFAULT_ENDPOINT;
+#ifndef __MSP430G2553
+	return application[0].endPoint;
+#else
+	return application.endPoint;
+#endif
 }
 
 uint8_t ZigBeeClass::endpoint(uint8_t addresstype){
 	if(addresstype==TO){
-		return receivedToEndpoint;
+		return _received.toEndpoint;
 	}else if(addresstype==FROM){
-		return receivedFromEndpoint;
+		return _received.fromEndpoint;
 	}else if (addresstype==READ){
 		return read(1);
 	}
+	return 0;
 }
 
 uint16_t ZigBeeClass::cluster(){
@@ -575,7 +1018,8 @@ uint16_t ZigBeeClass::cluster(){
 
 uint16_t ZigBeeClass::cluster(uint8_t type){
 	if (type==READ)
-		return receivedClusterId;
+		return _received.cluster;
+	return INFO_MESSAGE_CLUSTER;
 }
 
 /*------------------------------------------------------------- MESSAGE CLASS --------------------------------------------------------*/
@@ -586,25 +1030,38 @@ void ZigBeeClass::ackMode(uint8_t ack){
 	afSetAckMode(ack);
 }
 
+// Discards the message being built
 void ZigBeeClass::flush(){
-	index=0;
+	txLength[txSelected]=0;
 }
 
 int ZigBeeClass::available(){
-	return receivedLength-index;
+	return _received.dataLength-rxIndex;
 }
 
 int ZigBeeClass::peek(){
-	if(index<MAX_MESSAGE_SIZE)
-		return buffer[index];
-	else{
-		printf("Error: Buffer exceeds %d",MAX_MESSAGE_SIZE);
-	}
+	if(rxIndex<_received.dataLength)
+		return _received.data[rxIndex];
+	return -1;
+}
+
+#ifndef __MSP430G2553
+void ZigBeeClass::compose(uint8_t builder){
+	if (builder<TX_MESSAGE_BUILDERS) txSelected=builder;
 }
 
+uint8_t ZigBeeClass::composing(){
+	return txSelected;
+}
+
+uint8_t ZigBeeClass::messageLength(uint8_t builder){
+	return (builder<TX_MESSAGE_BUILDERS)?txLength[builder]:0;
+}
+#endif
+
 size_t ZigBeeClass::write(uint8_t data){
-	if(index<MAX_MESSAGE_SIZE){
-		buffer[index++]=data;
+	if(txLength[txSelected]<MAX_MESSAGE_SIZE){
+		txBuffer[txSelected][txLength[txSelected]++]=data;
 		return 1;
 	}
 	else{
@@ -660,11 +1117,9 @@ size_t ZigBeeClass::write(char *buffer) {
 }
 
 int ZigBeeClass::read(){
-	if(index<MAX_MESSAGE_SIZE)
-		return buffer[index++];
-	else{
-		printf("Error: Buffer exceeds %d",MAX_MESSAGE_SIZE);
-	}
+	if(rxIndex<_received.dataLength)
+		return _received.data[rxIndex++];
+	return -1;
 }
 
 int ZigBeeClass::read(unsigned char* buffer, size_t size){
@@ -673,6 +1128,7 @@ int ZigBeeClass::read(unsigned char* buffer, size_t size){
 		buffer[i]=read();
 	}
 	buffer[i]='\0';
+	return i;
 }
 
 
@@ -733,13 +1189,52 @@ void ZigBeeClass::printlnTo(Print& p, uint16_t datatype, int format){
 }
 uint64_t ZigBeeClass::peek(uint16_t numbytes){
 	uint64_t readvalue =read(numbytes);
-	index-=(0x000F & numbytes);
+	rxIndex-=(0x000F & numbytes);
 	return readvalue;
 }
 
-uint8_t ZigBeeClass::appAdd(){return ++appCount;}
+uint8_t ZigBeeClass::appAdd(){
+#ifndef __MSP430G2553
+	struct applicationConfiguration app=DEFAULT_APPLICATION_CONFIGURATION;
+	while (appIndex(app.endPoint)!=MAX_APPLICATION_SIZE) app.endPoint--;
+	return appAdd(app);
+#else
+	return 0;
+#endif
+}
+
 uint8_t ZigBeeClass::appNum(){return appCount;}
-uint8_t ZigBeeClass::appDelete(){return --appCount;}
+
+uint8_t ZigBeeClass::appDelete(){
+	if (appCount>1) appCount--;
+	return appCount;
+}
+
+#ifndef __MSP430G2553
+uint8_t ZigBeeClass::appIndex(uint8_t endpoint){
+	uint8_t i;
+	for (i=0; i<appCount; i++)
+		if (application[i].endPoint==endpoint) break;
+	return (i<appCount)?i:MAX_APPLICATION_SIZE;
+}
+
+uint8_t ZigBeeClass::appAdd(const struct applicationConfiguration& app){
+	if (appCount>=MAX_APPLICATION_SIZE || !IS_VALID_ZIGBEE_ENDPOINT(app.endPoint) || appIndex(app.endPoint)!=MAX_APPLICATION_SIZE)
+		return 0;
+	if (app.numberOfBindingInputClusters>MAX_BINDING_CLUSTERS || app.numberOfBindingOutputClusters>MAX_BINDING_CLUSTERS)
+		return 0;
+	application[appCount]=app;
+	return ++appCount;
+}
+
+uint8_t ZigBeeClass::appDelete(uint8_t endpoint){
+	uint8_t i=appIndex(endpoint);
+	if (i==MAX_APPLICATION_SIZE || appCount==1) return 0;
+	for (appCount--; i<appCount; i++)
+		application[i]=application[i+1];
+	return appCount;
+}
+#endif
 
 
 
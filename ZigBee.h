@@ -17,9 +17,29 @@
 #ifdef __MSP430G2553
 #define MAX_MESSAGE_SIZE		32
 #define MAX_APPLICATION_SIZE	1
+#define TX_MESSAGE_BUILDERS		1
 #else
 #define MAX_APPLICATION_SIZE	4
 #define MAX_MESSAGE_SIZE		128
+#ifndef TX_MESSAGE_BUILDERS
+#if defined(__MSP430FR5969)
+#define TX_MESSAGE_BUILDERS		2		// only 2KB of RAM
+#else
+#define TX_MESSAGE_BUILDERS		4		// outgoing messages that can be built at once, MAX_MESSAGE_SIZE bytes of RAM each
+#endif
+#endif
+#ifndef MAX_MESSAGE_HANDLERS
+#define MAX_MESSAGE_HANDLERS	8		// handlers onMessage() can register
+#endif
+#ifndef MESSAGE_HANDLER_SLOTS
+#define MESSAGE_HANDLER_SLOTS	16		// lookup table size; a power of two, at least twice MAX_MESSAGE_HANDLERS
+#endif
+#ifndef POLL_MAX_MESSAGES
+#define POLL_MAX_MESSAGES		4		// messages poll() hands to the onMessage() handlers each time it's called
+#endif
+#if (MESSAGE_HANDLER_SLOTS & (MESSAGE_HANDLER_SLOTS-1)) || (MESSAGE_HANDLER_SLOTS < 2*MAX_MESSAGE_HANDLERS) || (MAX_MESSAGE_HANDLERS > 254)
+#error MESSAGE_HANDLER_SLOTS must be a power of two, at least twice MAX_MESSAGE_HANDLERS
+#endif
 #endif
 
 
@@ -36,6 +56,10 @@
 #define INCOMING				FROM
 #define OUTGOING				TO
 
+// RECEIVE MODES
+#define RECEIVE_POLLED			0x00	// receive() checks the module for one message
+#define RECEIVE_INTERRUPT		0x01	// SRDY interrupt queues messages as they arrive; receive() drains the queue
+
 
 #define CURRENT					0x00
 #define RECEIVED_TIMESTAMP		0x01
@@ -62,6 +86,10 @@
 #define INCOMING_DATA			AF_INCOMING_MSG				// 0x4481
 #define DATA_CONFIRM			AF_DATA_CONFIRM				// 0x4480
 
+// MESSAGE HANDLER WILDCARDS
+#define ANY_ENDPOINT			0xFFu
+#define ANY_CLUSTER				0xFFFFu
+
 // MODULE PARAMETERS			0x00XD
 #define STATE					0x0001u						// 0x00
 #define MAC_ADDRESS				0x0018u						// 0x01
@@ -75,6 +103,7 @@
 #define DATETIME				0x00B4u
 #define VOLTAGE					0x00C2u
 #define TEMPERATURE				0x00D2u
+#define RESET_TIME				0x00E4u						// microseconds the module took to be ready after the last reset
 
 
 
@@ -97,37 +126,75 @@ union mac_t {
   uint64_t num64;
 };
 
+// What receive() loaded from the last message; also what message handlers are given
+struct receivedMessage {
+	uint16_t type;				// STATE_CHANGE, DEVICE_ANNOUNCE, INCOMING_DATA, AF_INCOMING_MSG_EXT...
+	uint16_t fromAddress;
+	uint16_t toAddress;
+	uint8_t fromEndpoint;
+	uint8_t toEndpoint;
+	uint16_t cluster;
+	uint16_t group;
+	uint8_t lqi;
+	uint8_t wasBroadcast;
+	uint8_t capabilities;
+	uint8_t transaction;
+	uint32_t timestamp;
+	uint64_t mac;
+	uint16_t length;			// payload length as sent
+	uint8_t* data;				// where the payload is: the internal buffer, or the receiveBuffer()
+	uint16_t dataLength;		// how much of the payload is there
+};
+
+typedef void (*messageHandler)(const struct receivedMessage& message);
+
 class ZigBeeClass: public Stream
 {
 
 private:
-	uint8_t index;
 	uint8_t _status;
-	uint8_t buffer[MAX_MESSAGE_SIZE];
-	
-	
-	uint16_t receivedLength;
-	uint16_t receivedType;
-	uint8_t receivedCapabilities;
-	uint16_t receivedClusterId;
-	uint8_t  receivedLqi;	
-	uint8_t receivedWasBroadcast;
-	uint16_t receivedGroup;
-	uint16_t receivedToAddress;		
-	uint16_t receivedFromAddress;	
-	uint8_t receivedToEndpoint;
-	uint8_t receivedFromEndpoint;
-	uint8_t receivedTransaction;
-	uint32_t receivedTimestamp;
-	uint64_t receivedMac;
+	uint8_t txBuffer[TX_MESSAGE_BUILDERS][MAX_MESSAGE_SIZE];	// messages being built with write()
+	uint8_t txLength[TX_MESSAGE_BUILDERS];
+	uint8_t txSelected;				// the builder write() and send() use
+	uint8_t rxBuffer[MAX_MESSAGE_SIZE];
+	uint16_t rxIndex;				// next byte read() returns
+	struct receivedMessage _received;	// the last message receive() loaded
 	
 	//MACAddress receivedMac;
 	
 #ifndef __MSP430G2553
 	static void (*user_onReceive)(void);
-	uint8_t _applicationCount;
+	static void (*user_onSendProgress)(uint16_t sent, uint16_t total);
+	static void streamProgress(void* context, uint16_t sent, uint16_t total);
+	static void (*user_onReceiveChunk)(uint16_t index, uint8_t* data, uint8_t length);
+	static void (*user_onBegin)(int result);
+	uint8_t* _receiveBuffer;
+	uint16_t _receiveBufferSize;
+	static void srdyInterrupt(void);
+	static uint8_t recover();
+	void attachSrdyInterrupt();
+	uint8_t appIndex(uint8_t endpoint);	// which application has this endpoint, MAX_APPLICATION_SIZE if none
+	uint8_t _receiveMode;
+	uint8_t _deviceInfo[DIP_EXTENDED_PANID+1][8];	// Device Information Properties, LSB first
+	uint8_t _deviceInfoValid;						// bit n set if _deviceInfo[n] is current
+	struct messageHandlerEntry {
+		uint16_t type;
+		uint16_t cluster;
+		uint8_t endpoint;
+		messageHandler handler;
+	};
+	struct messageHandlerEntry _handlers[MAX_MESSAGE_HANDLERS];
+	uint8_t _handlerCount;
+	uint8_t _handlerSlots[MESSAGE_HANDLER_SLOTS];	// 1 + index into _handlers, 0 if free
+	uint8_t handlerSlot(uint16_t type, uint8_t endpoint, uint16_t cluster);
+	void indexHandlers();
+	void dispatch();
 #endif
 	int start();
+	uint8_t* deviceInfo(uint8_t dip);
+	int receiveNow(uint16_t messageType);
+	void receiveExtended();
+	static void receiveSink(void* context, uint16_t index, uint8_t* data, uint8_t length);
 	//void reverseMac(uint8_t* buf);
 public:
 
@@ -145,11 +212,24 @@ public:
 /******************* HAL Configuration ***************************/
 
 	// THESE METHODS CAN ALSO BE READ/WRITE BY USING ZigBee.hal.<variable>
+	// With HAL_FIXED_PINS (utility/_SETTINGS_.h) the board's default pins are built in and these have no effect
 
 	void mrstPin(uint8_t pin);
 	void mrdyPin(uint8_t pin);
 	void srdyPin(uint8_t pin);
 	void spiModule(uint8_t module);
+#ifndef __MSP430G2553
+	// SPI CLOCK: begin() tries faster SPI clocks with SYS_VERSION/SYS_RANDOM round trips and keeps the fastest reliable one,
+	// less a step for margin. Set a divider (SPI_CLOCK_DIV2...) before begin() to use that instead, or 0 to calibrate again.
+	// spiClock() is the rate in Hz (0 if the board's isn't known) and spiErrors() the round trips that failed calibrating.
+	// beginAsync() doesn't calibrate; it uses the divider set here, or the board's default.
+	void spiClockDivider(uint8_t divider);
+	uint32_t spiClock();
+	uint16_t spiErrors();
+	// UART: talk to the module over this serial port instead of SPI, e.g. ZigBee.uart(Serial1). Begin the port at the module's
+	// baud rate (115200) and call this before begin(). There's no SRDY, so use receive() or poll(), not RECEIVE_INTERRUPT or onReceive().
+	void uart(Stream& port);
+#endif
 
 /******************* MODULE Configuration ***************************/
 
@@ -174,6 +254,8 @@ public:
 	
 	// STARTUP OPTIONS: STARTOPT_CLEAR_CONFIG, STARTOPT_CLEAR_STATE, STARTOPT_AUTO
 	// DEFAULT: (STARTOPT_CLEAR_CONFIG + STARTOPT_CLEAR_STATE)
+	// WARM START: without STARTOPT_CLEAR_CONFIG the module keeps the settings written last time, and begin() only
+	// writes the ones that changed. reconnect() starts that way, or call startupOptions(0) before begin().
 	void startupOptions(uint8_t _startupOptions);
 	
 	// SECURITY MODE: SECURITY_MODE_OFF, SECURITY_MODE_PRECONFIGURED_KEYS, SECURITY_MODE_COORD_DIST_KEYS
@@ -200,6 +282,21 @@ public:
 	int begin();
 	int reconnect();
 	void stop(); // turns off ZigBee radio
+	// RECOVERY: when the module stops answering the SPI or UART port is reset, then the module is reset and the applications restored.
+	// How many times each step has been tried: RECOVERY_SPI_RESET, RECOVERY_MODULE_RESET, RECOVERY_APPLICATIONS
+	uint16_t recoveries(uint8_t step);
+#ifndef __MSP430G2553
+	// NON-BLOCKING START: beginAsync() returns straight away and poll() does the next step each time it's called, e.g. from loop().
+	// poll() returns OPERATION_PENDING until the device is on the network, then the result, which is also passed to onBegin().
+	// startupStep() says how far it has got: START_STEP_RESET ... START_STEP_DONE, or START_STEP_FAILED
+	// EVENT LOOP: once started, poll() runs the library's timers (sendAsync() timeouts...), collects AF_DATA_CONFIRMs and,
+	// if any onMessage() handlers are registered, hands up to POLL_MAX_MESSAGES messages to them. It never waits.
+	int beginAsync(uint8_t deviceType);
+	int beginAsync();
+	int poll();
+	uint8_t startupStep();
+	void onBegin( void (*)(int result) );
+#endif
 
 
 /******************* AF Functions ***************************/
@@ -213,6 +310,38 @@ public:
 	int broadcast();
 	int broadcast(uint8_t toEndpoint, uint8_t fromEndpoint, uint16_t cluster);
 	void ackMode(uint8_t ack); // ACK MODE: AF_MAC_ACK, AF_APS_ACK
+#ifndef __MSP430G2553
+	void receiveMode(uint8_t mode); // RECEIVE MODE: RECEIVE_POLLED, RECEIVE_INTERRUPT
+	
+	// ASYNCHRONOUS SEND: returns the transaction number (0-255) without waiting for delivery, or -1 on error
+	int sendAsync(uint16_t shortAddress);
+	int sendAsync(uint16_t shortAddress, uint8_t toEndpoint, uint8_t fromEndpoint, uint16_t cluster);
+	uint8_t sendStatus(uint8_t transaction); // AF_SEND_PENDING, SUCCESS, TIMEOUT, AF_SEND_UNKNOWN or a delivery error
+	void onSendComplete( void (*)(uint8_t transaction, uint8_t status) );
+	void maxPendingSends(uint8_t count); // 1 TO AF_MAX_PENDING_SENDS, DEFAULT: AF_MAX_PENDING_SENDS
+	uint8_t pendingSends();
+	
+	// STREAMED SEND: sends length bytes (up to AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH) read from source as they are needed
+	int send(uint16_t shortAddress, Stream& source, uint16_t length);
+	int send(uint16_t shortAddress, uint8_t toEndpoint, uint8_t fromEndpoint, uint16_t cluster, Stream& source, uint16_t length);
+	void onSendProgress( void (*)(uint16_t sent, uint16_t total) );
+	
+	// MESSAGE BUILDERS: write() and send() use builder 0 TO TX_MESSAGE_BUILDERS-1, DEFAULT: 0. Each keeps its message until it is sent.
+	void compose(uint8_t builder);
+	uint8_t composing();
+	uint8_t messageLength(uint8_t builder);
+	
+	// LARGE MESSAGES: extended messages go to this buffer instead of the internal MAX_MESSAGE_SIZE one, up to size bytes
+	void receiveBuffer(uint8_t* buffer, uint16_t size);
+	// and/or every message goes to this method, in chunks, as it comes from the module (don't use the ZigBee methods that talk to the module in it)
+	void onReceiveChunk( void (*)(uint16_t index, uint8_t* data, uint8_t length) );
+	
+	// MESSAGE HANDLERS: receive() calls the handler registered for the message's type, and for INCOMING_DATA the
+	// endpoint it came to and its cluster. The best match wins: exact, then ANY_CLUSTER, then ANY_ENDPOINT, then both.
+	// A NULL handler removes the registration. Returns SUCCESS, or FAIL if MAX_MESSAGE_HANDLERS are registered.
+	int onMessage(uint16_t messageType, messageHandler handler);
+	int onMessage(uint16_t messageType, uint8_t endpoint, uint16_t cluster, messageHandler handler);
+#endif
 	int receive();
 	int receive(uint16_t messageType);
 	
@@ -231,6 +360,12 @@ public:
 	int unbind(uint16_t addressname, uint8_t srcEndpoint, uint64_t sourceMac, uint8_t destinationEndpoint, uint64_t destinationMac, uint16_t cluster);
 	int bindGroup(uint16_t addressname, uint64_t sourceMac, uint16_t group);
 	int unbindGroup(uint16_t addressname, uint64_t sourceMac, uint16_t group);
+#ifndef __MSP430G2553
+	// ADDRESS CACHE: address() and macAddress() lookups answered without going over the air
+	uint32_t addressCacheHits();
+	uint32_t addressCacheMisses();
+	void addressCacheClear();
+#endif
 	
 	
 /******************* SYS Functions ***************************/
@@ -254,6 +389,7 @@ public:
 	uint32_t time();
 	int time(uint32_t clock);
 	bool connected();
+	int refresh();	// re-read the module properties above; they are otherwise kept until the network state changes
 
 /******************* MESSAGE FUNCTIONS *************************/
 
@@ -287,9 +423,15 @@ public:
 
 /***************************** APPLICATION FUNCTIONS ********************************/
 
-    uint8_t appAdd();
+	// ENDPOINTS: begin() registers application[0] TO application[appNum()-1], each its own endpoint. Send from any of them
+	// with send(address, toEndpoint, fromEndpoint, cluster); the default endpoint() is application[0]'s. Changes apply at the next begin().
+    uint8_t appAdd();	// adds a copy of the default application on the next free endpoint; returns appNum(), or 0 if there's no room
 	uint8_t appNum();
-	uint8_t appDelete();
+	uint8_t appDelete();	// removes the last application; returns appNum()
+#ifndef __MSP430G2553
+	uint8_t appAdd(const struct applicationConfiguration& app);	// returns appNum(), or 0 if there's no room or the endpoint is invalid or in use
+	uint8_t appDelete(uint8_t endpoint);	// returns appNum(), or 0 if there's no such endpoint or it's the only one
+#endif
 
 };
 
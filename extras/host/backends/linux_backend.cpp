@@ -0,0 +1,167 @@
+#include "linux_backend.h"
+#include "Energia.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+#define GPIO_CONSUMER_NAME      "zigbee"
+
+LinuxBackend::LinuxBackend() : _spiFd(-1), _chipFd(-1), _spiSpeed(1000000), _fixedSpeed(0)
+{
+}
+
+LinuxBackend::~LinuxBackend()
+{
+	close();
+}
+
+bool LinuxBackend::fail(const char* what, const char* device)
+{
+	char message[256];
+	snprintf(message, sizeof(message), "%s %s: %s", what, device, strerror(errno));
+	_error = message;
+	return false;
+}
+
+bool LinuxBackend::open(const char* spiDevice, const char* gpioChip)
+{
+	close();
+	_spiFd = ::open(spiDevice, O_RDWR);
+	if (_spiFd < 0)
+		return fail("cannot open", spiDevice);
+	_chipFd = ::open(gpioChip, O_RDWR);
+	if (_chipFd < 0)
+		return fail("cannot open", gpioChip);
+
+	uint32_t mode = SPI_MODE_0 | SPI_NO_CS;             //MRDY is our chip select
+	if (ioctl(_spiFd, SPI_IOC_WR_MODE32, &mode) < 0)
+	{
+		mode = SPI_MODE_0;                              //controller can't release CS; that's fine
+		if (ioctl(_spiFd, SPI_IOC_WR_MODE32, &mode) < 0)
+			return fail("cannot set mode 0 on", spiDevice);
+	}
+	uint8_t bits = 8;
+	if (ioctl(_spiFd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0)
+		return fail("cannot set 8 bit words on", spiDevice);
+	spiBegin(_spiSpeed);
+	return true;
+}
+
+void LinuxBackend::close()
+{
+	for (std::map<uint8_t, Line>::iterator it = _lines.begin(); it != _lines.end(); ++it)
+		::close(it->second.fd);
+	_lines.clear();
+	if (_chipFd >= 0)
+		::close(_chipFd);
+	if (_spiFd >= 0)
+		::close(_spiFd);
+	_chipFd = -1;
+	_spiFd = -1;
+}
+
+/** Requests (or re-requests, if the direction changed) a line. @return its fd, or -1 */
+int LinuxBackend::requestLine(uint8_t pin, uint8_t mode)
+{
+	std::map<uint8_t, Line>::iterator it = _lines.find(pin);
+	if (it != _lines.end())
+	{
+		if (it->second.mode == mode)
+			return it->second.fd;
+		::close(it->second.fd);
+		_lines.erase(it);
+	}
+	if (_chipFd < 0)
+		return -1;
+
+	struct gpio_v2_line_request request;
+	memset(&request, 0, sizeof(request));
+	request.offsets[0] = pin;
+	request.num_lines = 1;
+	strncpy(request.consumer, GPIO_CONSUMER_NAME, sizeof(request.consumer) - 1);
+	if (mode == OUTPUT)
+		request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+	else if (mode == INPUT_PULLUP)
+		request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+	else if (mode == INPUT_PULLDOWN)
+		request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN;
+	else
+		request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+	if (ioctl(_chipFd, GPIO_V2_GET_LINE_IOCTL, &request) < 0)
+	{
+		fail("cannot request GPIO line on", "gpiochip");
+		return -1;
+	}
+	Line line = { request.fd, mode };
+	_lines[pin] = line;
+	return request.fd;
+}
+
+void LinuxBackend::pinMode(uint8_t pin, uint8_t mode)
+{
+	requestLine(pin, mode);
+}
+
+void LinuxBackend::digitalWrite(uint8_t pin, uint8_t value)
+{
+	int fd = requestLine(pin, OUTPUT);
+	if (fd < 0)
+		return;
+	struct gpio_v2_line_values values;
+	values.bits = (value == LOW) ? 0 : 1;
+	values.mask = 1;
+	ioctl(fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
+}
+
+int LinuxBackend::digitalRead(uint8_t pin)
+{
+	std::map<uint8_t, Line>::iterator it = _lines.find(pin);
+	int fd = (it != _lines.end()) ? it->second.fd : requestLine(pin, INPUT);
+	if (fd < 0)
+		return HIGH;
+	struct gpio_v2_line_values values;
+	values.bits = 0;
+	values.mask = 1;
+	if (ioctl(fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)
+		return HIGH;
+	return (values.bits & 1) ? HIGH : LOW;
+}
+
+void LinuxBackend::setSpeed(uint32_t hz)
+{
+	_fixedSpeed = hz;
+	spiBegin(_spiSpeed);
+}
+
+void LinuxBackend::spiBegin(uint32_t clockHz)
+{
+	_spiSpeed = (_fixedSpeed != 0) ? _fixedSpeed : clockHz;
+	if (_spiFd >= 0)
+		ioctl(_spiFd, SPI_IOC_WR_MAX_SPEED_HZ, &_spiSpeed);
+}
+
+uint8_t LinuxBackend::spiTransfer(uint8_t out)
+{
+	uint8_t in = out;
+	spiTransferBlock(&in, 1);
+	return in;
+}
+
+/** One ioctl for the whole block; spidev copies the bytes out before it copies the reply in */
+void LinuxBackend::spiTransferBlock(uint8_t* buf, size_t count)
+{
+	struct spi_ioc_transfer transfer;
+	memset(&transfer, 0, sizeof(transfer));
+	transfer.tx_buf = (unsigned long) buf;
+	transfer.rx_buf = (unsigned long) buf;
+	transfer.len = count;
+	transfer.speed_hz = _spiSpeed;
+	transfer.bits_per_word = 8;
+	if (_spiFd < 0 || ioctl(_spiFd, SPI_IOC_MESSAGE(1), &transfer) < 0)
+		memset(buf, 0xFF, count);
+}
@@ -0,0 +1,57 @@
+/**
+*  @file linux_backend.h
+*
+*  @brief A HostBackend that talks to a real A2530 from Linux, e.g. on a gateway board.
+*
+* SPI goes through spidev (/dev/spidevB.C) in mode 0. MRST, MRDY and SRDY are GPIO lines on a GPIO
+* character device (/dev/gpiochipN), using the v2 uAPI; the pin numbers given to the library are
+* line offsets on that chip. MRDY is driven as a GPIO, so the spidev chip select can be left
+* unconnected.
+*/
+
+#ifndef LINUX_BACKEND_H
+#define LINUX_BACKEND_H
+
+#include "host_backend.h"
+#include <map>
+#include <string>
+
+class LinuxBackend : public HostBackend
+{
+public:
+	LinuxBackend();
+	~LinuxBackend();
+
+	/** Opens both devices. @return false if either could not be opened; see error() */
+	bool open(const char* spiDevice, const char* gpioChip);
+	void close();
+	const std::string& error() const { return _error; }
+	/** Clocks the bus at this speed whatever divider the library picks; 0 follows the library */
+	void setSpeed(uint32_t hz);
+
+	void pinMode(uint8_t pin, uint8_t mode);
+	void digitalWrite(uint8_t pin, uint8_t value);
+	int digitalRead(uint8_t pin);
+	void spiBegin(uint32_t clockHz);
+	void spiEnd() {}
+	uint8_t spiTransfer(uint8_t out);
+	void spiTransferBlock(uint8_t* buf, size_t count);
+
+private:
+	struct Line
+	{
+		int fd;
+		uint8_t mode;
+	};
+	int requestLine(uint8_t pin, uint8_t mode);
+	bool fail(const char* what, const char* device);
+
+	int _spiFd;
+	int _chipFd;
+	uint32_t _spiSpeed;
+	uint32_t _fixedSpeed;
+	std::map<uint8_t, Line> _lines;
+	std::string _error;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "linux_serial.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+LinuxSerial::LinuxSerial() : _fd(-1), _head(0), _tail(0)
+{
+}
+
+LinuxSerial::~LinuxSerial()
+{
+	close();
+}
+
+bool LinuxSerial::fail(const char* what, const char* device)
+{
+	char message[256];
+	snprintf(message, sizeof(message), "%s %s: %s", what, device, strerror(errno));
+	_error = message;
+	close();
+	return false;
+}
+
+static speed_t baudConstant(uint32_t baud)
+{
+	switch (baud)
+	{
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	case 460800: return B460800;
+	case 921600: return B921600;
+	default: return B0;
+	}
+}
+
+bool LinuxSerial::open(const char* device, uint32_t baud)
+{
+	close();
+	speed_t speed = baudConstant(baud);
+	if (speed == B0)
+	{
+		errno = EINVAL;
+		return fail("unsupported baud rate for", device);
+	}
+	_fd = ::open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (_fd < 0)
+		return fail("cannot open", device);
+	struct termios tty;
+	if (tcgetattr(_fd, &tty) < 0)
+		return fail("cannot read settings of", device);
+	cfmakeraw(&tty);
+	tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+	tty.c_cflag |= CLOCAL | CREAD;
+	cfsetispeed(&tty, speed);
+	cfsetospeed(&tty, speed);
+	if (tcsetattr(_fd, TCSANOW, &tty) < 0)
+		return fail("cannot configure", device);
+	tcflush(_fd, TCIOFLUSH);
+	return true;
+}
+
+void LinuxSerial::close()
+{
+	if (_fd >= 0)
+		::close(_fd);
+	_fd = -1;
+	_head = 0;
+	_tail = 0;
+}
+
+size_t LinuxSerial::write(uint8_t c)
+{
+	return write(&c, 1);
+}
+
+size_t LinuxSerial::write(const uint8_t* buffer, size_t size)
+{
+	size_t written = 0;
+	while (_fd >= 0 && written < size)
+	{
+		ssize_t n = ::write(_fd, buffer + written, size - written);
+		if (n > 0)
+			written += n;
+		else if (n < 0 && errno != EAGAIN && errno != EINTR)
+			break;
+	}
+	return written;
+}
+
+int LinuxSerial::available()
+{
+	if (_head == _tail && _fd >= 0)
+	{
+		ssize_t n = ::read(_fd, _buffer, sizeof(_buffer));
+		_head = 0;
+		_tail = (n > 0) ? n : 0;
+	}
+	return (int) (_tail - _head);
+}
+
+int LinuxSerial::read()
+{
+	if (available() == 0)
+		return -1;
+	return _buffer[_head++];
+}
+
+int LinuxSerial::peek()
+{
+	if (available() == 0)
+		return -1;
+	return _buffer[_head];
+}
+
+void LinuxSerial::flush()
+{
+	if (_fd >= 0)
+		tcdrain(_fd);
+}
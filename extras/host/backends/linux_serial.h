@@ -0,0 +1,46 @@
+/**
+*  @file linux_serial.h
+*
+*  @brief A serial port on Linux (/dev/ttyUSB0, /dev/ttyS1...), for a Module on a UART.
+*
+* The tty is put in raw mode, 8N1 with no flow control, and read without blocking: available() pulls
+* in whatever the kernel has received, so frames from the Module are never waited for. Use it with
+* ZigBee.uart().
+*/
+
+#ifndef LINUX_SERIAL_H
+#define LINUX_SERIAL_H
+
+#include "Energia.h"
+#include <string>
+
+class LinuxSerial : public Stream
+{
+public:
+	LinuxSerial();
+	~LinuxSerial();
+
+	/** Opens the tty at this baud rate. @return false if it could not be opened; see error() */
+	bool open(const char* device, uint32_t baud = 115200);
+	void close();
+	const std::string& error() const { return _error; }
+
+	size_t write(uint8_t c);
+	size_t write(const uint8_t* buffer, size_t size);
+	using Print::write;
+	int available();
+	int read();
+	int peek();
+	void flush();
+
+private:
+	bool fail(const char* what, const char* device);
+
+	int _fd;
+	uint8_t _buffer[256];
+	size_t _head;
+	size_t _tail;
+	std::string _error;
+};
+
+#endif
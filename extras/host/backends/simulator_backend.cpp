@@ -0,0 +1,36 @@
+#include "simulator_backend.h"
+#include "Energia.h"
+
+SimulatorBackend::SimulatorBackend(ZnpSimulator& simulator, uint8_t mrstPin, uint8_t mrdyPin, uint8_t srdyPin)
+	: _simulator(simulator), _mrstPin(mrstPin), _mrdyPin(mrdyPin), _srdyPin(srdyPin)
+{
+	_simulator.setClock([]() { return hostClock()->micros(); });
+}
+
+void SimulatorBackend::digitalWrite(uint8_t pin, uint8_t value)
+{
+	if (pin == _mrstPin)
+		_simulator.setReset(value == HIGH);
+	else if (pin == _mrdyPin)
+		_simulator.setMrdy(value == HIGH);
+	else
+		_otherPins[pin] = value;
+}
+
+int SimulatorBackend::digitalRead(uint8_t pin)
+{
+	if (pin == _srdyPin)
+		return _simulator.srdy() ? HIGH : LOW;
+	std::map<uint8_t, uint8_t>::const_iterator it = _otherPins.find(pin);
+	return (it == _otherPins.end()) ? HIGH : it->second;   //inputs read as pulled up
+}
+
+void SimulatorBackend::spiBegin(uint32_t clockHz)
+{
+	_simulator.setSpiClock(clockHz);
+}
+
+uint8_t SimulatorBackend::spiTransfer(uint8_t out)
+{
+	return _simulator.transfer(out);
+}
@@ -0,0 +1,34 @@
+/**
+*  @file simulator_backend.h
+*
+*  @brief A HostBackend that connects the library to an in-process ZnpSimulator.
+*
+* MRST, MRDY and SRDY are mapped to the simulator's signals; every other pin is just remembered so
+* that sketches can blink LEDs or read buttons. The simulator is put on the same clock as the shim.
+*/
+
+#ifndef SIMULATOR_BACKEND_H
+#define SIMULATOR_BACKEND_H
+
+#include "host_backend.h"
+#include "../znp_simulator.h"
+#include <map>
+
+class SimulatorBackend : public HostBackend
+{
+public:
+	SimulatorBackend(ZnpSimulator& simulator, uint8_t mrstPin, uint8_t mrdyPin, uint8_t srdyPin);
+	void digitalWrite(uint8_t pin, uint8_t value);
+	int digitalRead(uint8_t pin);
+	void spiBegin(uint32_t clockHz);
+	uint8_t spiTransfer(uint8_t out);
+	ZnpSimulator& simulator() { return _simulator; }
+private:
+	ZnpSimulator& _simulator;
+	uint8_t _mrstPin;
+	uint8_t _mrdyPin;
+	uint8_t _srdyPin;
+	std::map<uint8_t, uint8_t> _otherPins;
+};
+
+#endif
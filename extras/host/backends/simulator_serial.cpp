@@ -0,0 +1,125 @@
+#include "simulator_serial.h"
+
+#define UART_SOF                0xFE
+#define UART_BITS_PER_BYTE      10          //start bit, 8 data bits, stop bit
+/** How long the Module gets to move SRDY before the exchange is abandoned */
+#define SRDY_TIMEOUT_US         1000000
+
+SimulatorSerial::SimulatorSerial(ZnpSimulator& simulator, uint32_t baud)
+	: _simulator(simulator), _byteNs((uint32_t) (1000000000ULL * UART_BITS_PER_BYTE / baud)), _frameErrors(0)
+{
+	_simulator.setClock([]() { return hostClock()->micros(); });
+}
+
+size_t SimulatorSerial::write(uint8_t c)
+{
+	hostClock()->busCycle(_byteNs);
+	if (_fromHost.empty() && c != UART_SOF)
+		return 1;                                           //noise between frames
+	_fromHost.push_back(c);
+	if (_fromHost.size() >= 2 && _fromHost.size() == (size_t) _fromHost[1] + 5)
+	{
+		receiveFrame();
+		_fromHost.clear();
+	}
+	return 1;
+}
+
+/** Checks a whole frame from the library and passes it on to the simulator */
+void SimulatorSerial::receiveFrame()
+{
+	uint8_t fcs = 0;
+	for (size_t i = 1; i < _fromHost.size() - 1; i++)
+		fcs ^= _fromHost[i];
+	if (fcs != _fromHost.back())
+	{
+		_frameErrors++;
+		return;
+	}
+	std::vector<uint8_t> frame(_fromHost.begin() + 1, _fromHost.end() - 1);
+	if (frame[1] == 0x41 && frame[2] == 0x00)                   //SYS_RESET_REQ: the Module resets, and says so when it's back
+	{
+		_simulator.setReset(false);
+		_simulator.setReset(true);
+		_toHost.clear();
+		return;
+	}
+	if (exchange(frame))
+		sendFrame(frame);
+}
+
+bool SimulatorSerial::waitForSrdy(bool high)
+{
+	uint64_t start = hostClock()->micros();
+	while (_simulator.srdy() != high)
+	{
+		if (hostClock()->micros() - start >= SRDY_TIMEOUT_US)
+			return false;
+		hostClock()->busCycle(HOST_PIN_ACCESS_NS);
+	}
+	return true;
+}
+
+/** One SPI transaction with the simulator, as the Module's UART firmware would do internally */
+bool SimulatorSerial::exchange(std::vector<uint8_t>& frame)
+{
+	_simulator.setMrdy(false);
+	bool ok = waitForSrdy(false);
+	if (ok)
+	{
+		for (size_t i = 0; i < frame.size(); i++)
+			_simulator.transfer(frame[i]);
+		ok = waitForSrdy(true);
+	}
+	if (ok)
+	{
+		frame.assign(3, 0);
+		for (int i = 0; i < 3; i++)
+			frame[i] = _simulator.transfer(0);
+		for (int i = 0; i < frame[0]; i++)
+			frame.push_back(_simulator.transfer(0));
+	}
+	_simulator.setMrdy(true);
+	return ok;
+}
+
+void SimulatorSerial::sendFrame(const std::vector<uint8_t>& frame)
+{
+	uint8_t fcs = 0;
+	_toHost.push_back(UART_SOF);
+	for (size_t i = 0; i < frame.size(); i++)
+	{
+		_toHost.push_back(frame[i]);
+		fcs ^= frame[i];
+	}
+	_toHost.push_back(fcs);
+	hostClock()->busCycle(_byteNs * (frame.size() + 2));
+}
+
+int SimulatorSerial::available()
+{
+	hostClock()->busCycle(HOST_PIN_ACCESS_NS);
+	if (_toHost.empty() && !_simulator.srdy())                  //the Module has an AREQ; it sends it without being asked
+	{
+		std::vector<uint8_t> poll(3, 0);
+		if (exchange(poll) && poll[0] + poll[1] + poll[2] > 0)
+			sendFrame(poll);
+	}
+	return (int) _toHost.size();
+}
+
+int SimulatorSerial::read()
+{
+	if (available() == 0)
+		return -1;
+	uint8_t c = _toHost.front();
+	_toHost.pop_front();
+	return c;
+}
+
+int SimulatorSerial::peek()
+{
+	if (available() == 0)
+		return -1;
+	return _toHost.front();
+}
@@ -0,0 +1,49 @@
+/**
+*  @file simulator_serial.h
+*
+*  @brief A serial port with an in-process ZnpSimulator on the other end, speaking UART MT framing.
+*
+* Plays the Module's UART: frames the library writes (SOF, length, cmd0, cmd1, data, FCS) are checked
+* and handed to the simulator over its SPI signals, and whatever the simulator answers or has waiting
+* comes back framed the same way. A SYS_RESET_REQ resets the simulator, so nothing but this port needs
+* to be connected. Use it with ZigBee.uart() to run the UART transport without a real Module.
+*
+* Each byte costs the clock its time on the line at the given baud rate.
+*/
+
+#ifndef SIMULATOR_SERIAL_H
+#define SIMULATOR_SERIAL_H
+
+#include "Energia.h"
+#include "../znp_simulator.h"
+#include <deque>
+#include <vector>
+
+class SimulatorSerial : public Stream
+{
+public:
+	SimulatorSerial(ZnpSimulator& simulator, uint32_t baud = 115200);
+	size_t write(uint8_t c);
+	using Print::write;
+	int available();
+	int read();
+	int peek();
+	void flush() {}
+	ZnpSimulator& simulator() { return _simulator; }
+	/** Frames from the library that were dropped because their FCS was wrong */
+	uint32_t frameErrors() const { return _frameErrors; }
+
+private:
+	bool waitForSrdy(bool high);
+	bool exchange(std::vector<uint8_t>& frame);
+	void sendFrame(const std::vector<uint8_t>& frame);
+	void receiveFrame();
+
+	ZnpSimulator& _simulator;
+	uint32_t _byteNs;
+	std::deque<uint8_t> _toHost;
+	std::vector<uint8_t> _fromHost;     //frame being received from the library, without SOF
+	uint32_t _frameErrors;
+};
+
+#endif
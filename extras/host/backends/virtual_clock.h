@@ -0,0 +1,29 @@
+/**
+*  @file virtual_clock.h
+*
+*  @brief A HostClock that only moves when the program does something, for repeatable runs.
+*
+* Time advances by the bus cost of every pin access and SPI byte, and by the full amount of every
+* delay(). Nothing depends on how fast the host is, so the same program against the simulator
+* takes the same virtual time on every machine and every run.
+*/
+
+#ifndef VIRTUAL_CLOCK_H
+#define VIRTUAL_CLOCK_H
+
+#include "host_backend.h"
+
+class VirtualClock : public HostClock
+{
+public:
+	VirtualClock() : _ns(0) {}
+	uint64_t micros() { return _ns / 1000; }
+	uint64_t nanos() const { return _ns; }
+	void sleep(uint32_t us) { _ns += (uint64_t) us * 1000; }
+	void busCycle(uint32_t ns) { _ns += ns; }
+	void advance(uint64_t us) { _ns += us * 1000; }
+private:
+	uint64_t _ns;
+};
+
+#endif
@@ -0,0 +1,592 @@
+/**
+*  @file zigbee_bench.cpp
+*
+*  @brief Measures the library's transport, send, receive and startup paths against the ZNP simulator.
+*
+* Every scenario starts from a fresh simulator on a VirtualClock, so the virtual times it reports
+* (everything ending in _us, ops/s and bytes/s) only depend on the library and the simulator's Timing,
+* and are the same on every run and every machine. They are what to compare before and after a
+* change. cpu_ns_per_op is how long the host took, which does depend on the machine. Operations that
+* never touch the bus (e.g. address cache hits) take no virtual time and report 0 ops/s.
+*
+* Scenarios:
+* - spi:         the SPI transfer itself, into a loopback: byte at a time with SPI.transfer() and as one
+*                halSpiTransfer() block, per length. The shim charges HOST_SPI_CALL_NS per call, so the
+*                virtual times differ by that cost model and nothing else; cpu_ns_per_op is measured
+* - sreq:        SREQ/SRSP round trip (SYS_VERSION through sendMessage())
+* - handshake:   the MRDY/SRDY edges of a SREQ through the hal.h macros (assert MRDY, see SRDY low,
+*                release MRDY, see SRDY high), and a whole SYS_VERSION with the Module answering at once;
+*                runtime_pins, or fixed_pins in zigbee_bench_fixed_pins, which is built with HAL_FIXED_PINS.
+*                Their virtual times only differ by the shim's HOST_PIN_ACCESS_NS and HOST_PORT_ACCESS_NS,
+*                a cost model; cpu_ns_per_op is measured
+* - af_send:     afSendData() to a short address, including the wait for AF_DATA_CONFIRM, per payload size
+* - af_send_ext: afSendDataExtendedShort(), AF_DATA_REQUEST_EXT plus AF_DATA_STORE chunks, per size
+* - receive:     a burst of incoming messages, from injection until ZigBee.receive() returns each one;
+*                16 byte messages, and 400 byte ones that need AF_DATA_RETRIEVE, polled and with
+*                RECEIVE_INTERRUPT; dropped counts messages the receive queue had no room for
+* - lookup:      short to IEEE address: ZDO_IEEE_ADDR_REQ, UTIL_ADDRMGR_NWK_ADDR_LOOKUP, and
+*                ZigBee.macAddress() with a cold and a warm address cache
+* - begin:       ZigBee.begin(COORDINATOR) on a new Module (cold), again on the same Module without
+*                STARTOPT_CLEAR_CONFIG, so it keeps its configuration and network (warm), and
+*                ZigBee.reconnect(), which keeps the network and only rewrites changed configuration
+*
+* Usage: zigbee_bench [--scenario NAME]... [--format json|csv] [--output FILE] [--iterations N] [--list]
+*
+* @note Host-only code. Nothing under extras/ is compiled by Energia.
+*/
+
+#include <Energia.h>
+#include <ZigBee.h>
+#include "module.h"
+#include "af.h"
+#include "zdo.h"
+#include "hal.h"
+#include "message_queue.h"
+#include <SPI.h>
+#include "znp_simulator.h"
+#include "simulator_backend.h"
+#include "virtual_clock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define BENCH_DEVICES           16
+
+/** How this build's handshake reaches MRDY and SRDY. @see hal_gpio.h */
+#ifdef HAL_PIN_TRAITS
+#define BENCH_PINS              "fixed_pins"
+#else
+#define BENCH_PINS              "runtime_pins"
+#endif
+#define BENCH_FIRST_DEVICE      0x1000
+
+/** One row of output: a scenario, one of its variants, and the parameter it was run with */
+struct Result
+{
+	std::string scenario;
+	std::string variant;
+	uint32_t parameter;             //payload length, burst size, ...; 0 if none
+	uint32_t iterations;
+	uint32_t failures;
+	uint32_t dropped;               //messages the receive queue had no room for (messageQueueDropped())
+	double meanUs;
+	double minUs;
+	double maxUs;
+	double p50Us;
+	double p99Us;
+	double opsPerSecond;            //virtual
+	double bytesPerSecond;          //virtual, application payload only
+	double spiBytesPerOp;
+	double transactionsPerOp;
+	double cpuNsPerOp;              //host time, not repeatable
+};
+
+static std::vector<Result> results;
+static uint32_t iterationCount = 200;
+
+/** A fresh simulator on a fresh virtual clock, with the shim pointed at both */
+class Fixture
+{
+public:
+	Fixture() : backend(simulator, HOST_MRST_PIN, HOST_MRDY_PIN, HOST_SRDY_PIN)
+	{
+		select();
+		simulator.setClock([this]() { return clock.micros(); });
+	}
+	~Fixture()
+	{
+		hostSetBackend(NULL);
+		hostSetClock(NULL);
+	}
+	/** Points the shim at this fixture's clock and simulator */
+	void select()
+	{
+		hostSetClock(&clock);
+		hostSetBackend(&backend);
+	}
+	/** Starts a coordinator with BENCH_DEVICES children; a reset makes the Module forget them */
+	bool start(uint8_t startupOptions = DEFAULT_STARTUP_OPTIONS)
+	{
+		ZigBee.mrstPin(HOST_MRST_PIN);
+		ZigBee.mrdyPin(HOST_MRDY_PIN);
+		ZigBee.srdyPin(HOST_SRDY_PIN);
+		ZigBee.startupOptions(startupOptions);
+		int started = ZigBee.begin(COORDINATOR);
+		ZigBee.startupOptions(DEFAULT_STARTUP_OPTIONS);
+		if (started != SUCCESS)
+			return false;
+		for (int i = 0; i < BENCH_DEVICES; i++)
+		{
+			uint8_t ieee[8] = { (uint8_t) (i + 1), 0, 0, 0, 0x00, 0x4B, 0x12, 0x00 };
+			simulator.addDevice(BENCH_FIRST_DEVICE + i, ieee);
+		}
+		return true;
+	}
+	uint32_t spiBytes() const { return simulator.stats().bytesToModule + simulator.stats().bytesFromModule; }
+
+	VirtualClock clock;
+	ZnpSimulator simulator;
+	SimulatorBackend backend;
+};
+
+/** Collects per-operation virtual times, bus counters and host time for one Result */
+class Measurement
+{
+public:
+	Measurement(Fixture& fixture) : _fixture(&fixture), _failures(0)
+	{
+		_spiBytes = fixture.spiBytes();
+		_transactions = fixture.simulator.stats().transactions;
+		_dropped = messageQueueDropped();
+		_cpuStart = std::chrono::steady_clock::now();
+	}
+
+	/** Runs op and records how much virtual time it took */
+	template <typename Op> void time(Op op)
+	{
+		uint64_t startNs = _fixture->clock.nanos();
+		if (!op())
+			_failures++;
+		sample(_fixture->clock.nanos() - startNs);
+	}
+
+	void sample(uint64_t ns) { _samplesNs.push_back(ns); }
+	void fail() { _failures++; }
+	/** Counts bus bytes that didn't go to the simulator */
+	void countSpiBytes(uint32_t bytes) { _spiBytesDone += bytes; }
+
+	/** Moves the bus counters to another fixture, for scenarios that need a new one per operation */
+	void rebase(Fixture& fixture)
+	{
+		_spiBytesDone += _fixture->spiBytes() - _spiBytes;
+		_transactionsDone += _fixture->simulator.stats().transactions - _transactions;
+		_fixture = &fixture;
+		_spiBytes = fixture.spiBytes();
+		_transactions = fixture.simulator.stats().transactions;
+	}
+
+	/** @param opsNs virtual time for throughput; 0 to use the sum of the samples
+	@param bytesPerOp application bytes moved by one operation */
+	void finish(const char* scenario, const char* variant, uint32_t parameter, uint32_t bytesPerOp,
+	            uint64_t opsNs = 0)
+	{
+		double cpuNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - _cpuStart).count();
+		rebase(*_fixture);
+
+		Result r;
+		r.scenario = scenario;
+		r.variant = variant;
+		r.parameter = parameter;
+		r.iterations = _samplesNs.size();
+		r.failures = _failures;
+		r.dropped = messageQueueDropped() - _dropped;
+		std::vector<uint64_t> sorted(_samplesNs);
+		std::sort(sorted.begin(), sorted.end());
+		uint64_t totalNs = 0;
+		for (size_t i = 0; i < sorted.size(); i++)
+			totalNs += sorted[i];
+		if (opsNs == 0)
+			opsNs = totalNs;
+		size_t n = sorted.size();
+		r.meanUs = (n == 0) ? 0 : (double) totalNs / n / 1000;
+		r.minUs = (n == 0) ? 0 : sorted[0] / 1000.0;
+		r.maxUs = (n == 0) ? 0 : sorted[n - 1] / 1000.0;
+		r.p50Us = (n == 0) ? 0 : sorted[(n - 1) / 2] / 1000.0;
+		r.p99Us = (n == 0) ? 0 : sorted[(n - 1) * 99 / 100] / 1000.0;
+		r.opsPerSecond = (opsNs == 0) ? 0 : n * 1e9 / opsNs;
+		r.bytesPerSecond = r.opsPerSecond * bytesPerOp;
+		r.spiBytesPerOp = (n == 0) ? 0 : (double) _spiBytesDone / n;
+		r.transactionsPerOp = (n == 0) ? 0 : (double) _transactionsDone / n;
+		r.cpuNsPerOp = (n == 0) ? 0 : cpuNs / n;
+		results.push_back(r);
+	}
+
+private:
+	Fixture* _fixture;
+	std::vector<uint64_t> _samplesNs;
+	uint32_t _failures;
+	uint32_t _spiBytes;
+	uint32_t _transactions;
+	uint16_t _dropped;
+	uint64_t _spiBytesDone = 0;
+	uint64_t _transactionsDone = 0;
+	std::chrono::steady_clock::time_point _cpuStart;
+};
+
+static void fillPayload(uint8_t* data, uint16_t length)
+{
+	for (uint16_t i = 0; i < length; i++)
+		data[i] = (uint8_t) (i * 7 + 1);
+}
+
+/** Sends every byte straight back, so transfers can be timed on their own */
+class LoopbackBackend : public HostBackend
+{
+public:
+	void digitalWrite(uint8_t pin, uint8_t value) { (void) pin; (void) value; }
+	int digitalRead(uint8_t pin) { (void) pin; return HIGH; }
+	uint8_t spiTransfer(uint8_t out) { return out; }
+};
+
+static bool benchSpi()
+{
+	static const uint16_t lengths[] = { 3, 16, 64, 100, 250 };
+	Fixture f;
+	LoopbackBackend loopback;
+	hostSetBackend(&loopback);
+	halSpiInitModule();
+	uint8_t buffer[256];
+	for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+	{
+		uint16_t length = lengths[l];
+		fillPayload(buffer, length);
+		Measurement byte(f);
+		for (uint32_t i = 0; i < iterationCount; i++)
+		{
+			byte.time([&]() {
+				for (uint16_t b = 0; b < length; b++)
+					buffer[b] = SPI.transfer(buffer[b]);
+				return true;
+			});
+			byte.countSpiBytes(length);
+		}
+		byte.finish("spi", "per_byte", length, length);
+
+		Measurement block(f);
+		for (uint32_t i = 0; i < iterationCount; i++)
+		{
+			block.time([&]() { halSpiTransfer(buffer, length); return true; });
+			block.countSpiBytes(length);
+		}
+		block.finish("spi", "block", length, length);
+	}
+	return true;
+}
+
+static bool benchSreq()
+{
+	Fixture f;
+	if (!f.start())
+		return false;
+	Measurement m(f);
+	for (uint32_t i = 0; i < iterationCount; i++)
+		m.time([]() { return sysVersion() == MODULE_SUCCESS; });
+	m.finish("sreq", "sys_version", 0, 0);
+	return true;
+}
+
+static bool benchHandshake()
+{
+	Fixture f;
+	if (!f.start())
+		return false;
+	f.simulator.timing().mrdyToSrdy = 0;
+	f.simulator.timing().srsp = 0;
+	Measurement edges(f);
+	for (uint32_t i = 0; i < iterationCount; i++)
+		edges.time([]() {
+			SPI_SS_SET();
+			bool low = SRDY_IS_LOW();
+			SPI_SS_CLEAR();
+			return low && SRDY_IS_HIGH();
+		});
+	edges.finish("handshake", BENCH_PINS, 0, 0);
+
+	Measurement sreq(f);
+	for (uint32_t i = 0; i < iterationCount; i++)
+		sreq.time([]() { return sysVersion() == MODULE_SUCCESS; });
+	sreq.finish("handshake", BENCH_PINS "_sreq", 0, 0);
+	return true;
+}
+
+static bool benchAfSend()
+{
+	static const uint8_t lengths[] = { 1, 16, 32, 48, 64, MAXIMUM_PAYLOAD_LENGTH };
+	for (size_t l = 0; l < sizeof(lengths); l++)
+	{
+		Fixture f;
+		if (!f.start())
+			return false;
+		uint8_t data[MAXIMUM_PAYLOAD_LENGTH];
+		fillPayload(data, lengths[l]);
+		Measurement m(f);
+		for (uint32_t i = 0; i < iterationCount; i++)
+			m.time([&]() {
+				return afSendData(DEFAULT_ENDPOINT, DEFAULT_ENDPOINT, BENCH_FIRST_DEVICE + (i % BENCH_DEVICES),
+				                  INFO_MESSAGE_CLUSTER, data, lengths[l]) == MODULE_SUCCESS;
+			});
+		m.finish("af_send", "short", lengths[l], lengths[l]);
+	}
+	return true;
+}
+
+static bool benchAfSendExtended()
+{
+	static const uint16_t lengths[] = { 100, AF_DATA_REQUEST_EXT_MAX_PAYLOAD_LENGTH, 300, 460,
+	                                    AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH };
+	for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+	{
+		Fixture f;
+		if (!f.start())
+			return false;
+		uint8_t data[AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH];
+		fillPayload(data, lengths[l]);
+		Measurement m(f);
+		for (uint32_t i = 0; i < iterationCount; i++)
+			m.time([&]() {
+				return afSendDataExtendedShort(DEFAULT_ENDPOINT, DEFAULT_ENDPOINT, BENCH_FIRST_DEVICE + (i % BENCH_DEVICES),
+				                               INFO_MESSAGE_CLUSTER, data, lengths[l]) == MODULE_SUCCESS;
+			});
+		m.finish("af_send_ext", "short", lengths[l], lengths[l]);
+	}
+	return true;
+}
+
+/** Injects bursts of messages all at once and times each one from injection until receive() returns
+it. Throughput is over the whole burst, latency is per message. Extended messages are too long to come
+with their AF_INCOMING_MSG_EXT, so receive() retrieves them into a receiveBuffer(). */
+static bool benchReceive()
+{
+	static const struct { const char* variant; uint16_t burst; uint16_t length; uint8_t mode; } runs[] = {
+		{ "burst", 1, 16, RECEIVE_POLLED }, { "burst", 10, 16, RECEIVE_POLLED }, { "burst", 50, 16, RECEIVE_POLLED },
+		{ "extended", 1, 400, RECEIVE_POLLED }, { "extended", 10, 400, RECEIVE_POLLED },
+		{ "interrupt", 1, 16, RECEIVE_INTERRUPT }, { "interrupt", 10, 16, RECEIVE_INTERRUPT },
+		{ "interrupt", 50, 16, RECEIVE_INTERRUPT }, { "interrupt_extended", 10, 400, RECEIVE_INTERRUPT },
+	};
+	static uint8_t receiveBuffer[AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH];
+	for (size_t b = 0; b < sizeof(runs) / sizeof(runs[0]); b++)
+	{
+		Fixture f;
+		if (!f.start())
+			return false;
+		uint16_t burst = runs[b].burst;
+		uint8_t data[AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH];
+		fillPayload(data, runs[b].length);
+		ZigBee.receiveBuffer(receiveBuffer, sizeof(receiveBuffer));
+		ZigBee.receiveMode(runs[b].mode);
+		uint32_t rounds = std::max<uint32_t>(1, iterationCount / burst);
+		uint64_t burstNs = 0;
+		Measurement m(f);
+		for (uint32_t r = 0; r < rounds; r++)
+		{
+			uint64_t injectedNs = f.clock.nanos();
+			for (uint16_t i = 0; i < burst; i++)
+				f.simulator.injectIncoming(BENCH_FIRST_DEVICE + (i % BENCH_DEVICES), DEFAULT_ENDPOINT, DEFAULT_ENDPOINT,
+				                           INFO_MESSAGE_CLUSTER, data, runs[b].length);
+			uint16_t received = 0;
+			uint32_t attempts = 0;
+			while (received < burst && attempts++ < 10 * burst + 100)
+				if (ZigBee.receive() && ZigBee.received(INCOMING_DATA))
+				{
+					if (ZigBee.available() != runs[b].length)
+						m.fail();
+					m.sample(f.clock.nanos() - injectedNs);
+					received++;
+				}
+			for (; received < burst; received++)
+				m.fail();
+			burstNs += f.clock.nanos() - injectedNs;
+		}
+		m.finish("receive", runs[b].variant, burst, runs[b].length, burstNs);
+		ZigBee.receiveMode(RECEIVE_POLLED);
+		ZigBee.receiveBuffer(NULL, 0);
+	}
+	return true;
+}
+
+static bool benchLookup()
+{
+	Fixture f;
+	if (!f.start())
+		return false;
+	uint8_t ieee[8];
+
+	Measurement zdo(f);
+	for (uint32_t i = 0; i < iterationCount; i++)
+		zdo.time([&]() {
+			return zdoRequestIeeeAddress(BENCH_FIRST_DEVICE + (i % BENCH_DEVICES), SINGLE_DEVICE_RESPONSE, 0) == MODULE_SUCCESS;
+		});
+	zdo.finish("lookup", "zdo", BENCH_DEVICES, 0);
+
+	Measurement addrmgr(f);
+	for (uint32_t i = 0; i < iterationCount; i++)
+		addrmgr.time([&]() {
+			return utilAddrMgrNwkAddrLookup(BENCH_FIRST_DEVICE + (i % BENCH_DEVICES), ieee) == MODULE_SUCCESS;
+		});
+	addrmgr.finish("lookup", "addrmgr", BENCH_DEVICES, 0);
+
+	Measurement cold(f);
+	for (uint32_t i = 0; i < iterationCount; i++)
+	{
+		ZigBee.addressCacheClear();
+		cold.time([&]() { return ZigBee.macAddress((uint16_t) (BENCH_FIRST_DEVICE + (i % BENCH_DEVICES))) != 0; });
+	}
+	cold.finish("lookup", "mac_address_cold", BENCH_DEVICES, 0);
+
+	for (int i = 0; i < BENCH_DEVICES; i++)
+		ZigBee.macAddress((uint16_t) (BENCH_FIRST_DEVICE + i));
+	Measurement cached(f);
+	for (uint32_t i = 0; i < iterationCount; i++)
+		cached.time([&]() { return ZigBee.macAddress((uint16_t) (BENCH_FIRST_DEVICE + (i % BENCH_DEVICES))) != 0; });
+	cached.finish("lookup", "mac_address_cached", BENCH_DEVICES, 0);
+	return true;
+}
+
+static bool benchBegin()
+{
+	uint32_t coldIterations = std::max<uint32_t>(1, iterationCount / 10);
+	Fixture* f = new Fixture;
+	Measurement cold(*f);
+	for (uint32_t i = 0; i < coldIterations; i++)
+	{
+		if (i > 0)
+		{
+			Fixture* next = new Fixture;
+			cold.rebase(*next);
+			delete f;
+			f = next;
+			f->select();
+		}
+		cold.time([&]() { return f->start(); });
+	}
+	cold.finish("begin", "cold", 0, 0);
+
+	Measurement warm(*f);
+	for (uint32_t i = 0; i < coldIterations; i++)
+		warm.time([&]() { return f->start(0); });
+	warm.finish("begin", "warm", 0, 0);
+
+	Measurement reconnect(*f);
+	for (uint32_t i = 0; i < coldIterations; i++)
+		reconnect.time([&]() { return ZigBee.reconnect() == SUCCESS; });
+	reconnect.finish("begin", "reconnect", 0, 0);
+	delete f;
+	return true;
+}
+
+struct Scenario
+{
+	const char* name;
+	bool (*run)();
+};
+
+static const Scenario scenarios[] = {
+	{ "spi", benchSpi },
+	{ "sreq", benchSreq },
+	{ "handshake", benchHandshake },
+	{ "af_send", benchAfSend },
+	{ "af_send_ext", benchAfSendExtended },
+	{ "receive", benchReceive },
+	{ "lookup", benchLookup },
+	{ "begin", benchBegin },
+};
+#define SCENARIO_COUNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static void writeJson(FILE* out)
+{
+	fprintf(out, "{\n  \"iterations\": %u,\n  \"results\": [", iterationCount);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Result& r = results[i];
+		fprintf(out, "%s\n    {\"scenario\": \"%s\", \"variant\": \"%s\", \"parameter\": %u, \"iterations\": %u, "
+		        "\"failures\": %u, \"dropped\": %u, \"mean_us\": %.3f, \"min_us\": %.3f, \"max_us\": %.3f, \"p50_us\": %.3f, "
+		        "\"p99_us\": %.3f, \"ops_per_s\": %.3f, \"bytes_per_s\": %.3f, \"spi_bytes_per_op\": %.3f, "
+		        "\"transactions_per_op\": %.3f, \"cpu_ns_per_op\": %.0f}",
+		        (i == 0) ? "" : ",", r.scenario.c_str(), r.variant.c_str(), r.parameter, r.iterations, r.failures,
+		        r.dropped, r.meanUs, r.minUs, r.maxUs, r.p50Us, r.p99Us, r.opsPerSecond, r.bytesPerSecond, r.spiBytesPerOp,
+		        r.transactionsPerOp, r.cpuNsPerOp);
+	}
+	fprintf(out, "\n  ]\n}\n");
+}
+
+static void writeCsv(FILE* out)
+{
+	fprintf(out, "scenario,variant,parameter,iterations,failures,dropped,mean_us,min_us,max_us,p50_us,p99_us,"
+	        "ops_per_s,bytes_per_s,spi_bytes_per_op,transactions_per_op,cpu_ns_per_op\n");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Result& r = results[i];
+		fprintf(out, "%s,%s,%u,%u,%u,%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.0f\n",
+		        r.scenario.c_str(), r.variant.c_str(), r.parameter, r.iterations, r.failures, r.dropped, r.meanUs,
+		        r.minUs, r.maxUs, r.p50Us, r.p99Us, r.opsPerSecond, r.bytesPerSecond, r.spiBytesPerOp, r.transactionsPerOp,
+		        r.cpuNsPerOp);
+	}
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [--scenario NAME]... [--format json|csv] [--output FILE] [--iterations N] [--list]\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> selected;
+	bool csv = false;
+	const char* outputPath = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = (i + 1 < argc);
+		if (!strcmp(argv[i], "--scenario") && hasValue) selected.push_back(argv[++i]);
+		else if (!strcmp(argv[i], "--format") && hasValue)
+		{
+			const char* format = argv[++i];
+			if (!strcmp(format, "csv")) csv = true;
+			else if (strcmp(format, "json")) usage(argv[0]);
+		}
+		else if (!strcmp(argv[i], "--output") && hasValue) outputPath = argv[++i];
+		else if (!strcmp(argv[i], "--iterations") && hasValue) iterationCount = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "--list"))
+		{
+			for (size_t s = 0; s < SCENARIO_COUNT; s++)
+				printf("%s\n", scenarios[s].name);
+			return 0;
+		}
+		else usage(argv[0]);
+	}
+	if (iterationCount == 0)
+		usage(argv[0]);
+	for (size_t n = 0; n < selected.size(); n++)
+	{
+		size_t s = 0;
+		while (s < SCENARIO_COUNT && selected[n] != scenarios[s].name)
+			s++;
+		if (s == SCENARIO_COUNT)
+		{
+			fprintf(stderr, "unknown scenario %s; see --list\n", selected[n].c_str());
+			return 2;
+		}
+	}
+
+	hostSetSerialOutput(NULL);          //the library's debug output would end up in the results
+	int status = 0;
+	for (size_t s = 0; s < SCENARIO_COUNT; s++)
+	{
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), scenarios[s].name) == selected.end())
+			continue;
+		if (!scenarios[s].run())
+		{
+			fprintf(stderr, "%s: ZigBee.begin() failed\n", scenarios[s].name);
+			status = 1;
+		}
+	}
+
+	FILE* out = stdout;
+	if (outputPath != NULL && (out = fopen(outputPath, "w")) == NULL)
+	{
+		perror(outputPath);
+		return 1;
+	}
+	if (csv)
+		writeCsv(out);
+	else
+		writeJson(out);
+	if (out != stdout)
+		fclose(out);
+	return status;
+}
@@ -0,0 +1,35 @@
+#include "SPI.h"
+#include "host_backend.h"
+
+SPIClass SPI;
+
+void SPIClass::begin()
+{
+	hostBackend()->spiBegin(_clockHz);
+}
+
+void SPIClass::end()
+{
+	hostBackend()->spiEnd();
+}
+
+void SPIClass::setClockDivider(uint8_t divider)
+{
+	if (divider == 0)
+		divider = SPI_CLOCK_DIV2;
+	_clockHz = HOST_SPI_BASE_CLOCK / divider;
+	_byteNs = (uint32_t) (8000000000ULL / _clockHz);
+	hostBackend()->spiBegin(_clockHz);
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+	hostClock()->busCycle(_byteNs + HOST_SPI_CALL_NS);
+	return hostBackend()->spiTransfer(data);
+}
+
+void SPIClass::transfer(void* buf, size_t count)
+{
+	hostClock()->busCycle(_byteNs * count + HOST_SPI_CALL_NS);
+	hostBackend()->spiTransferBlock((uint8_t*) buf, count);
+}
@@ -0,0 +1,63 @@
+/**
+*  @file SPI.h
+*
+*  @brief The Energia SPI class for the host. Bytes go to the selected HostBackend.
+*
+* The clock dividers are relative to HOST_SPI_BASE_CLOCK, chosen so that SPI_CLOCK_DIV8 gives the
+* 1MHz the library comments assume. Each call to transfer() also costs HOST_SPI_CALL_NS, the gap a
+* processor leaves on the bus between calls, so a block transfer is cheaper than the same bytes one
+* at a time, as it is on the LaunchPads.
+*/
+
+#ifndef SPI_H
+#define SPI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SPI_MODE0               0x00
+#define SPI_MODE1               0x01
+#define SPI_MODE2               0x02
+#define SPI_MODE3               0x03
+
+#define SPI_CLOCK_DIV2          2
+#define SPI_CLOCK_DIV4          4
+#define SPI_CLOCK_DIV8          8
+#define SPI_CLOCK_DIV16         16
+#define SPI_CLOCK_DIV32         32
+#define SPI_CLOCK_DIV64         64
+#define SPI_CLOCK_DIV128        128
+
+#define LSBFIRST                0
+#define MSBFIRST                1
+
+#ifndef HOST_SPI_BASE_CLOCK
+#define HOST_SPI_BASE_CLOCK     8000000UL
+#endif
+
+/** Time between transfer() calls on the bus: the call, waiting for the byte to come back and reading it */
+#ifndef HOST_SPI_CALL_NS
+#define HOST_SPI_CALL_NS        1000
+#endif
+
+class SPIClass
+{
+public:
+	void begin();
+	void end();
+	void setModule(uint8_t module) { (void) module; begin(); }
+	void setDataMode(uint8_t mode) { (void) mode; }
+	void setBitOrder(uint8_t order) { (void) order; }
+	void setClockDivider(uint8_t divider);
+	uint8_t transfer(uint8_t data);
+	/** Clocks count bytes out of buf back to back, replacing them with the bytes clocked in */
+	void transfer(void* buf, size_t count);
+	uint32_t clockHz() const { return _clockHz; }
+private:
+	uint32_t _clockHz = HOST_SPI_BASE_CLOCK / SPI_CLOCK_DIV8;
+	uint32_t _byteNs = 8000000000ULL / (HOST_SPI_BASE_CLOCK / SPI_CLOCK_DIV8);
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+#include "Energia.h"
+
+#endif
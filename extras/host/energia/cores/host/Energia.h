@@ -0,0 +1,103 @@
+/**
+*  @file Energia.h
+*
+*  @brief The subset of the Energia core API used by the library, for building it on a Linux host.
+*
+* Pin, SPI and clock operations are forwarded to the HostBackend and HostClock selected with
+* hostSetBackend() and hostSetClock(). Serial writes to stdout (see hostSetSerialOutput()) and reads
+* from stdin.
+*/
+
+#ifndef Energia_h
+#define Energia_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH                    0x1
+#define LOW                     0x0
+
+#define INPUT                   0x0
+#define OUTPUT                  0x1
+#define INPUT_PULLUP            0x2
+#define INPUT_PULLDOWN          0x4
+
+#define CHANGE                  1
+#define FALLING                 2
+#define RISING                  3
+
+#define DEFAULT                 0
+#define INTERNAL1V5             1
+#define INTERNAL2V5             2
+#define TEMPSENSOR              10
+
+#define DEC                     10
+#define HEX                     16
+#define OCT                     8
+#define BIN                     2
+
+/* Default module pins on the host. These are line offsets on the GPIO chip when using the Linux
+backend, and just names when using the simulator. */
+#ifndef HOST_MRST_PIN
+#define HOST_MRST_PIN           0
+#endif
+#ifndef HOST_MRDY_PIN
+#define HOST_MRDY_PIN           1
+#endif
+#ifndef HOST_SRDY_PIN
+#define HOST_SRDY_PIN           2
+#endif
+
+#define lowByte(w)              ((uint8_t) ((w) & 0xff))
+#define highByte(w)             ((uint8_t) ((w) >> 8))
+#define bitRead(value, bit)     (((value) >> (bit)) & 0x01)
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogReference(uint16_t mode);
+uint16_t analogRead(uint8_t pin);
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+unsigned long millis();
+unsigned long micros();
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t pin);
+void noInterrupts();
+void interrupts();
+void yield();
+
+#include "host_backend.h"
+
+#ifdef __cplusplus
+#include "Print.h"
+#include "Stream.h"
+
+class HardwareSerial : public Stream
+{
+public:
+	void begin(unsigned long baud) { (void) baud; }
+	void end() {}
+	virtual size_t write(uint8_t c);
+	virtual size_t write(const uint8_t* buffer, size_t size);
+	using Print::write;
+	virtual int available();
+	virtual int read();
+	virtual int peek();
+	virtual void flush();
+	operator bool() { return true; }
+private:
+	int _peeked = -1;
+};
+
+extern HardwareSerial Serial;
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+#include "Print.h"
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+	size_t n = 0;
+	while (size--)
+		n += write(*buffer++);
+	return n;
+}
+
+size_t Print::print(const char* s)                      { return write(s); }
+size_t Print::print(char c)                             { return write((uint8_t) c); }
+size_t Print::print(unsigned char n, int base)          { return print((unsigned long long) n, base); }
+size_t Print::print(unsigned int n, int base)           { return print((unsigned long long) n, base); }
+size_t Print::print(unsigned long n, int base)          { return print((unsigned long long) n, base); }
+size_t Print::print(int n, int base)                    { return print((long long) n, base); }
+size_t Print::print(long n, int base)                   { return print((long long) n, base); }
+size_t Print::print(const Printable& p)                 { return p.printTo(*this); }
+
+size_t Print::print(long long n, int base)
+{
+	if (base == 0)
+		return write((uint8_t) n);
+	if ((base == 10) && (n < 0))
+		return print('-') + printNumber((unsigned long long) -n, 10);
+	return printNumber((unsigned long long) n, base);
+}
+
+size_t Print::print(unsigned long long n, int base)
+{
+	if (base == 0)
+		return write((uint8_t) n);
+	return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits)
+{
+	size_t count = 0;
+	if (n < 0.0)
+	{
+		count += print('-');
+		n = -n;
+	}
+	double rounding = 0.5;
+	for (int i = 0; i < digits; i++)
+		rounding /= 10.0;
+	n += rounding;
+	unsigned long long whole = (unsigned long long) n;
+	count += printNumber(whole, 10);
+	if (digits > 0)
+		count += print('.');
+	double remainder = n - (double) whole;
+	while (digits-- > 0)
+	{
+		remainder *= 10.0;
+		int digit = (int) remainder;
+		count += print((char) ('0' + digit));
+		remainder -= digit;
+	}
+	return count;
+}
+
+size_t Print::println()
+{
+	return write("\r\n");
+}
+
+size_t Print::printNumber(unsigned long long n, int base)
+{
+	char buf[8 * sizeof(n) + 1];
+	char* str = &buf[sizeof(buf) - 1];
+	*str = '\0';
+	if (base < 2)
+		base = 10;
+	do
+	{
+		int digit = (int) (n % base);
+		n /= base;
+		*--str = (char) ((digit < 10) ? ('0' + digit) : ('A' + digit - 10));
+	} while (n);
+	return write(str);
+}
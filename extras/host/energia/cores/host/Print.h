@@ -0,0 +1,39 @@
+#ifndef Print_h
+#define Print_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "Printable.h"
+
+/** Same interface as the Energia/Arduino Print class */
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t* buffer, size_t size);
+	size_t write(const char* str) { return (str == NULL) ? 0 : write((const uint8_t*) str, strlen(str)); }
+	size_t write(const char* buffer, size_t size) { return write((const uint8_t*) buffer, size); }
+
+	size_t print(const char* s);
+	size_t print(char c);
+	size_t print(unsigned char n, int base = 10);
+	size_t print(int n, int base = 10);
+	size_t print(unsigned int n, int base = 10);
+	size_t print(long n, int base = 10);
+	size_t print(unsigned long n, int base = 10);
+	size_t print(long long n, int base = 10);
+	size_t print(unsigned long long n, int base = 10);
+	size_t print(double n, int digits = 2);
+	size_t print(const Printable& p);
+
+	size_t println();
+	template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+	template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+
+private:
+	size_t printNumber(unsigned long long n, int base);
+};
+
+#endif
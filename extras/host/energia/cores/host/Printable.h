@@ -0,0 +1,16 @@
+#ifndef Printable_h
+#define Printable_h
+
+#include <stddef.h>
+
+class Print;
+
+/** Something that knows how to print itself, e.g. MACAddress */
+class Printable
+{
+public:
+	virtual ~Printable() {}
+	virtual size_t printTo(Print& p) const = 0;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include "Stream.h"
+#include "Energia.h"
+
+#define STREAM_POLL_US      100
+
+/** Like Arduino's, except that it sleeps between polls so that a virtual clock moves */
+int Stream::timedRead()
+{
+	unsigned long start = millis();
+	do
+	{
+		int c = read();
+		if (c >= 0)
+			return c;
+		delayMicroseconds(STREAM_POLL_US);
+	} while ((millis() - start) < _timeout);
+	return -1;
+}
+
+size_t Stream::readBytes(char* buffer, size_t length)
+{
+	size_t count = 0;
+	while (count < length)
+	{
+		int c = timedRead();
+		if (c < 0)
+			break;
+		buffer[count++] = (char) c;
+	}
+	return count;
+}
@@ -0,0 +1,25 @@
+#ifndef Stream_h
+#define Stream_h
+
+#include "Print.h"
+
+/** Same interface as the Energia/Arduino Stream class, without the parsing helpers */
+class Stream : public Print
+{
+public:
+	Stream() : _timeout(1000) {}
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+	virtual void flush() = 0;
+
+	void setTimeout(unsigned long timeout) { _timeout = timeout; }
+	size_t readBytes(char* buffer, size_t length);
+	size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*) buffer, length); }
+
+protected:
+	int timedRead();
+	unsigned long _timeout;             //milliseconds readBytes() waits for each byte
+};
+
+#endif
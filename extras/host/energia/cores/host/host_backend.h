@@ -0,0 +1,78 @@
+/**
+*  @file host_backend.h
+*
+*  @brief Where the host Energia shim sends pin, SPI and clock operations.
+*
+* The shim implements the Energia calls used by the library (digitalRead/digitalWrite, SPI.transfer,
+* delay, millis, attachInterrupt...) on top of two pluggable objects:
+* - a HostBackend, which owns the pins and the SPI port: the in-process ZNP simulator, or a real
+*   module on Linux spidev + GPIO character device.
+* - a HostClock, which provides time: the wall clock, or a virtual clock for repeatable runs.
+*
+* Select them with hostSetBackend() and hostSetClock() before calling ZigBee.begin().
+*/
+
+#ifndef HOST_BACKEND_H
+#define HOST_BACKEND_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+class HostBackend
+{
+public:
+	virtual ~HostBackend() {}
+	virtual void pinMode(uint8_t pin, uint8_t mode) { (void) pin; (void) mode; }
+	virtual void digitalWrite(uint8_t pin, uint8_t value) = 0;
+	virtual int digitalRead(uint8_t pin) = 0;
+	virtual uint16_t analogRead(uint8_t pin) { (void) pin; return 512; }
+	virtual void spiBegin(uint32_t clockHz) { (void) clockHz; }
+	virtual void spiEnd() {}
+	virtual uint8_t spiTransfer(uint8_t out) = 0;
+	/** Transfers a block in place; override to send it in one go, e.g. a single spidev ioctl */
+	virtual void spiTransferBlock(uint8_t* buf, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			buf[i] = spiTransfer(buf[i]);
+	}
+};
+
+class HostClock
+{
+public:
+	virtual ~HostClock() {}
+	virtual uint64_t micros() = 0;
+	virtual void sleep(uint32_t us) = 0;
+	/** Called for every pin access and SPI byte with how long it takes on the bus, so that a virtual
+	clock keeps moving while the library busy-waits on SRDY. */
+	virtual void busCycle(uint32_t ns) { (void) ns; }
+};
+
+/** Time taken by one digitalRead()/digitalWrite(), charged to the clock */
+#ifndef HOST_PIN_ACCESS_NS
+#define HOST_PIN_ACCESS_NS      250
+#endif
+
+/** Time taken by one direct port register access, as HAL_FIXED_PINS makes: a bus cycle */
+#ifndef HOST_PORT_ACCESS_NS
+#define HOST_PORT_ACCESS_NS     20
+#endif
+
+/** The host's port registers, for halHostPin in hal_gpio.h: the backend's pins, at the cost of a port
+access rather than a digitalRead()/digitalWrite(). Like a real port read, hostPortRead() doesn't run
+pin interrupts. */
+void hostPortWrite(uint8_t pin, uint8_t value);
+int hostPortRead(uint8_t pin);
+
+void hostSetBackend(HostBackend* backend);
+void hostSetClock(HostClock* clock);
+HostBackend* hostBackend();
+/** Where Serial output goes: stdout by default, NULL to discard it */
+void hostSetSerialOutput(FILE* output);
+HostClock* hostClock();
+
+/** Runs any attached pin interrupt whose pin has fallen/risen since the last check. The shim calls
+this from delay(), millis(), micros() and digitalRead(); call it from long loops of your own. */
+void hostServiceInterrupts();
+
+#endif
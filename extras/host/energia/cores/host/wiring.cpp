@@ -0,0 +1,265 @@
+/**
+* @file wiring.cpp
+*
+* @brief Energia pin, timing and interrupt calls for the host, forwarded to the selected HostBackend
+* and HostClock.
+*
+* Pin interrupts are emulated by sampling the attached pins whenever the library touches a pin or
+* asks for the time, and calling the handler on the selected edge. Handlers never nest, and are
+* held off between noInterrupts() and interrupts(), like on the LaunchPad.
+*/
+
+#include "Energia.h"
+#include <chrono>
+#include <thread>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/** The wall clock. Used unless hostSetClock() selects something else. */
+class RealClock : public HostClock
+{
+public:
+	uint64_t micros()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - _start).count();
+	}
+	void sleep(uint32_t us)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(us));
+	}
+private:
+	std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+};
+
+/** Used until hostSetBackend() is called: nothing is connected, so SRDY never goes low */
+class UnconnectedBackend : public HostBackend
+{
+public:
+	void digitalWrite(uint8_t pin, uint8_t value) { (void) pin; (void) value; }
+	int digitalRead(uint8_t pin) { (void) pin; return HIGH; }
+	uint8_t spiTransfer(uint8_t out) { (void) out; return 0xFF; }
+};
+
+static RealClock realClock;
+static UnconnectedBackend unconnected;
+static HostBackend* backend = &unconnected;
+static HostClock* clock_ = &realClock;
+
+void hostSetBackend(HostBackend* b) { backend = (b != NULL) ? b : &unconnected; }
+void hostSetClock(HostClock* c)     { clock_ = (c != NULL) ? c : &realClock; }
+HostBackend* hostBackend()          { return backend; }
+HostClock* hostClock()              { return clock_; }
+
+static FILE* serialOutput = stdout;
+
+void hostSetSerialOutput(FILE* output) { serialOutput = output; }
+
+/*
+*               INTERRUPTS
+*/
+
+#define MAX_HOST_INTERRUPTS     4
+/** How often delay() samples the interrupt pins */
+#define DELAY_SLICE_US          100
+
+struct HostInterrupt
+{
+	uint8_t pin;
+	int mode;
+	int lastLevel;
+	void (*handler)(void);
+};
+
+static HostInterrupt interruptTable[MAX_HOST_INTERRUPTS];
+static uint8_t interruptCount = 0;
+static uint8_t interruptsDisabled = 0;
+static bool inInterrupt = false;
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode)
+{
+	detachInterrupt(pin);
+	if (interruptCount == MAX_HOST_INTERRUPTS)
+		return;
+	HostInterrupt* i = &interruptTable[interruptCount++];
+	i->pin = pin;
+	i->mode = mode;
+	i->handler = handler;
+	i->lastLevel = backend->digitalRead(pin);
+}
+
+void detachInterrupt(uint8_t pin)
+{
+	for (uint8_t i = 0; i < interruptCount; i++)
+		if (interruptTable[i].pin == pin)
+		{
+			interruptTable[i] = interruptTable[--interruptCount];
+			return;
+		}
+}
+
+void noInterrupts()     { interruptsDisabled = 1; }
+void interrupts()       { interruptsDisabled = 0; hostServiceInterrupts(); }
+
+void hostServiceInterrupts()
+{
+	if (interruptsDisabled || inInterrupt || (interruptCount == 0))
+		return;
+	inInterrupt = true;
+	for (uint8_t n = 0; n < interruptCount; n++)
+	{
+		HostInterrupt* i = &interruptTable[n];
+		int level = backend->digitalRead(i->pin);
+		bool fire = ((i->mode == FALLING) && (i->lastLevel == HIGH) && (level == LOW)) ||
+		            ((i->mode == RISING) && (i->lastLevel == LOW) && (level == HIGH)) ||
+		            ((i->mode == CHANGE) && (i->lastLevel != level));
+		i->lastLevel = level;
+		if (fire)
+		{
+			i->handler();
+			i->lastLevel = backend->digitalRead(i->pin);
+		}
+	}
+	inInterrupt = false;
+}
+
+/*
+*               PINS
+*/
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	backend->pinMode(pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	clock_->busCycle(HOST_PIN_ACCESS_NS);
+	backend->digitalWrite(pin, value);
+}
+
+int digitalRead(uint8_t pin)
+{
+	clock_->busCycle(HOST_PIN_ACCESS_NS);
+	int level = backend->digitalRead(pin);
+	hostServiceInterrupts();
+	return level;
+}
+
+void hostPortWrite(uint8_t pin, uint8_t value)
+{
+	clock_->busCycle(HOST_PORT_ACCESS_NS);
+	backend->digitalWrite(pin, value);
+}
+
+int hostPortRead(uint8_t pin)
+{
+	clock_->busCycle(HOST_PORT_ACCESS_NS);
+	return backend->digitalRead(pin);
+}
+
+void analogReference(uint16_t mode)
+{
+	(void) mode;
+}
+
+uint16_t analogRead(uint8_t pin)
+{
+	clock_->busCycle(HOST_PIN_ACCESS_NS);
+	return backend->analogRead(pin);
+}
+
+/*
+*               TIME
+*/
+
+unsigned long micros()
+{
+	hostServiceInterrupts();
+	return (unsigned long) clock_->micros();
+}
+
+unsigned long millis()
+{
+	hostServiceInterrupts();
+	return (unsigned long) (clock_->micros() / 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	uint64_t end = clock_->micros() + us;
+	uint64_t now;
+	while ((now = clock_->micros()) < end)
+	{
+		uint64_t left = end - now;
+		clock_->sleep((interruptCount > 0) && (left > DELAY_SLICE_US) ? DELAY_SLICE_US : (uint32_t) left);
+		hostServiceInterrupts();
+	}
+}
+
+void delay(uint32_t ms)
+{
+	while (ms--)
+		delayMicroseconds(1000);
+}
+
+void yield()
+{
+	hostServiceInterrupts();
+}
+
+/*
+*               SERIAL
+*/
+
+HardwareSerial Serial;
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	if (serialOutput == NULL)
+		return 1;
+	return (fputc(c, serialOutput) == EOF) ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+	if (serialOutput == NULL)
+		return size;
+	return fwrite(buffer, 1, size, serialOutput);
+}
+
+int HardwareSerial::available()
+{
+	if (_peeked >= 0)
+		return 1;
+	struct pollfd p = { STDIN_FILENO, POLLIN, 0 };
+	return ((poll(&p, 1, 0) == 1) && (p.revents & POLLIN)) ? 1 : 0;
+}
+
+int HardwareSerial::read()
+{
+	if (_peeked >= 0)
+	{
+		int c = _peeked;
+		_peeked = -1;
+		return c;
+	}
+	if (!available())
+		return -1;
+	uint8_t c;
+	return (::read(STDIN_FILENO, &c, 1) == 1) ? c : -1;
+}
+
+int HardwareSerial::peek()
+{
+	if (_peeked < 0)
+		_peeked = read();
+	return _peeked;
+}
+
+void HardwareSerial::flush()
+{
+	if (serialOutput != NULL)
+		fflush(serialOutput);
+}
@@ -0,0 +1,206 @@
+/**
+*  @file host_coordinator.cpp
+*
+*  @brief The Basic Tutorial coordinator, running on Linux.
+*
+* By default the module is the in-process ZNP simulator, which also plays a few end devices that
+* announce themselves and send a counter every 100mSec. Give --spidev and --gpiochip to drive a real
+* A2530 from a gateway board instead, or --uart to drive one on a serial port (e.g. a USB-UART) with
+* UART MT framing. --simulated-uart talks to the simulator that way too. --virtual-clock runs on a
+* clock that only moves with bus traffic and delays, so runs against the simulator are repeatable and
+* as fast as the host allows.
+*
+* Usage: host_coordinator [--spidev /dev/spidev0.0 --gpiochip /dev/gpiochip0 --mrst N --mrdy N --srdy N]
+*                         [--speed HZ] [--uart /dev/ttyUSB0 [--baud N] | --simulated-uart]
+*                         [--virtual-clock] [--devices N] [--seconds N]
+*/
+
+#include <Energia.h>
+#include <SPI.h>
+#include <ZigBee.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "znp_simulator.h"
+#include "simulator_backend.h"
+#include "linux_backend.h"
+#include "linux_serial.h"
+#include "simulator_serial.h"
+#include "virtual_clock.h"
+
+#define MESSAGE_INTERVAL_MS     100
+
+static ZnpSimulator simulator;
+static bool simulated = true;
+static int deviceCount = 3;
+static uint8_t counter = 0;
+
+void printNetwork(int connectStatus){
+  if(connectStatus==SUCCESS){
+    Serial.println("Success!");
+    Serial.print("Connected to: PanID: 0x");
+    Serial.print(ZigBee.panId(),HEX);
+    Serial.print(", Channel: 0x");
+    Serial.print(ZigBee.channel(),HEX);
+    Serial.print(", Address: 0x");
+    Serial.println(ZigBee.address(),HEX);
+  }
+  else{
+    Serial.print("Error: 0x");
+    Serial.println(connectStatus,HEX);
+  }
+}
+
+void setup()
+{
+  Serial.begin(9600);
+  Serial.print("Coordinator: Initializing Network...");
+  printNetwork(ZigBee.begin(COORDINATOR));
+}
+
+void loop(){
+  if(ZigBee.connected()){ // check if network joined
+    if (ZigBee.receive()){
+      if (ZigBee.received(TYPE)==DEVICE_ANNOUNCE){
+        Serial.print("Device Announce From: 0x");
+        Serial.println(ZigBee.address(FROM),HEX);
+      }
+      else if (ZigBee.received(TYPE)==INCOMING_DATA){
+        Serial.print("Data From: 0x");
+        Serial.print(ZigBee.address(FROM),HEX);
+        Serial.print(" Counter=");
+        Serial.println(ZigBee.read());
+      }
+    }
+    else
+      delayMicroseconds(100);
+  } 
+  else {
+    Serial.print("Disconnected...Restarting...");
+    printNetwork(ZigBee.begin(COORDINATOR));
+  }
+}
+
+/** Plays the simulated end devices: each announces itself once, then they take turns sending */
+static void simulateDevices()
+{
+  static bool announced = false;
+  static unsigned long lastMessage = 0;
+  if (!ZigBee.connected())
+    return;
+  if (!announced)
+  {
+    for (int i = 0; i < deviceCount; i++)
+    {
+      uint8_t ieee[8] = { (uint8_t) (i + 1), 0, 0, 0, 0x00, 0x4B, 0x12, 0x00 };
+      simulator.announceDevice(0x1000 + i, ieee, 0x8C, 1000 * (i + 1));
+    }
+    announced = true;
+    lastMessage = millis();
+  }
+  if (deviceCount > 0 && (millis() - lastMessage) >= MESSAGE_INTERVAL_MS)
+  {
+    lastMessage = millis();
+    uint8_t payload[1] = { counter };
+    simulator.injectIncoming(0x1000 + (counter % deviceCount), DEFAULT_ENDPOINT, DEFAULT_ENDPOINT, INFO_MESSAGE_CLUSTER, payload, sizeof(payload));
+    counter++;
+  }
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "usage: %s [--spidev PATH --gpiochip PATH --mrst N --mrdy N --srdy N] [--speed HZ]\n"
+          "          [--uart PATH [--baud N] | --simulated-uart] [--virtual-clock] [--devices N] [--seconds N]\n", name);
+  exit(2);
+}
+
+int main(int argc, char** argv)
+{
+  const char* spidev = NULL;
+  const char* gpiochip = NULL;
+  int mrst = HOST_MRST_PIN, mrdy = HOST_MRDY_PIN, srdy = HOST_SRDY_PIN;
+  uint32_t speed = 0;
+  const char* uart = NULL;
+  uint32_t baud = 115200;
+  bool simulatedUart = false;
+  bool virtualClock = false;
+  double seconds = 10;
+
+  for (int i = 1; i < argc; i++)
+  {
+    bool hasValue = (i + 1 < argc);
+    if (!strcmp(argv[i], "--spidev") && hasValue) spidev = argv[++i];
+    else if (!strcmp(argv[i], "--gpiochip") && hasValue) gpiochip = argv[++i];
+    else if (!strcmp(argv[i], "--mrst") && hasValue) mrst = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--mrdy") && hasValue) mrdy = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--srdy") && hasValue) srdy = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--speed") && hasValue) speed = strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--uart") && hasValue) uart = argv[++i];
+    else if (!strcmp(argv[i], "--baud") && hasValue) baud = strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--simulated-uart")) simulatedUart = true;
+    else if (!strcmp(argv[i], "--devices") && hasValue) deviceCount = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seconds") && hasValue) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--virtual-clock")) virtualClock = true;
+    else usage(argv[0]);
+  }
+  if ((spidev == NULL) != (gpiochip == NULL))
+    usage(argv[0]);
+  if ((uart != NULL) + (spidev != NULL) + simulatedUart > 1)
+    usage(argv[0]);
+
+  VirtualClock clock;
+  if (virtualClock)
+    hostSetClock(&clock);
+
+  LinuxBackend linuxBackend;
+  SimulatorBackend simulatorBackend(simulator, mrst, mrdy, srdy);
+  LinuxSerial linuxSerial;
+  SimulatorSerial simulatorSerial(simulator);
+  if (uart != NULL)
+  {
+    if (!linuxSerial.open(uart, baud))
+    {
+      fprintf(stderr, "%s\n", linuxSerial.error().c_str());
+      return 1;
+    }
+    ZigBee.uart(linuxSerial);                 //MRST, MRDY and SRDY aren't connected
+    simulated = false;
+  }
+  else if (simulatedUart)
+    ZigBee.uart(simulatorSerial);
+  else if (spidev != NULL)
+  {
+    if (!linuxBackend.open(spidev, gpiochip))
+    {
+      fprintf(stderr, "%s\n", linuxBackend.error().c_str());
+      return 1;
+    }
+    if (speed != 0)
+      linuxBackend.setSpeed(speed);
+    hostSetBackend(&linuxBackend);
+    simulated = false;
+  }
+  else
+    hostSetBackend(&simulatorBackend);
+
+  ZigBee.mrstPin(mrst);
+  ZigBee.mrdyPin(mrdy);
+  ZigBee.srdyPin(srdy);
+
+  unsigned long start = millis();
+  setup();
+  while ((millis() - start) < (unsigned long) (seconds * 1000))
+  {
+    if (simulated)
+      simulateDevices();
+    loop();
+  }
+
+  if (simulated)
+  {
+    const ZnpSimulator::Stats& stats = simulator.stats();
+    fprintf(stderr, "%lu ms: %u transactions, %u SREQs, %u polls, %u AREQs sent, %u protocol errors\n",
+            millis() - start, stats.transactions, stats.sreqs, stats.polls, stats.areqsSent, stats.protocolErrors);
+  }
+  return 0;
+}
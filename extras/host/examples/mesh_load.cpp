@@ -0,0 +1,129 @@
+/**
+*  @file mesh_load.cpp
+*
+*  @brief Runs the Gateway Sensor Tutorial with hundreds of sensors on a VirtualMesh and reports what
+*  the network and the coordinator went through.
+*
+* Node 0 runs Gateway_Coordinator, every sensor runs Sensor_End_Device, and optional host-less routers
+* spread the sensors into a two-level tree. All times are virtual, so results only depend on the
+* options and the seed.
+*
+* Usage: mesh_load [--sensors N] [--routers N] [--max-children N] [--latency US] [--loss P] [--queue N]
+*                  [--stagger MS] [--seconds N] [--seed N] [--areq-limit N] [--trace NODE]...
+*
+* --trace prints a node's Serial output; node 0 is the coordinator, sensors follow the routers.
+*/
+
+#include "virtual_mesh.h"
+#include "module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "usage: %s [--sensors N] [--routers N] [--max-children N] [--latency US] [--loss P]\n"
+          "          [--queue N] [--stagger MS] [--seconds N] [--seed N] [--areq-limit N] [--trace NODE]...\n", name);
+  exit(2);
+}
+
+static double average(uint64_t total, uint32_t count)
+{
+  return (count == 0) ? 0.0 : (double) total / count;
+}
+
+int main(int argc, char** argv)
+{
+  int sensors = 500;
+  int routers = 0;
+  int maxChildren = 0;
+  int areqLimit = 0;
+  uint32_t staggerMs = 0;
+  double seconds = 60;
+  uint32_t seed = 1;
+  std::vector<int> traced;
+  VirtualMesh::Link link;
+
+  for (int i = 1; i < argc; i++)
+  {
+    bool hasValue = (i + 1 < argc);
+    if (!strcmp(argv[i], "--sensors") && hasValue) sensors = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--routers") && hasValue) routers = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--max-children") && hasValue) maxChildren = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--latency") && hasValue) link.latencyUs = strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--loss") && hasValue) link.loss = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--queue") && hasValue) link.queueLimit = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--stagger") && hasValue) staggerMs = strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--seconds") && hasValue) seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && hasValue) seed = strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--areq-limit") && hasValue) areqLimit = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--trace") && hasValue) traced.push_back(atoi(argv[++i]));
+    else usage(argv[0]);
+  }
+
+  VirtualMesh mesh(seed);
+  int coordinator = mesh.addNode(MESH_GATEWAY_LIBRARY, -1, link);
+  if (coordinator < 0)
+  {
+    fprintf(stderr, "%s\n", mesh.error().c_str());
+    return 1;
+  }
+  mesh.simulator(coordinator).areqQueueLimit = areqLimit;
+
+  std::vector<int> parents(1, coordinator);
+  if (routers > 0)
+    parents.clear();
+  for (int r = 0; r < routers; r++)
+    parents.push_back(mesh.addRelay(coordinator, link));
+  for (size_t p = 0; p < parents.size(); p++)
+    mesh.setMaxChildren(parents[p], maxChildren);
+
+  srand(seed);
+  for (int s = 0; s < sensors; s++)
+  {
+    uint64_t startUs = (staggerMs == 0) ? 0 : ((uint64_t) (rand() % staggerMs) * 1000);
+    if (mesh.addNode(MESH_SENSOR_LIBRARY, parents[s % parents.size()], link, startUs) < 0)
+    {
+      fprintf(stderr, "%s\n", mesh.error().c_str());
+      return 1;
+    }
+  }
+
+  for (size_t t = 0; t < traced.size(); t++)
+    if ((traced[t] >= 0) && (traced[t] < (int) mesh.nodeCount()))
+      mesh.setSerialOutput(traced[t], stdout);
+
+  clock_t started = clock();
+  mesh.run((uint64_t) (seconds * 1000000));
+  double cpuSeconds = (double) (clock() - started) / CLOCKS_PER_SEC;
+
+  const VirtualMesh::Stats& m = mesh.stats();
+  const ZnpSimulator::Stats& c = mesh.simulator(coordinator).stats();
+  uint32_t dataRequests = 0;
+  uint32_t joined = 0;
+  for (size_t n = 1; n < mesh.nodeCount(); n++)
+    if (mesh.hasHost(n))
+    {
+      dataRequests += mesh.simulator(n).stats().dataRequests;
+      if (mesh.simulator(n).deviceState() == DEV_END_DEVICE)
+        joined++;
+    }
+
+  printf("%d sensors, %d routers, %.1f s virtual in %.1f s CPU (%llu context switches)\n",
+         sensors, routers, seconds, cpuSeconds, (unsigned long long) m.contextSwitches);
+  printf("joins:     %u admitted, %u refused, %u joined at the end, latency avg %.0f ms max %.0f ms\n",
+         m.joinsAdmitted, m.joinsRefused, joined,
+         average(m.joinLatencyTotalUs, m.joinsAdmitted) / 1000, m.joinLatencyMaxUs / 1000.0);
+  printf("frames:    %u sent (%u AF requests), %u delivered, %u dropped in queues, %u lost, %u undeliverable\n",
+         m.framesSent, dataRequests, m.framesDelivered, m.framesDroppedQueue, m.framesDroppedLoss, m.framesUndeliverable);
+  printf("mac:       %u retries, deepest link queue %u\n", m.macRetries, m.maxLinkQueue);
+  printf("confirm:   %u failed, latency avg %.2f ms max %.2f ms\n", m.confirmFailures,
+         average(m.confirmLatencyTotalUs, m.framesSent) / 1000, m.confirmLatencyMaxUs / 1000.0);
+  printf("delivery:  latency avg %.2f ms max %.2f ms\n",
+         average(m.deliveryLatencyTotalUs, m.framesDelivered) / 1000, m.deliveryLatencyMaxUs / 1000.0);
+  printf("gateway:   %u AREQs read, %u dropped by the module, backlog max %u, wait avg %.2f ms max %.2f ms\n",
+         c.areqsSent, c.areqsDropped, c.maxAreqsWaiting,
+         average(c.areqWaitTotalUs, c.areqsSent) / 1000, c.areqWaitMaxUs / 1000.0);
+  return 0;
+}
@@ -0,0 +1,39 @@
+/**
+*  @file mesh_node.h
+*
+*  @brief What a node library exports, so that VirtualMesh can run many copies of a sketch.
+*
+* A node library is the whole library, the Energia shim and one sketch, linked as a shared object.
+* VirtualMesh loads a private copy of it for every node, so each node gets its own ZigBee object,
+* zmBuf, hal and Serial, and runs the sketch's setup() and loop() unmodified.
+*
+* Build a node library from a sketch by including its .ino files and adding MESH_NODE_ENTRY_POINTS.
+*/
+
+#ifndef MESH_NODE_H
+#define MESH_NODE_H
+
+#include "host_backend.h"
+
+extern "C"
+{
+typedef void (*MeshNodeAttach)(HostBackend* backend, HostClock* clock, FILE* serialOutput);
+typedef void (*MeshNodeRun)(void);
+}
+
+#define MESH_NODE_ATTACH        "meshNodeAttach"
+#define MESH_NODE_SETUP         "meshNodeSetup"
+#define MESH_NODE_LOOP          "meshNodeLoop"
+
+/** Defines the entry points VirtualMesh looks up. Use once, after the sketch. */
+#define MESH_NODE_ENTRY_POINTS \
+	extern "C" __attribute__((visibility("default"))) void meshNodeAttach(HostBackend* backend, HostClock* clock, FILE* serialOutput) \
+	{ \
+		hostSetBackend(backend); \
+		hostSetClock(clock); \
+		hostSetSerialOutput(serialOutput); \
+	} \
+	extern "C" __attribute__((visibility("default"))) void meshNodeSetup(void) { setup(); } \
+	extern "C" __attribute__((visibility("default"))) void meshNodeLoop(void) { loop(); }
+
+#endif
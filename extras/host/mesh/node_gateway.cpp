@@ -0,0 +1,16 @@
+/**
+*  @file node_gateway.cpp
+*
+*  @brief The Gateway Sensor Tutorial coordinator, as a VirtualMesh node library.
+*/
+
+#include <Energia.h>
+#include "mesh_node.h"
+
+void datePrint(Print& p, uint32_t timeval);
+void timePrint(Print& p, uint32_t timeval);
+
+#include "../../../examples/Gateway Sensor Tutorial/Gateway_Coordinator/Gateway_Coordinator.ino"
+#include "../../../examples/Gateway Sensor Tutorial/Gateway_Coordinator/printUtilities.ino"
+
+MESH_NODE_ENTRY_POINTS
@@ -0,0 +1,16 @@
+/**
+*  @file node_sensor.cpp
+*
+*  @brief The Gateway Sensor Tutorial end device, as a VirtualMesh node library.
+*/
+
+#include <Energia.h>
+#include "mesh_node.h"
+
+uint16_t voltage();
+uint16_t temperature();
+
+#include "../../../examples/Gateway Sensor Tutorial/Sensor_End_Device/Sensor_End_Device.ino"
+#include "../../../examples/Gateway Sensor Tutorial/Sensor_End_Device/sensors.ino"
+
+MESH_NODE_ENTRY_POINTS
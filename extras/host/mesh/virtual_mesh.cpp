@@ -0,0 +1,481 @@
+#include "virtual_mesh.h"
+#include "simulator_backend.h"
+#include "../../../utility/module.h"
+#include "../../../utility/af.h"
+#include "../../../utility/utilities.h"
+#include "Energia.h"
+#include <dlfcn.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <queue>
+
+/* AF_DATA_CONFIRM status codes for frames that don't make it off the first hop */
+#define ZSUCCESS                        0x00
+#define NWK_NO_ROUTE                    0xCD
+#define MAC_NO_ACK                      0xE9
+#define MAC_TRANSACTION_OVERFLOW        0xF1
+
+#define NODE_STACK_SIZE                 (256 * 1024)
+#define MAC_OVERHEAD_BYTES              31      //PHY, MAC, NWK and APS headers of a data frame
+#define MAC_ACK_US                      864     //turnaround plus the ack frame
+#define MAC_BACKOFF_PERIOD_US           320
+#define MAC_MAX_BACKOFF_PERIODS         8
+#define CAPABILITIES_ROUTER             0x8E
+#define CAPABILITIES_END_DEVICE         0x80
+
+/** The mesh whose scheduler is running, for nodeMain() */
+static VirtualMesh* runningMesh = NULL;
+
+VirtualMesh::Link::Link()
+	: latencyUs(2000), loss(0.0), lqi(0xC8), bitRate(250000), queueLimit(16), macRetries(3)
+{
+}
+
+VirtualMesh::VirtualMesh(uint32_t seed)
+	: joinServiceUs(25000), _random(seed), _nowNs(0), _horizonNs(0), _trustCenterBusyUntilUs(0), _current(NULL)
+{
+	clearStats();
+	struct rlimit files;                            //every node keeps its library file open
+	if ((getrlimit(RLIMIT_NOFILE, &files) == 0) && (files.rlim_cur < files.rlim_max))
+	{
+		files.rlim_cur = files.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &files);
+	}
+}
+
+VirtualMesh::~VirtualMesh()
+{
+	for (size_t i = 0; i < _nodes.size(); i++)
+	{
+		Node* n = _nodes[i];
+		if (n->stack != NULL)
+			munmap(n->stack, NODE_STACK_SIZE);
+		delete n->backend;
+		delete n;                   //libraries stay loaded: their nodes were never unwound
+	}
+}
+
+void VirtualMesh::clearStats()
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+/** Loads a copy of the library that shares nothing with other copies. dlopen() returns the same
+handle for the same file name, so every copy is made from its own in-memory file, which stays open
+so that no two copies are ever loaded through the same /proc/self/fd name. */
+void* VirtualMesh::loadPrivateCopy(const char* path)
+{
+	FILE* source = fopen(path, "rb");
+	if (source == NULL)
+	{
+		_error = std::string("cannot open ") + path;
+		return NULL;
+	}
+	int fd = memfd_create("mesh-node", 0);
+	char buffer[65536];
+	size_t length;
+	bool copied = (fd >= 0);
+	while (copied && ((length = fread(buffer, 1, sizeof(buffer), source)) > 0))
+		copied = (write(fd, buffer, length) == (ssize_t) length);
+	fclose(source);
+	if (!copied)
+	{
+		_error = std::string("cannot copy ") + path;
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	char name[64];
+	snprintf(name, sizeof(name), "/proc/self/fd/%d", fd);
+	void* library = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+	if (library == NULL)
+	{
+		_error = dlerror();
+		close(fd);
+	}
+	return library;
+}
+
+int VirtualMesh::addNode(const char* nodeLibrary, int parent, const Link& uplink, uint64_t startUs)
+{
+	void* library = loadPrivateCopy(nodeLibrary);
+	if (library == NULL)
+		return -1;
+	Node* n = new Node(*this);
+	n->attach = (MeshNodeAttach) dlsym(library, MESH_NODE_ATTACH);
+	n->setup = (MeshNodeRun) dlsym(library, MESH_NODE_SETUP);
+	n->loop = (MeshNodeRun) dlsym(library, MESH_NODE_LOOP);
+	if ((n->attach == NULL) || (n->setup == NULL) || (n->loop == NULL))
+	{
+		_error = std::string(nodeLibrary) + " is not a node library";
+		delete n;
+		return -1;
+	}
+	n->id = (int) _nodes.size();
+	n->parent = parent;
+	n->relay = false;
+	n->uplink = uplink;
+	memset(n->ieee, 0, sizeof(n->ieee));
+	n->ieee[0] = LSB(n->id);
+	n->ieee[1] = MSB(n->id);
+	n->ieee[5] = 0x4B;                              //TI OUI, LSB first
+	n->ieee[6] = 0x12;
+	n->shortAddress = (parent < 0) ? 0x0000 : 0xFFFE;  //the coordinator doesn't join
+	n->admitted = false;
+	n->children = 0;
+	n->maxChildren = 0;
+	n->linkBusyUntilUs = 0;
+	n->library = library;
+	n->serialOutput = NULL;
+	n->stack = NULL;
+	n->started = false;
+	n->clock.ns = startUs * 1000;
+	n->positionNs = startUs * 1000;
+
+	n->simulator.setIeeeAddress(n->ieee);
+	n->backend = new SimulatorBackend(n->simulator, HOST_MRST_PIN, HOST_MRDY_PIN, HOST_SRDY_PIN);
+	NodeClock* clock = &n->clock;
+	n->simulator.setClock([clock]() { return clock->micros(); });
+	n->simulator.setAirHandler([this, n](const ZnpSimulator::AirFrame& frame, uint32_t& confirmLatencyUs) {
+		return sendFrame(*n, frame, confirmLatencyUs);
+	});
+	n->simulator.setJoinHandler([this, n](ZnpSimulator&, uint16_t& shortAddress, uint32_t& joinLatencyUs) {
+		return admit(*n, shortAddress, joinLatencyUs);
+	});
+	if (parent < 0)
+		_byShortAddress[n->shortAddress] = n->id;
+	_nodes.push_back(n);
+	return n->id;
+}
+
+int VirtualMesh::addRelay(int parent, const Link& uplink)
+{
+	Node* n = new Node(*this);
+	n->id = (int) _nodes.size();
+	n->parent = parent;
+	n->relay = true;
+	n->uplink = uplink;
+	memset(n->ieee, 0, sizeof(n->ieee));
+	n->ieee[0] = LSB(n->id);
+	n->ieee[1] = MSB(n->id);
+	n->shortAddress = (CONVERT_TO_INT(n->ieee[0], n->ieee[1]) % 0xFFF0) + 1;
+	n->admitted = false;
+	n->children = 0;
+	n->maxChildren = 0;
+	n->linkBusyUntilUs = 0;
+	n->backend = NULL;
+	n->serialOutput = NULL;
+	n->library = NULL;
+	n->stack = NULL;
+	n->started = false;
+	n->positionNs = 0;
+	_byShortAddress[n->shortAddress] = n->id;
+	_nodes.push_back(n);
+	return n->id;
+}
+
+void VirtualMesh::setSerialOutput(int node, FILE* output)
+{
+	_nodes[node]->serialOutput = output;
+}
+
+void VirtualMesh::setMaxChildren(int node, uint16_t count)
+{
+	_nodes[node]->maxChildren = count;
+}
+
+/*
+*               SCHEDULER
+*/
+
+void VirtualMesh::nodeMain()
+{
+	Node* n = runningMesh->_current;
+	n->setup();
+	for (;;)
+		n->loop();
+}
+
+/** Called by a node's clock. Lets the node carry on if it stays within the horizon, otherwise
+suspends it until every other node has caught up. Its clock keeps the old time while suspended, so
+frames arriving meanwhile are scheduled at their real arrival time. */
+void VirtualMesh::advance(Node& node, uint64_t targetNs)
+{
+	if (targetNs <= _horizonNs)
+	{
+		node.clock.ns = targetNs;
+		return;
+	}
+	node.positionNs = targetNs;
+	swapcontext(&node.context, &_schedulerContext);
+	node.clock.ns = targetNs;
+}
+
+void VirtualMesh::run(uint64_t untilUs)
+{
+	uint64_t untilNs = untilUs * 1000;
+	uint64_t lookaheadNs = UINT64_MAX;
+	for (size_t i = 0; i < _nodes.size(); i++)
+		if (_nodes[i]->parent >= 0)
+			lookaheadNs = std::min(lookaheadNs, ((uint64_t) _nodes[i]->uplink.latencyUs + 1) * 1000);
+	if (lookaheadNs == UINT64_MAX)
+		lookaheadNs = 1000000;
+
+	typedef std::pair<uint64_t, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > ready;
+	for (size_t i = 0; i < _nodes.size(); i++)
+		if (!_nodes[i]->relay)
+			ready.push(Entry(_nodes[i]->positionNs, (int) i));
+
+	VirtualMesh* previous = runningMesh;
+	runningMesh = this;
+	while (!ready.empty() && (ready.top().first < untilNs))
+	{
+		Node* n = _nodes[ready.top().second];
+		ready.pop();
+		_nowNs = std::max(_nowNs, n->positionNs);
+		_horizonNs = ready.empty() ? untilNs : std::min(untilNs, ready.top().first + lookaheadNs);
+		_current = n;
+		if (!n->started)
+		{
+			n->stack = mmap(NULL, NODE_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			getcontext(&n->context);
+			n->context.uc_stack.ss_sp = n->stack;
+			n->context.uc_stack.ss_size = NODE_STACK_SIZE;
+			n->context.uc_link = NULL;
+			makecontext(&n->context, nodeMain, 0);
+			n->attach(n->backend, &n->clock, n->serialOutput);
+			n->started = true;
+		}
+		_stats.contextSwitches++;
+		swapcontext(&_schedulerContext, &n->context);
+		ready.push(Entry(n->positionNs, n->id));
+	}
+	_nowNs = std::max(_nowNs, untilNs);
+	_current = NULL;
+	runningMesh = previous;
+}
+
+/*
+*               NETWORK
+*/
+
+/** Whether the node is on the network, and so can forward and take children */
+bool VirtualMesh::isUp(Node& node)
+{
+	if (node.relay)
+		return (node.parent < 0) || isUp(*_nodes[node.parent]);
+	uint8_t state = node.simulator.deviceState();
+	return (state == DEV_ZB_COORD) || (state == DEV_ROUTER) || (state == DEV_END_DEVICE);
+}
+
+/** The links a frame crosses from one node to another, each named by the node that owns it (the child) */
+std::vector<int> VirtualMesh::route(int from, int to)
+{
+	std::vector<int> up;
+	for (int n = from; n >= 0; n = _nodes[n]->parent)
+		up.push_back(n);
+	std::vector<int> down;
+	int common = to;
+	while (std::find(up.begin(), up.end(), common) == up.end())
+	{
+		down.push_back(common);
+		common = _nodes[common]->parent;
+	}
+	std::vector<int> links(up.begin(), std::find(up.begin(), up.end(), common));
+	links.insert(links.end(), down.rbegin(), down.rend());
+	return links;
+}
+
+int VirtualMesh::hops(int from, int to)
+{
+	return (int) route(from, to).size();
+}
+
+/** Sends a frame across one link, starting no earlier than timeUs. On success moves timeUs to when
+the frame arrives at the other end. */
+bool VirtualMesh::transmit(Node& linkOwner, uint64_t& timeUs, size_t bytes, uint8_t& status)
+{
+	Link& link = linkOwner.uplink;
+	std::vector<uint64_t>& queue = linkOwner.linkQueue;
+	queue.erase(std::remove_if(queue.begin(), queue.end(), [timeUs](uint64_t done) { return done <= timeUs; }), queue.end());
+	if (queue.size() >= link.queueLimit)
+	{
+		_stats.framesDroppedQueue++;
+		status = MAC_TRANSACTION_OVERFLOW;
+		return false;
+	}
+	uint64_t airUs = ((uint64_t) (bytes + MAC_OVERHEAD_BYTES) * 8 * 1000000) / link.bitRate + MAC_ACK_US;
+	uint64_t start = std::max(timeUs, linkOwner.linkBusyUntilUs);
+	uint64_t end = start + airUs;
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+	bool delivered = false;
+	for (int attempt = 0; attempt <= link.macRetries; attempt++)
+	{
+		end = start + airUs;
+		if (chance(_random) >= link.loss)
+		{
+			delivered = true;
+			break;
+		}
+		if (attempt < link.macRetries)
+			_stats.macRetries++;
+		start = end + (_random() % MAC_MAX_BACKOFF_PERIODS) * MAC_BACKOFF_PERIOD_US;
+	}
+	linkOwner.linkBusyUntilUs = end;
+	queue.push_back(end);
+	if (queue.size() > _stats.maxLinkQueue)
+		_stats.maxLinkQueue = queue.size();
+	if (!delivered)
+	{
+		_stats.framesDroppedLoss++;
+		status = MAC_NO_ACK;
+		return false;
+	}
+	timeUs = end + link.latencyUs;
+	return true;
+}
+
+/** Hands a frame that arrived at a node to its Module */
+void VirtualMesh::deliver(Node& to, const Node& from, const ZnpSimulator::AirFrame& frame, uint64_t sentUs,
+                          uint64_t arrivalUs, uint8_t lqi, bool wasBroadcast)
+{
+	if (to.relay || !isUp(to) || !to.simulator.hasEndpoint(frame.destinationEndpoint))
+	{
+		_stats.framesUndeliverable++;
+		return;
+	}
+	uint64_t toNow = to.clock.micros();
+	uint32_t delay = (arrivalUs > toNow) ? (uint32_t) (arrivalUs - toNow) : 0;
+	to.simulator.injectIncoming(from.shortAddress, frame.sourceEndpoint, frame.destinationEndpoint, frame.clusterId,
+	                            frame.data.data(), (uint16_t) frame.data.size(), lqi, wasBroadcast, delay);
+	_stats.framesDelivered++;
+	uint32_t latency = (uint32_t) (arrivalUs - sentUs);
+	_stats.deliveryLatencyTotalUs += latency;
+	if (latency > _stats.deliveryLatencyMaxUs)
+		_stats.deliveryLatencyMaxUs = latency;
+}
+
+/** The AirHandler of every node's simulator */
+uint8_t VirtualMesh::sendFrame(Node& from, const ZnpSimulator::AirFrame& frame, uint32_t& confirmLatencyUs)
+{
+	_stats.framesSent++;
+	uint64_t sentUs = from.clock.micros();
+	bool unicast = (frame.addressMode == DESTINATION_ADDRESS_MODE_LONG) ||
+	               ((frame.addressMode == DESTINATION_ADDRESS_MODE_SHORT) && (frame.shortAddress < 0xFFF8));
+	uint8_t status = ZSUCCESS;
+
+	if (!unicast)
+	{
+		_stats.broadcasts++;
+		uint64_t airUs = ((uint64_t) (frame.data.size() + MAC_OVERHEAD_BYTES) * 8 * 1000000) / 250000;
+		confirmLatencyUs = (uint32_t) airUs;
+		for (size_t i = 0; i < _nodes.size(); i++)
+		{
+			Node& to = *_nodes[i];
+			if ((&to == &from) || to.relay)
+				continue;
+			std::vector<int> links = route(from.id, to.id);
+			uint64_t arrival = sentUs;
+			for (size_t h = 0; h < links.size(); h++)
+				arrival += airUs + _nodes[links[h]]->uplink.latencyUs;
+			uint8_t lqi = links.empty() ? 0xFF : _nodes[links.back()]->uplink.lqi;
+			deliver(to, from, frame, sentUs, arrival, lqi, true);
+		}
+	} else {
+		int destination = -1;
+		if (frame.addressMode == DESTINATION_ADDRESS_MODE_SHORT)
+		{
+			std::map<uint16_t, int>::const_iterator it = _byShortAddress.find(frame.shortAddress);
+			if (it != _byShortAddress.end())
+				destination = it->second;
+		} else {
+			for (size_t i = 0; i < _nodes.size(); i++)
+				if (memcmp(_nodes[i]->ieee, frame.ieee, 8) == 0)
+					destination = (int) i;
+		}
+		if ((destination < 0) || (destination == from.id))
+		{
+			_stats.framesUndeliverable++;
+			status = NWK_NO_ROUTE;
+			confirmLatencyUs = MAC_ACK_US;
+		} else {
+			std::vector<int> links = route(from.id, destination);
+			uint64_t t = sentUs;
+			bool arrived = true;
+			for (size_t h = 0; h < links.size(); h++)
+			{
+				uint8_t hopStatus = ZSUCCESS;
+				arrived = transmit(*_nodes[links[h]], t, frame.data.size(), hopStatus);
+				if (h == 0)
+				{
+					status = hopStatus;
+					confirmLatencyUs = (hopStatus == MAC_TRANSACTION_OVERFLOW) ? MAC_ACK_US :
+					                   (uint32_t) (_nodes[links[0]]->linkBusyUntilUs - sentUs);
+				}
+				if (!arrived)
+					break;
+			}
+			if (arrived)
+				deliver(*_nodes[destination], from, frame, sentUs, t, _nodes[links.back()]->uplink.lqi, false);
+		}
+	}
+	if (status != ZSUCCESS)
+		_stats.confirmFailures++;
+	_stats.confirmLatencyTotalUs += confirmLatencyUs;
+	if (confirmLatencyUs > _stats.confirmLatencyMaxUs)
+		_stats.confirmLatencyMaxUs = confirmLatencyUs;
+	return status;
+}
+
+/** The JoinHandler of every node's simulator: admits the node through the trust center */
+bool VirtualMesh::admit(Node& node, uint16_t& shortAddress, uint32_t& joinLatencyUs)
+{
+	Node& parent = *_nodes[node.parent];
+	Node& coordinator = *_nodes[0];
+	if (!isUp(parent) || !isUp(coordinator) ||
+	    (!node.admitted && (parent.maxChildren != 0) && (parent.children >= parent.maxChildren)))
+	{
+		_stats.joinsRefused++;
+		return false;
+	}
+	if (!node.admitted)
+	{
+		parent.children++;
+		node.admitted = true;
+	}
+
+	uint64_t startUs = node.clock.micros();
+	uint64_t hopUs = 0;
+	std::vector<int> links = route(node.id, 0);
+	for (size_t h = 0; h < links.size(); h++)
+		hopUs += _nodes[links[h]]->uplink.latencyUs;
+	uint64_t atTrustCenter = startUs + joinLatencyUs / 2 + hopUs;  //after the scan for a network
+	uint64_t admitted = std::max(atTrustCenter, _trustCenterBusyUntilUs) + joinServiceUs;
+	_trustCenterBusyUntilUs = admitted;
+	uint64_t joinedUs = admitted + hopUs;
+	joinLatencyUs = (uint32_t) (joinedUs - startUs);
+
+	node.shortAddress = shortAddress;
+	_byShortAddress[shortAddress] = node.id;
+	_stats.joinsAdmitted++;
+	_stats.joinLatencyTotalUs += joinLatencyUs;
+	if (joinLatencyUs > _stats.joinLatencyMaxUs)
+		_stats.joinLatencyMaxUs = joinLatencyUs;
+
+	uint8_t capabilities = (node.simulator.logicalType() == END_DEVICE) ? CAPABILITIES_END_DEVICE : CAPABILITIES_ROUTER;
+	for (size_t i = 0; i < _nodes.size(); i++)
+	{
+		Node& other = *_nodes[i];
+		if ((&other == &node) || other.relay || !isUp(other))
+			continue;
+		uint64_t announced = joinedUs + hops(node.id, other.id) * (uint64_t) node.uplink.latencyUs;
+		uint64_t otherNow = other.clock.micros();
+		other.simulator.announceDevice(shortAddress, node.ieee, capabilities,
+		                               (announced > otherNow) ? (uint32_t) (announced - otherNow) : 0);
+	}
+	return true;
+}
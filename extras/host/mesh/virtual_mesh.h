@@ -0,0 +1,189 @@
+/**
+*  @file virtual_mesh.h
+*
+*  @brief Many simulated nodes, each running a real sketch against its own ZnpSimulator, joined by
+*  virtual radio links. For load testing a coordinator with hundreds of devices.
+*
+* Every node that has a host loads a private copy of a node library (see mesh_node.h), so it runs
+* the unmodified library and sketch with its own globals. Nodes are coroutines on one thread, each
+* with its own virtual clock. The scheduler always resumes the node that is furthest behind and lets
+* it run ahead by at most the shortest link latency; since nothing crosses a link faster than that,
+* no node ever receives a frame in its past. Runs are repeatable for a given seed.
+*
+* The network is a tree: every node has a parent (the coordinator is node 0 and has none) and one
+* Link to it. A unicast goes up the tree to the common ancestor and down again. On every hop it waits
+* for the link (one frame on air at a time, queueLimit frames waiting), takes air time at bitRate,
+* and may be lost and retried up to macRetries times. AF_DATA_CONFIRM comes after the first hop's MAC
+* ack, as on a real ZNP without APS acks. Broadcasts are delivered to every node, one link latency
+* per hop, without loss.
+*
+* Joins go through the coordinator acting as trust center, which admits one device at a time taking
+* joinServiceUs each, so a crowd of devices powering up together sees its join times grow. A parent
+* with maxChildren children refuses further joins, and nobody can join before the coordinator is up.
+* Joined devices are announced to every node with a host.
+*
+* Routers without a host (addRelay()) only forward. Polling by sleepy end devices is not modelled:
+* every node receives as soon as a frame arrives.
+*
+* @note Host-only code. Nothing under extras/ is compiled by Energia.
+*/
+
+#ifndef VIRTUAL_MESH_H
+#define VIRTUAL_MESH_H
+
+#include "../znp_simulator.h"
+#include "host_backend.h"
+#include "mesh_node.h"
+#include <stdio.h>
+#include <ucontext.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+class SimulatorBackend;
+
+class VirtualMesh
+{
+public:
+	/** The radio link between a node and its parent */
+	struct Link
+	{
+		uint32_t latencyUs;             //per hop, on top of air time: MAC/NWK processing and propagation
+		double loss;                    //chance that one transmission attempt is lost
+		uint8_t lqi;                    //reported with messages received over this link
+		uint32_t bitRate;               //bits per second on air
+		uint16_t queueLimit;            //frames waiting for the link before more are dropped
+		uint8_t macRetries;
+		Link();
+	};
+
+	struct Stats
+	{
+		uint32_t framesSent;            //AF messages handed to the network by any node
+		uint32_t framesDelivered;
+		uint32_t framesDroppedQueue;    //a link queue was full
+		uint32_t framesDroppedLoss;     //lost on every attempt on some hop
+		uint32_t framesUndeliverable;   //no such address, destination not joined or endpoint not registered
+		uint32_t broadcasts;
+		uint32_t macRetries;
+		uint32_t confirmFailures;       //AF_DATA_CONFIRM with a status other than success
+		uint32_t maxLinkQueue;
+		uint64_t confirmLatencyTotalUs;
+		uint32_t confirmLatencyMaxUs;
+		uint64_t deliveryLatencyTotalUs;
+		uint32_t deliveryLatencyMaxUs;
+		uint32_t joinsAdmitted;
+		uint32_t joinsRefused;
+		uint64_t joinLatencyTotalUs;
+		uint32_t joinLatencyMaxUs;
+		uint64_t contextSwitches;
+	};
+
+	explicit VirtualMesh(uint32_t seed = 1);
+	~VirtualMesh();
+
+	/** Adds a node that runs the sketch in the given node library. The first node added must be the
+	coordinator, with parent -1.
+	@param startUs when the node is powered up
+	@return the node's id, or -1 if the library could not be loaded; see error() */
+	int addNode(const char* nodeLibrary, int parent, const Link& uplink, uint64_t startUs = 0);
+
+	/** Adds a router with no host, which only forwards. @return the node's id */
+	int addRelay(int parent, const Link& uplink);
+
+	/** Where a node's Serial output goes; discarded by default */
+	void setSerialOutput(int node, FILE* output);
+	void setMaxChildren(int node, uint16_t count);
+
+	/** Runs every node until the given virtual time */
+	void run(uint64_t untilUs);
+
+	uint64_t now() const { return _nowNs / 1000; }
+	const Stats& stats() const { return _stats; }
+	void clearStats();
+	size_t nodeCount() const { return _nodes.size(); }
+	bool hasHost(int node) const { return !_nodes[node]->relay; }
+	ZnpSimulator& simulator(int node) { return _nodes[node]->simulator; }
+	const std::string& error() const { return _error; }
+
+	/** Trust center time to admit one device */
+	uint32_t joinServiceUs;
+
+private:
+	struct Node;
+
+	/** A node's clock. Moving it past what the scheduler allows suspends the node. */
+	class NodeClock : public HostClock
+	{
+	public:
+		NodeClock(VirtualMesh& mesh, Node& node) : _mesh(mesh), _node(node), ns(0) {}
+		uint64_t micros() { return ns / 1000; }
+		void sleep(uint32_t us) { _mesh.advance(_node, ns + (uint64_t) us * 1000); }
+		void busCycle(uint32_t cycleNs) { _mesh.advance(_node, ns + cycleNs); }
+	private:
+		VirtualMesh& _mesh;
+		Node& _node;
+	public:
+		uint64_t ns;
+	};
+
+	struct Node
+	{
+		Node(VirtualMesh& mesh) : clock(mesh, *this) {}
+		int id;
+		int parent;
+		bool relay;
+		Link uplink;
+		uint8_t ieee[8];
+		uint16_t shortAddress;
+		bool admitted;                  //counted in the parent's children
+		uint16_t children;
+		uint16_t maxChildren;           //0 = no limit
+
+		/* Link to the parent */
+		uint64_t linkBusyUntilUs;
+		std::vector<uint64_t> linkQueue;    //when each frame waiting for the link will be done
+
+		/* Host */
+		ZnpSimulator simulator;
+		SimulatorBackend* backend;
+		NodeClock clock;
+		FILE* serialOutput;
+		void* library;
+		MeshNodeAttach attach;
+		MeshNodeRun setup;
+		MeshNodeRun loop;
+		ucontext_t context;
+		void* stack;
+		bool started;
+		uint64_t positionNs;            //when the node next needs to run
+	};
+
+	static void nodeMain();
+	void advance(Node& node, uint64_t targetNs);
+	void* loadPrivateCopy(const char* path);
+
+	bool isUp(Node& node);
+	int hops(int from, int to);
+	std::vector<int> route(int from, int to);
+	bool transmit(Node& linkOwner, uint64_t& timeUs, size_t bytes, uint8_t& status);
+	void deliver(Node& to, const Node& from, const ZnpSimulator::AirFrame& frame, uint64_t sentUs,
+	             uint64_t arrivalUs, uint8_t lqi, bool wasBroadcast);
+	uint8_t sendFrame(Node& from, const ZnpSimulator::AirFrame& frame, uint32_t& confirmLatencyUs);
+	bool admit(Node& node, uint16_t& shortAddress, uint32_t& joinLatencyUs);
+
+	std::vector<Node*> _nodes;
+	std::map<uint16_t, int> _byShortAddress;
+	Stats _stats;
+	std::mt19937 _random;
+	std::string _error;
+
+	uint64_t _nowNs;
+	uint64_t _horizonNs;                //how far the running node may go before it must yield
+	uint64_t _trustCenterBusyUntilUs;
+	Node* _current;
+	ucontext_t _schedulerContext;
+};
+
+#endif
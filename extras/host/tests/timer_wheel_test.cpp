@@ -0,0 +1,77 @@
+/**
+*  @file timer_wheel_test.cpp
+*
+*  @brief Checks that timers on the timer wheel fire on the millisecond they're due, including across
+*  the wrap of millis() at 2^32.
+*
+* For each start time, timers of lengths around every level boundary are started together and the
+* clock is then moved on a millisecond at a time, calling timerService() as ZigBee.poll() would.
+* A timer started with no delay fires on the next millisecond. Returns non-zero if any timer fired early,
+* late or not at all.
+*
+* @note Host-only code. Nothing under extras/ is compiled by Energia.
+*/
+
+#include <Energia.h>
+#include <stdio.h>
+#include "timer_wheel.h"
+#include "virtual_clock.h"
+
+/** Start times: well clear of the wrap, and some way, just and right before it */
+static const uint32_t startTimes[] = { 0x000003E8, 0xFFFFF000, 0xFFFFFF00, 0xFFFFFFF0, 0xFFFFFFFF };
+
+/** Timer lengths in mSec: either side of each level of the wheel, and beyond its reach */
+static const uint32_t delays[] = { 0, 1, 15, 16, 17, 255, 256, 257, 1000, 4095, 4096, 4097,
+	15000, 65535, 65536, 65537, 100000 };
+
+#define TIMER_COUNT     (sizeof(delays) / sizeof(delays[0]))
+
+static struct timer timers[TIMER_COUNT];
+/** When each timer fired, as millis(); valid if fired is set */
+static uint32_t firedAt[TIMER_COUNT];
+static bool fired[TIMER_COUNT];
+
+static void timerFired(void* context)
+{
+	uint8_t i = (uint8_t)(uintptr_t) context;
+	fired[i] = true;
+	firedAt[i] = (uint32_t) millis();
+}
+
+int main()
+{
+	int failures = 0;
+	for (unsigned s = 0; s < sizeof(startTimes) / sizeof(startTimes[0]); s++)
+	{
+		VirtualClock clock;
+		clock.advance((uint64_t) startTimes[s] * 1000);
+		hostSetClock(&clock);
+		for (uint8_t i = 0; i < TIMER_COUNT; i++)
+		{
+			fired[i] = false;
+			timerStart(&timers[i], delays[i], timerFired, (void*)(uintptr_t) i);
+		}
+		uint32_t last = delays[TIMER_COUNT - 1] + 1;
+		for (uint32_t ms = 0; (ms <= last) && (timerCount() > 0); ms++)
+		{
+			timerService((uint32_t) millis());
+			clock.advance(1000);
+		}
+		for (uint8_t i = 0; i < TIMER_COUNT; i++)
+		{
+			uint32_t due = startTimes[s] + ((delays[i] > 0) ? delays[i] : 1);
+			if (!fired[i])
+				printf("FAIL start 0x%08X delay %u: never fired\n", startTimes[s], delays[i]);
+			else if (firedAt[i] != due)
+				printf("FAIL start 0x%08X delay %u: fired at 0x%08X, due 0x%08X (%d mSec late)\n",
+					startTimes[s], delays[i], firedAt[i], due, (int32_t)(firedAt[i] - due));
+			else
+				continue;
+			failures++;
+			timerStop(&timers[i]);
+		}
+	}
+	hostSetClock(NULL);
+	printf("timer_wheel_test: %d failures\n", failures);
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,1198 @@
+/**
+* @file znp_simulator.cpp
+*
+* @brief A software model of the A2530 ZNP that speaks MT over SPI.
+*
+* @see znp_simulator.h for what is modelled and how the simulator is connected to the library.
+*
+* Frame formats follow the Z-Stack Monitor and Test API. Where the real Module would wait for the
+* network (data confirms, ZDO responses, forming or joining a network) the simulator schedules the
+* corresponding AREQ using the latencies in Timing.
+*/
+
+#include "znp_simulator.h"
+#include "../../utility/module.h"
+#include "../../utility/af.h"
+#include "../../utility/utilities.h"
+#include <string.h>
+#include <chrono>
+
+/* Subsystems, from the low 5 bits of the first command byte */
+#define MT_SYS                          0x01
+#define MT_AF                           0x04
+#define MT_ZDO                          0x05
+#define MT_SAPI                         0x06
+#define MT_UTIL                         0x07
+
+/* Command types, from the high 3 bits of the first command byte */
+#define MT_TYPE_MASK                    0xE0
+#define MT_TYPE_SREQ                    0x20
+#define MT_TYPE_AREQ                    0x40
+#define MT_SUBSYSTEM_MASK               0x1F
+#define MT_RPC_DATA_MAX                 250     //largest MT payload
+#define AF_INCOMING_MSG_EXT_HEADER_LEN  27      //AF_INCOMING_MSG_EXT payload before the data
+
+/* ERROR_SRSP error codes */
+#define MT_RPC_ERR_SUBSYSTEM            0x01
+#define MT_RPC_ERR_COMMAND_ID           0x02
+
+/* Status values used in responses */
+#define ZSUCCESS                        0x00
+#define ZINVALID_PARAMETER              0x02
+#define ZMEM_ERROR                      0x10
+#define NV_OPER_FAILED                  0x0A
+#define ZAPS_DUPLICATE_ENTRY            0xB8
+#define ZNWK_INVALID_REQUEST            0xC2
+#define ZDP_DEVICE_NOT_FOUND            0x81
+#define ZDP_NOT_SUPPORTED               0x84
+
+/* ZDO_STARTUP_FROM_APP status */
+#define RESTORED_NETWORK_STATE          0x00
+#define NEW_NETWORK_STATE               0x01
+
+#define INVALID_NODE_ADDRESS            0xFFFE
+
+/* What the simulated Module reports in SYS_RESET_IND and SYS_VERSION */
+#define SYS_RESET_REASON_POWER_UP       0x00
+#define SYS_RESET_TRANSPORT_REVISION    0x02
+#define PRODUCT_ID_A2530R24A            0x20
+#define MAXIMUM_MT_PAYLOAD              250
+
+/** Seconds between 1970-01-01 and the ZNP's epoch, 2000-01-01 */
+#define ZNP_EPOCH_OFFSET                946684800UL
+
+static bool isJoinedState(uint8_t state)
+{
+	return (state == DEV_ZB_COORD) || (state == DEV_ROUTER) || (state == DEV_END_DEVICE);
+}
+
+static void putShort(std::vector<uint8_t>& v, uint16_t value)
+{
+	v.push_back(LSB(value));
+	v.push_back(MSB(value));
+}
+
+ZnpSimulator::ZnpSimulator()
+{
+	_timing.boot = 600000;              //MRST released to SYS_RESET_IND; moduleReset() waits for the SRDY edge, so this sets how long it takes
+	_timing.mrdyToSrdy = 50;
+	_timing.srsp = 400;
+	_timing.poll = 100;
+	_timing.dataConfirm = 15000;
+	_timing.zdoResponse = 25000;
+	_timing.formNetwork = 1000000;
+	_timing.joinNetwork = 2000000;
+	_timing.restoreNetwork = 250000;
+	incomingMaxPayload = MAXIMUM_PAYLOAD_LENGTH;
+	incomingExtMaxPayload = MT_RPC_DATA_MAX - AF_INCOMING_MSG_EXT_HEADER_LEN;
+	areqQueueLimit = 0;
+
+	static const uint8_t defaultIeee[8] = { 0x04, 0x03, 0x02, 0x01, 0x00, 0x4B, 0x12, 0x00 };
+	memcpy(_ieee, defaultIeee, 8);
+	clearStats();
+
+	_phase = POWERED_OFF;
+	_mrdyHigh = true;
+	_phaseStart = 0;
+	_bootDone = 0;
+	_txPos = 0;
+	_pollInProgress = false;
+	_networkValid = false;
+	_networkPanId = 0xFFFF;
+	_networkChannel = 11;
+	_deviceState = DEV_HOLD;
+	_shortAddress = INVALID_NODE_ADDRESS;
+	_txPower = 0;
+	_time = 0;
+	_spiClock = 0;
+	_spiClockLimit = 4000000;
+	_random = 0xACE1;
+	_outgoingExt.active = false;
+	_incomingTimestamp = 1;
+	_incomingTransaction = 0;
+	setDefaultConfiguration();
+}
+
+void ZnpSimulator::setClock(std::function<uint64_t()> clock)
+{
+	_clock = clock;
+}
+
+void ZnpSimulator::clearStats()
+{
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+uint64_t ZnpSimulator::now()
+{
+	if (_clock)
+		return _clock();
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** The factory defaults, restored by STARTOPT_CLEAR_CONFIG */
+void ZnpSimulator::setDefaultConfiguration()
+{
+	static const char moduleName[] = "A2530R24A       ";
+	std::vector<uint8_t> userDescription;
+	userDescription.push_back(ZCD_NV_USERDESC_LEN - 1);
+	userDescription.insert(userDescription.end(), moduleName, moduleName + ZCD_NV_USERDESC_LEN - 1);
+
+	_config.clear();
+	_config[ZCD_NV_USERDESC] = userDescription;
+	_config[ZCD_NV_STARTUP_OPTION] = std::vector<uint8_t>(1, 0);
+	_config[ZCD_NV_LOGICAL_TYPE] = std::vector<uint8_t>(1, COORDINATOR);
+	_config[ZCD_NV_PANID] = std::vector<uint8_t>(2, 0xFF);
+	uint8_t chanlist[4] = { 0x00, 0x08, 0x00, 0x00 };               //channel 11
+	_config[ZCD_NV_CHANLIST] = std::vector<uint8_t>(chanlist, chanlist + 4);
+	_config[ZCD_NV_ZDO_DIRECT_CB] = std::vector<uint8_t>(1, 0);
+	_config[ZCD_NV_SECURITY_MODE] = std::vector<uint8_t>(1, 0);
+	_config[ZCD_NV_PRECFGKEYS_ENABLE] = std::vector<uint8_t>(1, 0);
+	_config[ZCD_NV_PRECFGKEY] = std::vector<uint8_t>(ZCD_NV_PRECFGKEY_LEN, 0);
+	uint16_t pollRates[3] = { ZCD_NV_POLL_RATE, ZCD_NV_QUEUED_POLL_RATE, ZCD_NV_RESPONSE_POLL_RATE };
+	for (int i = 0; i < 3; i++)
+	{
+		std::vector<uint8_t> rate;
+		putShort(rate, (i == 0) ? 1000 : 100);
+		_config[(uint8_t) pollRates[i]] = rate;
+	}
+}
+
+std::vector<uint8_t> ZnpSimulator::configuration(uint8_t id)
+{
+	std::map<uint8_t, std::vector<uint8_t> >::const_iterator it = _config.find(id);
+	if (it == _config.end())
+		return std::vector<uint8_t>();
+	return it->second;
+}
+
+/*
+*               SIGNALS
+*/
+
+void ZnpSimulator::setReset(bool high)
+{
+	update();
+	if (!high)
+	{
+		if (_phase != POWERED_OFF)
+		{
+			resetModule();
+			_phase = POWERED_OFF;
+		}
+	} else if (_phase == POWERED_OFF) {
+		_phase = BOOTING;
+		_bootDone = now() + _timing.boot;
+	}
+}
+
+void ZnpSimulator::setMrdy(bool high)
+{
+	update();
+	if (high == _mrdyHigh)
+		return;
+	_mrdyHigh = high;
+	if (!high)                                          //MRDY asserted: start of a transaction
+	{
+		if (_phase == IDLE)
+		{
+			_phase = SELECTED;
+			_phaseStart = now();
+			_rx.clear();
+			_tx.clear();
+			_txPos = 0;
+		}
+		return;
+	}
+	/* MRDY released: end of the transaction */
+	if ((_phase != SELECTED) && (_phase != PROCESSING) && (_phase != RESPONDING))
+		return;
+	_stats.transactions++;
+	if ((_phase == SELECTED) && (!_rx.empty()))         //host gave up part way through a frame
+		_stats.protocolErrors++;
+	if ((_phase == PROCESSING) || ((_phase == RESPONDING) && (_txPos < _tx.size())))
+	{
+		_stats.protocolErrors++;                        //response not read completely
+		if (_pollInProgress && (_txPos == 0) && (_tx[0] > 0))
+		{
+			_ready.push_front(_tx);                     //the AREQ was never read, so keep it
+			_readySince.push_front(now());
+		}
+	}
+	_pollInProgress = false;
+	_phase = IDLE;
+}
+
+bool ZnpSimulator::srdy()
+{
+	update();
+	switch (_phase)
+	{
+	case IDLE:
+		return _ready.empty();                          //SRDY low = Module has something for us
+	case SELECTED:
+		if (!_ready.empty())
+			return false;
+		return (now() < (_phaseStart + _timing.mrdyToSrdy));
+	case PROCESSING:
+		if (now() >= (_phaseStart + (_pollInProgress ? _timing.poll : _timing.srsp)))
+		{
+			_phase = RESPONDING;
+			return true;
+		}
+		return false;
+	case RESPONDING:
+		return true;
+	default:                                            //held in reset, or booting
+		return true;
+	}
+}
+
+uint8_t ZnpSimulator::transfer(uint8_t out)
+{
+	uint8_t in = exchange(out);
+	if ((_spiClockLimit == 0) || (_spiClock <= _spiClockLimit))
+		return in;
+	_stats.garbledBytes++;
+	return in ^ 0x01;
+}
+
+/** One byte each way on SPI, at a clock the Module can keep up with */
+uint8_t ZnpSimulator::exchange(uint8_t out)
+{
+	update();
+	switch (_phase)
+	{
+	case SELECTED:
+		if (_rx.empty() && srdy())                      //host didn't wait for SRDY to go low
+			_stats.protocolErrors++;
+		_rx.push_back(out);
+		if ((_rx.size() >= 3) && (_rx.size() == (size_t) _rx[0] + 3))
+		{
+			_stats.bytesToModule += _rx.size();
+			process();
+			_stats.bytesFromModule += _tx.size();
+			_phase = PROCESSING;
+			_phaseStart = now();
+		}
+		return 0;
+	case PROCESSING:
+		if (!srdy())                                    //host didn't wait for SRDY to go high
+		{
+			_stats.protocolErrors++;
+			_phase = RESPONDING;
+		}
+		//fall through
+	case RESPONDING:
+		if (_txPos < _tx.size())
+			return _tx[_txPos++];
+		_stats.protocolErrors++;                        //host read more than we sent
+		return 0;
+	default:
+		_stats.protocolErrors++;                        //bytes clocked without MRDY asserted
+		return 0;
+	}
+}
+
+/*
+*               SCHEDULING
+*/
+
+void ZnpSimulator::update()
+{
+	uint64_t t = now();
+	if ((_phase == BOOTING) && (t >= _bootDone))
+		bootComplete();
+	if ((_phase == POWERED_OFF) || (_phase == BOOTING))
+		return;
+	while ((!_scheduled.empty()) && (_scheduled.front().due <= t))
+	{
+		Event e = _scheduled.front();
+		_scheduled.erase(_scheduled.begin());
+		if (e.newState >= 0)
+		{
+			_deviceState = (uint8_t) e.newState;
+			if (isJoinedState(_deviceState))
+				_networkValid = true;
+		}
+		if (!e.frame.empty())
+			makeReady(e.frame);
+	}
+}
+
+/** Hands an AREQ to the host, unless the backlog is full and it is an incoming message */
+void ZnpSimulator::makeReady(const std::vector<uint8_t>& frame)
+{
+	uint16_t command = CONVERT_TO_INT(frame[2], frame[1]);
+	bool incoming = (command == AF_INCOMING_MSG) || (command == AF_INCOMING_MSG_EXT);
+	if (incoming && (areqQueueLimit != 0) && (_ready.size() >= areqQueueLimit))
+	{
+		_stats.areqsDropped++;
+		return;
+	}
+	_ready.push_back(frame);
+	_readySince.push_back(now());
+	if (_ready.size() > _stats.maxAreqsWaiting)
+		_stats.maxAreqsWaiting = _ready.size();
+}
+
+void ZnpSimulator::schedule(uint32_t delayUs, const std::vector<uint8_t>& frame, int newState)
+{
+	Event e;
+	e.due = now() + delayUs;
+	e.newState = newState;
+	e.frame = frame;
+	std::vector<Event>::iterator it = _scheduled.begin();
+	while ((it != _scheduled.end()) && (it->due <= e.due))   //events due at the same time stay in order
+		++it;
+	_scheduled.insert(it, e);
+}
+
+void ZnpSimulator::scheduleAreq(uint32_t delayUs, uint16_t command, const std::vector<uint8_t>& payload, int newState)
+{
+	std::vector<uint8_t> frame;
+	frame.push_back((uint8_t) payload.size());
+	frame.push_back(MSB(command));
+	frame.push_back(LSB(command));
+	frame.insert(frame.end(), payload.begin(), payload.end());
+	schedule(delayUs, frame, newState);
+}
+
+void ZnpSimulator::queueAreq(uint16_t command, const uint8_t* payload, uint8_t length, uint32_t delayUs)
+{
+	scheduleAreq(delayUs, command, std::vector<uint8_t>(payload, payload + length));
+}
+
+size_t ZnpSimulator::areqsWaiting()
+{
+	update();
+	return _ready.size();
+}
+
+void ZnpSimulator::respond(uint16_t command, const std::vector<uint8_t>& payload)
+{
+	_tx.clear();
+	_tx.push_back((uint8_t) payload.size());
+	_tx.push_back(MSB(command));
+	_tx.push_back(LSB(command));
+	_tx.insert(_tx.end(), payload.begin(), payload.end());
+}
+
+/*
+*               RESET AND STARTUP
+*/
+
+/** Everything that doesn't survive a reset */
+void ZnpSimulator::resetModule()
+{
+	_stats.resets++;
+	_ready.clear();
+	_readySince.clear();
+	_scheduled.clear();
+	_endpoints.clear();
+	_incomingStore.clear();
+	_outgoingExt.active = false;
+	_pollInProgress = false;
+	_deviceState = DEV_HOLD;
+}
+
+/** Applies the startup options the way Z-Stack does on boot, then reports SYS_RESET_IND */
+void ZnpSimulator::bootComplete()
+{
+	uint8_t options = configuration(ZCD_NV_STARTUP_OPTION)[0];
+	if (options & STARTOPT_CLEAR_CONFIG)
+		setDefaultConfiguration();
+	if (options & STARTOPT_CLEAR_STATE)
+	{
+		_networkValid = false;
+		_devices.clear();
+	}
+	_config[ZCD_NV_STARTUP_OPTION][0] = options & ~(STARTOPT_CLEAR_CONFIG | STARTOPT_CLEAR_STATE);
+
+	_phase = IDLE;
+	if (!_mrdyHigh)                                     //host was already waiting for us
+	{
+		_phase = SELECTED;
+		_phaseStart = now();
+		_rx.clear();
+	}
+	uint8_t resetInd[] = { SYS_RESET_REASON_POWER_UP, SYS_RESET_TRANSPORT_REVISION, PRODUCT_ID_A2530R24A, 2, 5, 1 };
+	std::vector<uint8_t> frame;
+	frame.push_back(sizeof(resetInd));
+	frame.push_back(MSB(SYS_RESET_IND));
+	frame.push_back(LSB(SYS_RESET_IND));
+	frame.insert(frame.end(), resetInd, resetInd + sizeof(resetInd));
+	makeReady(frame);
+}
+
+/** Handles ZDO_STARTUP_FROM_APP: restores the network from "NV", or forms/joins a new one */
+void ZnpSimulator::startNetwork()
+{
+	uint8_t logicalType = configuration(ZCD_NV_LOGICAL_TYPE)[0];
+	std::vector<uint8_t> panConfig = configuration(ZCD_NV_PANID);
+	uint16_t configuredPan = CONVERT_TO_INT(panConfig[0], panConfig[1]);
+	std::vector<uint8_t> chanlist = configuration(ZCD_NV_CHANLIST);
+	uint32_t channelMask = chanlist[0] | (chanlist[1] << 8) | (chanlist[2] << 16) | ((uint32_t) chanlist[3] << 24);
+
+	uint8_t finalState = (logicalType == COORDINATOR) ? DEV_ZB_COORD : ((logicalType == ROUTER) ? DEV_ROUTER : DEV_END_DEVICE);
+	bool restore = _networkValid && ((configuredPan == 0xFFFF) || (configuredPan == _networkPanId));
+
+	std::vector<uint8_t> status(1, restore ? RESTORED_NETWORK_STATE : NEW_NETWORK_STATE);
+	respond(ZDO_STARTUP_FROM_APP + SRSP, status);
+
+	if (!restore)
+	{
+		_networkChannel = 11;
+		for (uint8_t channel = 11; channel <= 26; channel++)
+			if (channelMask & (1UL << channel))
+			{
+				_networkChannel = channel;
+				break;
+			}
+		_networkPanId = (configuredPan != 0xFFFF) ? configuredPan : (CONVERT_TO_INT(_ieee[0], _ieee[1]) & 0x3FFF);
+		if (logicalType == COORDINATOR)
+			_shortAddress = 0x0000;
+		else
+			_shortAddress = (CONVERT_TO_INT(_ieee[0], _ieee[1]) % 0xFFF0) + 1;
+	}
+
+	std::vector<uint8_t> state(1);
+	if (logicalType == COORDINATOR)
+	{
+		state[0] = DEV_COORD_STARTING;
+		scheduleAreq(1000, ZDO_STATE_CHANGE_IND, state, DEV_COORD_STARTING);
+	} else if (restore) {
+		state[0] = DEV_NWK_REJOIN;
+		scheduleAreq(1000, ZDO_STATE_CHANGE_IND, state, DEV_NWK_REJOIN);
+	} else {
+		state[0] = DEV_NWK_DISC;
+		scheduleAreq(1000, ZDO_STATE_CHANGE_IND, state, DEV_NWK_DISC);
+		uint32_t joinLatency = _timing.joinNetwork;
+		if (_joinHandler && !_joinHandler(*this, _shortAddress, joinLatency))
+			return;                                     //nobody let us in: keep discovering
+		state[0] = DEV_NWK_JOINING;
+		scheduleAreq(joinLatency / 2, ZDO_STATE_CHANGE_IND, state, DEV_NWK_JOINING);
+		state[0] = finalState;
+		scheduleAreq(joinLatency, ZDO_STATE_CHANGE_IND, state, finalState);
+		return;
+	}
+	state[0] = finalState;
+	uint32_t upAfter = restore ? _timing.restoreNetwork : _timing.formNetwork;
+	scheduleAreq(upAfter, ZDO_STATE_CHANGE_IND, state, finalState);
+}
+
+/*
+*               NETWORK MODEL
+*/
+
+void ZnpSimulator::setIeeeAddress(const uint8_t* ieee)
+{
+	memcpy(_ieee, ieee, 8);
+}
+
+void ZnpSimulator::addDevice(uint16_t shortAddress, const uint8_t* ieee)
+{
+	for (size_t i = 0; i < _devices.size(); i++)
+		if ((_devices[i].shortAddress == shortAddress) || (memcmp(_devices[i].ieee, ieee, 8) == 0))
+		{
+			_devices[i].shortAddress = shortAddress;
+			memcpy(_devices[i].ieee, ieee, 8);
+			return;
+		}
+	Device d;
+	d.shortAddress = shortAddress;
+	memcpy(d.ieee, ieee, 8);
+	_devices.push_back(d);
+}
+
+void ZnpSimulator::removeDevice(uint16_t shortAddress)
+{
+	for (size_t i = 0; i < _devices.size(); i++)
+		if (_devices[i].shortAddress == shortAddress)
+		{
+			_devices.erase(_devices.begin() + i);
+			return;
+		}
+}
+
+const ZnpSimulator::Device* ZnpSimulator::findDevice(uint16_t shortAddress) const
+{
+	for (size_t i = 0; i < _devices.size(); i++)
+		if (_devices[i].shortAddress == shortAddress)
+			return &_devices[i];
+	return 0;
+}
+
+const ZnpSimulator::Device* ZnpSimulator::findDevice(const uint8_t* ieee) const
+{
+	for (size_t i = 0; i < _devices.size(); i++)
+		if (memcmp(_devices[i].ieee, ieee, 8) == 0)
+			return &_devices[i];
+	return 0;
+}
+
+/** The ZCD_NV_LOGICAL_TYPE the host configured: COORDINATOR, ROUTER or END_DEVICE */
+uint8_t ZnpSimulator::logicalType()
+{
+	return configuration(ZCD_NV_LOGICAL_TYPE)[0];
+}
+
+bool ZnpSimulator::hasEndpoint(uint8_t endpoint) const
+{
+	for (size_t i = 0; i < _endpoints.size(); i++)
+		if (_endpoints[i] == endpoint)
+			return true;
+	return false;
+}
+
+/** Hands an outgoing message to the AirHandler (if any) and schedules its AF_DATA_CONFIRM */
+void ZnpSimulator::sendOverAir(const AirFrame& frame)
+{
+	uint32_t latency = _timing.dataConfirm;
+	uint8_t status = ZSUCCESS;
+	if (_airHandler)
+		status = _airHandler(frame, latency);
+	std::vector<uint8_t> confirm;
+	confirm.push_back(status);
+	confirm.push_back(frame.sourceEndpoint);
+	confirm.push_back(frame.transactionId);
+	scheduleAreq(latency, AF_DATA_CONFIRM, confirm);
+}
+
+/** Reports a message received over the air, as AF_INCOMING_MSG or AF_INCOMING_MSG_EXT depending on its size */
+void ZnpSimulator::injectIncoming(uint16_t fromAddress, uint8_t fromEndpoint, uint8_t toEndpoint, uint16_t clusterId,
+                                  const uint8_t* data, uint16_t length, uint8_t lqi, bool wasBroadcast, uint32_t delayUs)
+{
+	uint32_t timestamp = _incomingTimestamp++;
+	std::vector<uint8_t> p;
+	putShort(p, 0);                                     //group
+	putShort(p, clusterId);
+	if (length <= incomingMaxPayload)
+	{
+		putShort(p, fromAddress);
+		p.push_back(fromEndpoint);
+		p.push_back(toEndpoint);
+		p.push_back(wasBroadcast ? 1 : 0);
+		p.push_back(lqi);
+		p.push_back(0);                                 //security use
+		for (int i = 0; i < 4; i++)
+			p.push_back((timestamp >> (8 * i)) & 0xFF);
+		p.push_back(_incomingTransaction++);
+		p.push_back((uint8_t) length);
+		p.insert(p.end(), data, data + length);
+		scheduleAreq(delayUs, AF_INCOMING_MSG, p);
+		return;
+	}
+	p.push_back(DESTINATION_ADDRESS_MODE_SHORT);
+	putShort(p, fromAddress);
+	p.insert(p.end(), 6, 0);                            //rest of the 8 byte source address
+	p.push_back(fromEndpoint);
+	putShort(p, _networkPanId);
+	p.push_back(toEndpoint);
+	p.push_back(wasBroadcast ? 1 : 0);
+	p.push_back(lqi);
+	p.push_back(0);                                     //security use
+	for (int i = 0; i < 4; i++)
+		p.push_back((timestamp >> (8 * i)) & 0xFF);
+	p.push_back(_incomingTransaction++);
+	putShort(p, length);
+	if (length <= incomingExtMaxPayload)
+		p.insert(p.end(), data, data + length);
+	else                                                //too big: host must use AF_DATA_RETRIEVE
+		_incomingStore[timestamp] = std::vector<uint8_t>(data, data + length);
+	scheduleAreq(delayUs, AF_INCOMING_MSG_EXT, p);
+}
+
+void ZnpSimulator::announceDevice(uint16_t shortAddress, const uint8_t* ieee, uint8_t capabilities, uint32_t delayUs)
+{
+	addDevice(shortAddress, ieee);
+	std::vector<uint8_t> p;
+	putShort(p, shortAddress);                          //source address
+	putShort(p, shortAddress);                          //network address
+	p.insert(p.end(), ieee, ieee + 8);
+	p.push_back(capabilities);
+	scheduleAreq(delayUs, ZDO_END_DEVICE_ANNCE_IND, p);
+}
+
+void ZnpSimulator::deviceLeft(uint16_t shortAddress, const uint8_t* ieee, uint32_t delayUs)
+{
+	removeDevice(shortAddress);
+	std::vector<uint8_t> p;
+	putShort(p, shortAddress);
+	p.insert(p.end(), ieee, ieee + 8);
+	p.push_back(0);                                     //request
+	p.push_back(0);                                     //remove children
+	p.push_back(0);                                     //rejoin
+	scheduleAreq(delayUs, ZDO_LEAVE_IND, p);
+}
+
+/*
+*               COMMAND PROCESSING
+*/
+
+/** Acts on the frame in _rx and leaves the response in _tx */
+void ZnpSimulator::process()
+{
+	uint8_t len = _rx[0];
+	uint8_t cmd0 = _rx[1];
+	uint8_t cmd1 = _rx[2];
+	const uint8_t* p = &_rx[3];
+	_tx.clear();
+	_txPos = 0;
+	_pollInProgress = false;
+
+	if ((len == 0) && (cmd0 == 0) && (cmd1 == 0))       //poll
+	{
+		_stats.polls++;
+		_pollInProgress = true;
+		if (_ready.empty())
+		{
+			_stats.emptyPolls++;
+			_tx.assign(3, 0);
+		} else {
+			_tx = _ready.front();
+			_ready.pop_front();
+			uint64_t waited = now() - _readySince.front();
+			_readySince.pop_front();
+			_stats.areqsSent++;
+			_stats.areqWaitTotalUs += waited;
+			if (waited > _stats.areqWaitMaxUs)
+				_stats.areqWaitMaxUs = (uint32_t) waited;
+		}
+		return;
+	}
+	if ((cmd0 & MT_TYPE_MASK) == MT_TYPE_AREQ)          //nothing the library sends needs an answer
+	{
+		_stats.hostAreqs++;
+		_tx.assign(3, 0);
+		return;
+	}
+	if ((cmd0 & MT_TYPE_MASK) != MT_TYPE_SREQ)
+	{
+		_stats.protocolErrors++;
+		_tx.assign(3, 0);
+		return;
+	}
+
+	_stats.sreqs++;
+	switch (cmd0 & MT_SUBSYSTEM_MASK)
+	{
+	case MT_SYS:  sysCommand(cmd1, p, len); break;
+	case MT_AF:   afCommand(cmd1, p, len); break;
+	case MT_ZDO:  zdoCommand(cmd1, p, len); break;
+	case MT_SAPI: zbCommand(cmd1, p, len); break;
+	case MT_UTIL: utilCommand(cmd1, p, len); break;
+	default: break;
+	}
+	if (_tx.empty())                                    //not something we know about
+	{
+		_stats.unknownCommands++;
+		std::vector<uint8_t> error;
+		error.push_back(((cmd0 & MT_SUBSYSTEM_MASK) > MT_UTIL) ? MT_RPC_ERR_SUBSYSTEM : MT_RPC_ERR_COMMAND_ID);
+		error.push_back(cmd0);
+		error.push_back(cmd1);
+		respond(ERROR_SRSP, error);
+	}
+}
+
+void ZnpSimulator::sysCommand(uint8_t cmd1, const uint8_t* p, uint8_t len)
+{
+	uint16_t command = (MT_TYPE_SREQ | MT_SYS) << 8 | cmd1;
+	std::vector<uint8_t> r;
+	switch (command)
+	{
+	case SYS_VERSION:
+	{
+		uint8_t version[] = { SYS_RESET_TRANSPORT_REVISION, PRODUCT_ID_A2530R24A, 2, 5, 1 };
+		r.assign(version, version + sizeof(version));
+		break;
+	}
+	case SYS_RANDOM:
+		_random = (_random >> 1) ^ (-(_random & 1u) & 0xB400u);   //16 bit Galois LFSR
+		putShort(r, _random);
+		break;
+	case SYS_ADC_READ:
+		putShort(r, 0x0800);
+		break;
+	case SYS_GPIO:
+		r.push_back((len >= 2) ? p[1] : 0);
+		break;
+	case SYS_STACK_TUNE:
+		r.push_back((len >= 2) ? p[1] : 0);
+		break;
+	case SYS_SET_TX_POWER:
+		_txPower = (len >= 1) ? p[0] : 0;
+		if ((int8_t) _txPower > 20)
+			_txPower = 20;
+		r.push_back(_txPower);
+		break;
+	case SYS_SET_TIME:
+		_time = (len >= 4) ? (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24)) : 0;
+		_time -= (uint32_t) (now() / 1000000);          //so GET_TIME keeps counting
+		r.push_back(ZSUCCESS);
+		break;
+	case SYS_GET_TIME:
+	{
+		uint32_t utc = _time + (uint32_t) (now() / 1000000);
+		for (int i = 0; i < 4; i++)
+			r.push_back((utc >> (8 * i)) & 0xFF);
+		/* Civil date from days since 1970-01-01 (Howard Hinnant's algorithm) */
+		uint64_t unixTime = (uint64_t) utc + ZNP_EPOCH_OFFSET;
+		int64_t z = (int64_t) (unixTime / 86400) + 719468;
+		int64_t era = z / 146097;
+		uint32_t doe = (uint32_t) (z - era * 146097);
+		uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		uint32_t mp = (5 * doy + 2) / 153;
+		uint32_t day = doy - (153 * mp + 2) / 5 + 1;
+		uint32_t month = (mp < 10) ? mp + 3 : mp - 9;
+		uint32_t year = (uint32_t) (yoe + era * 400 + ((month <= 2) ? 1 : 0));
+		uint32_t secondOfDay = (uint32_t) (unixTime % 86400);
+		r.push_back(secondOfDay / 3600);
+		r.push_back((secondOfDay / 60) % 60);
+		r.push_back(secondOfDay % 60);
+		r.push_back(month);
+		r.push_back(day);
+		putShort(r, year);
+		break;
+	}
+	case SYS_NV_READ:
+	{
+		if (len < 3)
+			return;
+		uint16_t id = CONVERT_TO_INT(p[0], p[1]);
+		uint8_t offset = p[2];
+		std::map<uint16_t, std::vector<uint8_t> >::const_iterator it = _nv.find(id);
+		if ((it == _nv.end()) || (offset > it->second.size()))
+		{
+			r.push_back(NV_OPER_FAILED);
+			r.push_back(0);
+		} else {
+			r.push_back(ZSUCCESS);
+			r.push_back((uint8_t) (it->second.size() - offset));
+			r.insert(r.end(), it->second.begin() + offset, it->second.end());
+		}
+		break;
+	}
+	case SYS_NV_WRITE:
+	{
+		if ((len < 4) || (len < 4 + p[3]))
+			return;
+		uint16_t id = CONVERT_TO_INT(p[0], p[1]);
+		uint8_t offset = p[2];
+		std::vector<uint8_t>& item = _nv[id];
+		if (item.size() < (size_t) offset + p[3])
+			item.resize(offset + p[3]);
+		memcpy(&item[offset], p + 4, p[3]);
+		r.push_back(ZSUCCESS);
+		break;
+	}
+	default:
+		return;                                         //ERROR_SRSP
+	}
+	respond(command + SRSP, r);
+}
+
+void ZnpSimulator::zbCommand(uint8_t cmd1, const uint8_t* p, uint8_t len)
+{
+	uint16_t command = (MT_TYPE_SREQ | MT_SAPI) << 8 | cmd1;
+	std::vector<uint8_t> r;
+	switch (command)
+	{
+	case ZB_WRITE_CONFIGURATION:
+		if ((len < 2) || (len < 2 + p[1]))
+			return;
+		_config[p[0]] = std::vector<uint8_t>(p + 2, p + 2 + p[1]);
+		r.push_back(ZSUCCESS);
+		break;
+	case ZB_READ_CONFIGURATION:
+	{
+		if (len < 1)
+			return;
+		std::vector<uint8_t> value = configuration(p[0]);
+		r.push_back(value.empty() ? ZINVALID_PARAMETER : ZSUCCESS);
+		r.push_back(p[0]);
+		r.push_back((uint8_t) value.size());
+		r.insert(r.end(), value.begin(), value.end());
+		break;
+	}
+	case ZB_GET_DEVICE_INFO:
+		if (len < 1)
+			return;
+		r.push_back(p[0]);
+		{
+			std::vector<uint8_t> value = deviceInfo(p[0]);
+			r.insert(r.end(), value.begin(), value.end());
+		}
+		break;
+	default:
+		return;
+	}
+	respond(command + SRSP, r);
+}
+
+/** @return the 8 byte value field of ZB_GET_DEVICE_INFO for this device information property */
+std::vector<uint8_t> ZnpSimulator::deviceInfo(uint8_t dip)
+{
+	std::vector<uint8_t> v;
+	bool joined = isJoinedState(_deviceState);
+	bool coordinator = (configuration(ZCD_NV_LOGICAL_TYPE)[0] == COORDINATOR);
+	switch (dip)
+	{
+	case DIP_STATE:
+		v.push_back(_deviceState);
+		break;
+	case DIP_MAC_ADDRESS:
+		v.assign(_ieee, _ieee + 8);
+		break;
+	case DIP_SHORT_ADDRESS:
+		putShort(v, joined ? _shortAddress : INVALID_NODE_ADDRESS);
+		break;
+	case DIP_PARENT_SHORT_ADDRESS:
+		putShort(v, (joined && !coordinator) ? 0x0000 : INVALID_NODE_ADDRESS);
+		break;
+	case DIP_PARENT_MAC_ADDRESS:
+		if (joined && !coordinator)
+		{
+			const Device* parent = findDevice((uint16_t) 0x0000);
+			if (parent)
+				v.assign(parent->ieee, parent->ieee + 8);
+		}
+		break;
+	case DIP_CHANNEL:
+		v.push_back(joined ? _networkChannel : 0);
+		break;
+	case DIP_PANID:
+		putShort(v, joined ? _networkPanId : 0xFFFF);
+		break;
+	case DIP_EXTENDED_PANID:
+		if (joined)
+			v.assign(_ieee, _ieee + 8);
+		break;
+	default:
+		break;
+	}
+	v.resize(8, 0);
+	return v;
+}
+
+void ZnpSimulator::afCommand(uint8_t cmd1, const uint8_t* p, uint8_t len)
+{
+	uint16_t command = (MT_TYPE_SREQ | MT_AF) << 8 | cmd1;
+	std::vector<uint8_t> r;
+	switch (command)
+	{
+	case AF_REGISTER:
+		if (len < 9)
+			return;
+		if (hasEndpoint(p[0]))
+			r.push_back(ZAPS_DUPLICATE_ENTRY);
+		else {
+			_endpoints.push_back(p[0]);
+			r.push_back(ZSUCCESS);
+		}
+		break;
+	case AF_DATA_REQUEST:
+	{
+#define AF_DATA_REQUEST_HEADER          10
+		if ((len < AF_DATA_REQUEST_HEADER) || (len != AF_DATA_REQUEST_HEADER + p[9]))
+			return;
+		_stats.dataRequests++;
+		AirFrame f;
+		f.addressMode = DESTINATION_ADDRESS_MODE_SHORT;
+		f.shortAddress = CONVERT_TO_INT(p[0], p[1]);
+		memset(f.ieee, 0, 8);
+		f.destinationEndpoint = p[2];
+		f.sourceEndpoint = p[3];
+		f.clusterId = CONVERT_TO_INT(p[4], p[5]);
+		f.transactionId = p[6];
+		f.data.assign(p + AF_DATA_REQUEST_HEADER, p + len);
+		if (!isJoinedState(_deviceState))
+			r.push_back(ZNWK_INVALID_REQUEST);
+		else if (!hasEndpoint(f.sourceEndpoint))
+			r.push_back(ZINVALID_PARAMETER);
+		else {
+			r.push_back(ZSUCCESS);
+			sendOverAir(f);
+		}
+		break;
+	}
+	case AF_DATA_REQUEST_EXT:
+	{
+#define AF_DATA_REQUEST_EXT_HEADER      20
+		if (len < AF_DATA_REQUEST_EXT_HEADER)
+			return;
+		_stats.dataRequests++;
+		AirFrame f;
+		f.addressMode = p[0];
+		f.shortAddress = CONVERT_TO_INT(p[1], p[2]);
+		memcpy(f.ieee, p + 1, 8);
+		f.destinationEndpoint = p[9];
+		f.sourceEndpoint = p[12];
+		f.clusterId = CONVERT_TO_INT(p[13], p[14]);
+		f.transactionId = p[15];
+		uint16_t dataLength = CONVERT_TO_INT(p[18], p[19]);
+		if (!isJoinedState(_deviceState))
+			r.push_back(ZNWK_INVALID_REQUEST);
+		else if (!hasEndpoint(f.sourceEndpoint))
+			r.push_back(ZINVALID_PARAMETER);
+		else if (len == AF_DATA_REQUEST_EXT_HEADER + dataLength) {
+			f.data.assign(p + AF_DATA_REQUEST_EXT_HEADER, p + len);
+			r.push_back(ZSUCCESS);
+			sendOverAir(f);
+		} else if ((len == AF_DATA_REQUEST_EXT_HEADER) && (dataLength <= AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH)) {
+			_outgoingExt.active = true;                 //payload follows in AF_DATA_STORE
+			_outgoingExt.frame = f;
+			_outgoingExt.length = dataLength;
+			_outgoingExt.frame.data.assign(dataLength, 0);
+			r.push_back(ZSUCCESS);
+		} else
+			r.push_back(ZINVALID_PARAMETER);
+		break;
+	}
+	case AF_DATA_STORE:
+	{
+		if ((len < 3) || (len != 3 + p[2]))
+			return;
+		_stats.dataStores++;
+		uint16_t index = CONVERT_TO_INT(p[0], p[1]);
+		if (!_outgoingExt.active)
+			r.push_back(ZMEM_ERROR);
+		else if (p[2] == 0) {                           //zero length: send it
+			_outgoingExt.active = false;
+			sendOverAir(_outgoingExt.frame);
+			r.push_back(ZSUCCESS);
+		} else if (index + p[2] > _outgoingExt.length)
+			r.push_back(ZMEM_ERROR);
+		else {
+			memcpy(&_outgoingExt.frame.data[index], p + 3, p[2]);
+			r.push_back(ZSUCCESS);
+		}
+		break;
+	}
+	case AF_DATA_RETRIEVE:
+	{
+		if (len < 7)
+			return;
+		_stats.dataRetrieves++;
+		uint32_t timestamp = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+		uint16_t index = CONVERT_TO_INT(p[4], p[5]);
+		uint8_t length = p[6];
+		std::map<uint32_t, std::vector<uint8_t> >::iterator it = _incomingStore.find(timestamp);
+		if (it == _incomingStore.end())
+		{
+			r.push_back(ZMEM_ERROR);
+			r.push_back(0);
+		} else if (length == 0) {                       //zero length: free it
+			_incomingStore.erase(it);
+			r.push_back(ZSUCCESS);
+			r.push_back(0);
+		} else {
+			if (index >= it->second.size())
+				length = 0;
+			else if (index + length > it->second.size())
+				length = (uint8_t) (it->second.size() - index);
+			if (length > MAXIMUM_MT_PAYLOAD - 2)
+				length = MAXIMUM_MT_PAYLOAD - 2;
+			r.push_back(ZSUCCESS);
+			r.push_back(length);
+			r.insert(r.end(), it->second.begin() + index, it->second.begin() + index + length);
+		}
+		break;
+	}
+	default:
+		return;
+	}
+	respond(command + SRSP, r);
+}
+
+void ZnpSimulator::zdoCommand(uint8_t cmd1, const uint8_t* p, uint8_t len)
+{
+	uint16_t command = (MT_TYPE_SREQ | MT_ZDO) << 8 | cmd1;
+	std::vector<uint8_t> ok(1, ZSUCCESS);
+	std::vector<uint8_t> a;                             //the AREQ that answers this request
+	switch (command)
+	{
+	case ZDO_STARTUP_FROM_APP:
+		if (_deviceState != DEV_HOLD)                   //already started
+		{
+			respond(command + SRSP, std::vector<uint8_t>(1, RESTORED_NETWORK_STATE));
+			return;
+		}
+		startNetwork();
+		return;
+	case ZDO_IEEE_ADDR_REQ:
+	case ZDO_NWK_ADDR_REQ:
+	{
+		bool byShort = (command == ZDO_IEEE_ADDR_REQ);
+		if (len < (byShort ? 4 : 10))
+			return;
+		uint16_t shortAddress = CONVERT_TO_INT(p[0], p[1]);
+		const Device* d = byShort ? findDevice(shortAddress) : findDevice(p);
+		bool self = byShort ? (shortAddress == _shortAddress) : (memcmp(p, _ieee, 8) == 0);
+		a.push_back((d || self) ? ZSUCCESS : ZDP_DEVICE_NOT_FOUND);
+		if (self)
+		{
+			a.insert(a.end(), _ieee, _ieee + 8);
+			putShort(a, _shortAddress);
+		} else if (d) {
+			a.insert(a.end(), d->ieee, d->ieee + 8);
+			putShort(a, d->shortAddress);
+		} else {
+			if (byShort)
+				a.insert(a.end(), 8, 0);
+			else
+				a.insert(a.end(), p, p + 8);
+			putShort(a, byShort ? shortAddress : INVALID_NODE_ADDRESS);
+		}
+		a.push_back(0);                                 //start index
+		a.push_back(0);                                 //number of associated devices
+		respond(command + SRSP, ok);
+		scheduleAreq(_timing.zdoResponse, byShort ? ZDO_IEEE_ADDR_RSP : ZDO_NWK_ADDR_RSP, a);
+		return;
+	}
+	case ZDO_USER_DESC_REQ:
+	{
+		if (len < 4)
+			return;
+		uint16_t nwk = CONVERT_TO_INT(p[2], p[3]);
+		putShort(a, CONVERT_TO_INT(p[0], p[1]));
+		if (nwk == _shortAddress)
+		{
+			std::vector<uint8_t> desc = configuration(ZCD_NV_USERDESC);
+			uint8_t descLength = desc.empty() ? 0 : desc[0];
+			a.push_back(ZSUCCESS);
+			putShort(a, nwk);
+			a.push_back(descLength);
+			a.insert(a.end(), desc.begin() + 1, desc.begin() + 1 + descLength);
+		} else {
+			a.push_back(findDevice(nwk) ? ZDP_NOT_SUPPORTED : ZDP_DEVICE_NOT_FOUND);
+			putShort(a, nwk);
+			a.push_back(0);
+		}
+		respond(command + SRSP, ok);
+		scheduleAreq(_timing.zdoResponse, ZDO_USER_DESC_RSP, a);
+		return;
+	}
+	case ZDO_USER_DESC_SET:
+	{
+		if ((len < 5) || (len < 5 + p[4]))
+			return;
+		uint16_t nwk = CONVERT_TO_INT(p[2], p[3]);
+		putShort(a, CONVERT_TO_INT(p[0], p[1]));
+		if (nwk == _shortAddress)
+		{
+			std::vector<uint8_t> desc(1, p[4]);
+			desc.insert(desc.end(), p + 5, p + 5 + p[4]);
+			desc.resize(ZCD_NV_USERDESC_LEN, ' ');
+			_config[ZCD_NV_USERDESC] = desc;
+			a.push_back(ZSUCCESS);
+		} else
+			a.push_back(findDevice(nwk) ? ZDP_NOT_SUPPORTED : ZDP_DEVICE_NOT_FOUND);
+		putShort(a, nwk);
+		respond(command + SRSP, ok);
+		scheduleAreq(_timing.zdoResponse, ZDO_USER_DESC_CONF, a);
+		return;
+	}
+	case ZDO_NODE_DESC_REQ:
+	{
+		if (len < 4)
+			return;
+		uint16_t nwk = CONVERT_TO_INT(p[2], p[3]);
+		bool self = (nwk == _shortAddress);
+		putShort(a, CONVERT_TO_INT(p[0], p[1]));
+		a.push_back((self || findDevice(nwk)) ? ZSUCCESS : ZDP_DEVICE_NOT_FOUND);
+		putShort(a, nwk);
+		uint8_t logicalType = self ? configuration(ZCD_NV_LOGICAL_TYPE)[0] : ((nwk == 0) ? COORDINATOR : ROUTER);
+		a.push_back(logicalType);                       //logical type, no complex/user descriptor
+		a.push_back(0x40);                              //2.4GHz band
+		a.push_back((logicalType == END_DEVICE) ? 0x80 : 0x8E);    //MAC capabilities
+		putShort(a, 0x0000);                            //manufacturer code
+		a.push_back(0x50);                              //max buffer size
+		putShort(a, 160);                               //max incoming transfer size
+		putShort(a, (logicalType == COORDINATOR) ? 0x0001 : 0x0000);   //server mask
+		putShort(a, 160);                               //max outgoing transfer size
+		a.push_back(0);                                 //descriptor capabilities
+		respond(command + SRSP, ok);
+		scheduleAreq(_timing.zdoResponse, ZDO_NODE_DESC_RSP, a);
+		return;
+	}
+	case ZDO_MGMT_PERMIT_JOIN_REQ:
+		if (len < 4)
+			return;
+		putShort(a, CONVERT_TO_INT(p[0], p[1]));
+		a.push_back(ZSUCCESS);
+		respond(command + SRSP, ok);
+		scheduleAreq(_timing.zdoResponse, ZDO_MGMT_PERMIT_JOIN_RSP, a);
+		return;
+	case ZDO_MGMT_LEAVE_REQ:
+	{
+		if (len < 11)
+			return;
+		const Device* d = findDevice(p + 2);
+		putShort(a, CONVERT_TO_INT(p[0], p[1]));
+		a.push_back(d ? ZSUCCESS : ZDP_DEVICE_NOT_FOUND);
+		if (d)
+			removeDevice(d->shortAddress);
+		respond(command + SRSP, ok);
+		scheduleAreq(_timing.zdoResponse, ZDO_MGMT_LEAVE_RSP, a);
+		return;
+	}
+	case ZDO_BIND_REQ:
+	case ZDO_UNBIND_REQ:
+		if (len < 2)
+			return;
+		putShort(a, CONVERT_TO_INT(p[0], p[1]));
+		a.push_back(ZSUCCESS);
+		respond(command + SRSP, ok);
+		scheduleAreq(_timing.zdoResponse, (command == ZDO_BIND_REQ) ? ZDO_BIND_RSP : ZDO_UNBIND_RSP, a);
+		return;
+	case ZDO_NWK_DISCOVERY_REQ:
+		if (len < 5)
+			return;
+		a.push_back(ZSUCCESS);
+		respond(command + SRSP, ok);
+		scheduleAreq(_timing.zdoResponse * (1 + p[4]), ZDO_NWK_DISCOVERY_CONF, a);
+		return;
+	default:
+		return;
+	}
+}
+
+void ZnpSimulator::utilCommand(uint8_t cmd1, const uint8_t* p, uint8_t len)
+{
+	uint16_t command = (MT_TYPE_SREQ | MT_UTIL) << 8 | cmd1;
+	std::vector<uint8_t> r;
+	switch (command)
+	{
+	case UTIL_ADDRMGR_EXT_ADDR_LOOKUP:
+	{
+		if (len < 8)
+			return;
+		const Device* d = findDevice(p);
+		if (memcmp(p, _ieee, 8) == 0)
+			putShort(r, _shortAddress);
+		else
+			putShort(r, d ? d->shortAddress : INVALID_NODE_ADDRESS);
+		break;
+	}
+	case UTIL_ADDRMGR_NWK_ADDR_LOOKUP:
+	{
+		if (len < 2)
+			return;
+		uint16_t shortAddress = CONVERT_TO_INT(p[0], p[1]);
+		const Device* d = findDevice(shortAddress);
+		if (isJoinedState(_deviceState) && (shortAddress == _shortAddress))
+			r.assign(_ieee, _ieee + 8);
+		else if (d)
+			r.assign(d->ieee, d->ieee + 8);
+		else
+			r.assign(8, 0);
+		break;
+	}
+	default:
+		return;
+	}
+	respond(command + SRSP, r);
+}
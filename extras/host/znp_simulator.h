@@ -0,0 +1,250 @@
+/**
+*  @file znp_simulator.h
+*
+*  @brief A software model of the A2530 ZNP that speaks MT over SPI, for running the library on a host.
+*
+* The simulator sits behind the same four signals the library drives on real hardware: MRST, MRDY and
+* SRDY, plus the SPI data line. The HAL shim forwards digitalWrite(mrst/mrdy), digitalRead(srdy) and
+* SPI.transfer() to setReset(), setMrdy(), srdy() and transfer(), so zm_phy_spi.cpp and everything
+* above it run unmodified.
+*
+* What is modelled:
+* - the MRDY/SRDY handshake: SRDY falls a short time after MRDY is asserted, rises when the SRSP (or
+*   the polled AREQ) is ready, and is held low while the Module has an AREQ waiting.
+* - SREQ/SRSP and AREQ semantics, including the 0,0,0 poll used to fetch AREQs.
+* - the Module's configuration (ZB_*_CONFIGURATION), NV items (SYS_NV_*), startup options, device
+*   information properties and the network state that survives a reset.
+* - AF_REGISTER, AF_DATA_REQUEST(_EXT) with AF_DATA_STORE, incoming messages with AF_DATA_RETRIEVE, and
+*   AF_DATA_CONFIRM.
+* - the ZDO requests used by the library and their asynchronous responses, ZDO_STATE_CHANGE_IND after
+*   ZDO_STARTUP_FROM_APP, and the UTIL address manager lookups.
+*
+* Anything the library does not use is answered with an ERROR_SRSP, which is what the ZNP does too.
+*
+* All timing comes from a clock callback returning microseconds, so the simulator works the same with
+* the wall clock or with a virtual clock that the HAL shim advances.
+*
+* @note Host-only code. Nothing under extras/ is compiled by Energia.
+*/
+
+#ifndef ZNP_SIMULATOR_H
+#define ZNP_SIMULATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+class ZnpSimulator
+{
+public:
+	/** How long the simulated Module takes to do things, in microseconds */
+	struct Timing
+	{
+		uint32_t boot;                  //MRST released to SYS_RESET_IND ready
+		uint32_t mrdyToSrdy;            //MRDY asserted to SRDY low
+		uint32_t srsp;                  //last byte of a SREQ to SRDY high (SRSP ready)
+		uint32_t poll;                  //last byte of a poll to SRDY high (AREQ ready)
+		uint32_t dataConfirm;           //AF_DATA_REQUEST to AF_DATA_CONFIRM
+		uint32_t zdoResponse;           //ZDO request to its response AREQ
+		uint32_t formNetwork;           //ZDO_STARTUP_FROM_APP to coordinator up, new network
+		uint32_t joinNetwork;           //ZDO_STARTUP_FROM_APP to router/end device joined, new network
+		uint32_t restoreNetwork;        //ZDO_STARTUP_FROM_APP to up, using network state kept in NV
+	};
+
+	/** Counters, mostly for tests and benchmarks */
+	struct Stats
+	{
+		uint32_t transactions;          //MRDY assert/release pairs
+		uint32_t sreqs;
+		uint32_t polls;
+		uint32_t emptyPolls;            //polls made when nothing was waiting
+		uint32_t hostAreqs;
+		uint32_t areqsSent;
+		uint32_t unknownCommands;
+		uint32_t protocolErrors;        //handshake violations, e.g. clocking bytes before SRDY is low
+		uint32_t resets;
+		uint32_t dataRequests;
+		uint32_t dataStores;
+		uint32_t dataRetrieves;
+		uint32_t bytesToModule;
+		uint32_t bytesFromModule;
+		uint32_t areqsDropped;          //incoming messages lost because areqQueueLimit was reached
+		uint32_t maxAreqsWaiting;       //deepest the AREQ backlog got
+		uint32_t areqWaitMaxUs;         //longest an AREQ waited for the host to read it
+		uint64_t areqWaitTotalUs;
+		uint32_t garbledBytes;          //bytes corrupted because the SPI clock was over spiClockLimit
+	};
+
+	/** A device the simulated Module knows about, e.g. a child or neighbor */
+	struct Device
+	{
+		uint16_t shortAddress;
+		uint8_t ieee[8];                //LSB first, as sent over MT
+	};
+
+	/** An AF message the host asked the Module to send over the air */
+	struct AirFrame
+	{
+		uint8_t addressMode;            //DESTINATION_ADDRESS_MODE_SHORT, _LONG or _BROADCAST
+		uint16_t shortAddress;          //if not using long addressing
+		uint8_t ieee[8];                //if using long addressing, LSB first
+		uint8_t destinationEndpoint;
+		uint8_t sourceEndpoint;
+		uint16_t clusterId;
+		uint8_t transactionId;
+		std::vector<uint8_t> data;
+	};
+
+	/** Decides what happens to a message sent over the air. Returns the AF_DATA_CONFIRM status and
+	may change the confirm latency, e.g. to model more hops. */
+	typedef std::function<uint8_t(const AirFrame& frame, uint32_t& confirmLatencyUs)> AirHandler;
+
+	/** Decides whether a router or end device that starts a new network join gets in, and when.
+	May change the short address it will get. Returning false refuses the join: the Module stays in
+	network discovery, like when no coordinator answers. */
+	typedef std::function<bool(ZnpSimulator& device, uint16_t& shortAddress, uint32_t& joinLatencyUs)> JoinHandler;
+
+	ZnpSimulator();
+
+	void setClock(std::function<uint64_t()> clock);
+	Timing& timing() { return _timing; }
+	const Stats& stats() const { return _stats; }
+	void clearStats();
+
+	/* Signals, driven by the HAL shim */
+	void setReset(bool high);
+	void setMrdy(bool high);
+	bool srdy();
+	uint8_t transfer(uint8_t out);
+	/** The SPI clock the host is running, in Hz; 0 if not known. Above the limit, every byte the
+	Module sends comes back with its low bit flipped, like MISO sampled too early. */
+	void setSpiClock(uint32_t hz) { _spiClock = hz; }
+	/** The fastest SPI clock that works, in Hz; 0 for no limit. 4MHz, the CC2530's limit, by default. */
+	void setSpiClockLimit(uint32_t hz) { _spiClockLimit = hz; }
+
+	/* Identity and network model */
+	void setIeeeAddress(const uint8_t* ieee);
+	const uint8_t* ieeeAddress() const { return _ieee; }
+	uint8_t deviceState() const { return _deviceState; }
+	uint16_t shortAddress() const { return _shortAddress; }
+	uint8_t logicalType();
+	void addDevice(uint16_t shortAddress, const uint8_t* ieee);
+	void removeDevice(uint16_t shortAddress);
+	const std::vector<Device>& devices() const { return _devices; }
+	void setAirHandler(AirHandler handler) { _airHandler = handler; }
+	void setJoinHandler(JoinHandler handler) { _joinHandler = handler; }
+	bool hasEndpoint(uint8_t endpoint) const;
+
+	/* Things that happen on the network, reported to the host as AREQs */
+	void injectIncoming(uint16_t fromAddress, uint8_t fromEndpoint, uint8_t toEndpoint, uint16_t clusterId,
+	                    const uint8_t* data, uint16_t length, uint8_t lqi = 0xFF, bool wasBroadcast = false,
+	                    uint32_t delayUs = 0);
+	void announceDevice(uint16_t shortAddress, const uint8_t* ieee, uint8_t capabilities = 0x8E, uint32_t delayUs = 0);
+	void deviceLeft(uint16_t shortAddress, const uint8_t* ieee, uint32_t delayUs = 0);
+	void queueAreq(uint16_t command, const uint8_t* payload, uint8_t length, uint32_t delayUs = 0);
+	size_t areqsWaiting();
+	/** Incoming messages kept for AF_DATA_RETRIEVE that the host has not freed yet */
+	size_t incomingStored() const { return _incomingStore.size(); }
+
+	/** Processes anything due by now. Called by every signal method; call it to advance the model
+	without touching the bus. */
+	void update();
+
+	/** The largest AF_INCOMING_MSG payload; longer messages use AF_INCOMING_MSG_EXT */
+	uint16_t incomingMaxPayload;
+
+	/** The largest AF_INCOMING_MSG_EXT payload sent inline; longer ones wait for AF_DATA_RETRIEVE */
+	uint16_t incomingExtMaxPayload;
+
+	/** The most AREQs the Module holds for the host before it drops incoming messages; 0 = no limit */
+	size_t areqQueueLimit;
+
+private:
+	enum Phase { POWERED_OFF, BOOTING, IDLE, SELECTED, PROCESSING, RESPONDING };
+
+	struct Event
+	{
+		uint64_t due;
+		int newState;                   //device state to enter when this event fires, or -1
+		std::vector<uint8_t> frame;     //AREQ to send when this event fires, may be empty
+	};
+
+	struct OutgoingExt                  //AF_DATA_REQUEST_EXT waiting for its AF_DATA_STORE chunks
+	{
+		bool active;
+		AirFrame frame;
+		uint16_t length;
+	};
+
+	uint64_t now();
+	uint8_t exchange(uint8_t out);
+	void process();
+	void resetModule();
+	void bootComplete();
+	void startNetwork();
+	void schedule(uint32_t delayUs, const std::vector<uint8_t>& frame, int newState = -1);
+	void scheduleAreq(uint32_t delayUs, uint16_t command, const std::vector<uint8_t>& payload, int newState = -1);
+	void respond(uint16_t command, const std::vector<uint8_t>& payload);
+	void sendOverAir(const AirFrame& frame);
+	const Device* findDevice(uint16_t shortAddress) const;
+	const Device* findDevice(const uint8_t* ieee) const;
+	std::vector<uint8_t> deviceInfo(uint8_t dip);
+	std::vector<uint8_t> configuration(uint8_t id);
+	void setDefaultConfiguration();
+
+	void sysCommand(uint8_t cmd1, const uint8_t* p, uint8_t len);
+	void zbCommand(uint8_t cmd1, const uint8_t* p, uint8_t len);
+	void afCommand(uint8_t cmd1, const uint8_t* p, uint8_t len);
+	void zdoCommand(uint8_t cmd1, const uint8_t* p, uint8_t len);
+	void utilCommand(uint8_t cmd1, const uint8_t* p, uint8_t len);
+
+	std::function<uint64_t()> _clock;
+	Timing _timing;
+	Stats _stats;
+
+	/* Bus */
+	Phase _phase;
+	bool _mrdyHigh;
+	uint64_t _phaseStart;               //when MRDY was asserted, or when processing started
+	uint64_t _bootDone;
+	std::vector<uint8_t> _rx;           //frame being clocked in from the host
+	std::vector<uint8_t> _tx;           //frame being clocked out to the host
+	size_t _txPos;
+	bool _pollInProgress;
+
+	/* AREQs */
+	void makeReady(const std::vector<uint8_t>& frame);
+	std::deque<std::vector<uint8_t> > _ready;
+	std::deque<uint64_t> _readySince;   //when each entry of _ready became ready
+	std::vector<Event> _scheduled;      //kept in order of due time
+
+	/* Kept in "NV": survives a reset unless cleared by the startup options */
+	std::map<uint8_t, std::vector<uint8_t> > _config;
+	std::map<uint16_t, std::vector<uint8_t> > _nv;
+	bool _networkValid;
+	uint16_t _networkPanId;
+	uint8_t _networkChannel;
+
+	/* Volatile state */
+	uint8_t _ieee[8];
+	uint8_t _deviceState;
+	uint16_t _shortAddress;
+	uint8_t _txPower;
+	uint32_t _time;
+	uint32_t _spiClock;
+	uint32_t _spiClockLimit;
+	uint16_t _random;
+	std::vector<uint8_t> _endpoints;
+	std::vector<Device> _devices;
+	OutgoingExt _outgoingExt;
+	std::map<uint32_t, std::vector<uint8_t> > _incomingStore;  //by timestamp, for AF_DATA_RETRIEVE
+	uint32_t _incomingTimestamp;
+	uint8_t _incomingTransaction;
+	AirHandler _airHandler;
+	JoinHandler _joinHandler;
+};
+
+#endif
@@ -1,3 +1,6 @@
 // enables UART display of errors, module details. useful for debugging
 //#define ENABLE_MODULE_SERIAL_DEBUG
-#define ENABLE_APPLICATION_SERIAL_DEBUG
\ No newline at end of file
+#define ENABLE_APPLICATION_SERIAL_DEBUG
+// builds the board's MRST/MRDY/SRDY pins into the SPI handshake, using the port registers directly
+// instead of digitalRead/digitalWrite. The pins can't be changed at runtime then. See hal_gpio.h
+//#define HAL_FIXED_PINS
@@ -0,0 +1,213 @@
+/**
+* @file address_cache.c
+*
+* @brief Remembers which IEEE (MAC) address goes with which short (network) address.
+*
+* Entries are learned from messages the Module sends us: end device announces, address responses and
+* incoming data. When the table is full the least recently used entry is replaced. A device that 
+* leaves the network is removed.
+*
+* All IEEE addresses are LSB first, the same order the Module uses.
+*/
+
+#include "address_cache.h"
+#include "module_commands.h"
+#include "zdo.h"
+#include "af.h"
+#include "utilities.h"
+#include "zm_phy_spi.h"
+#include <string.h>                     //for memcpy, memcmp
+
+#ifndef __MSP430G2553
+
+struct addressCacheEntry
+{
+    uint16_t shortAddress;
+    uint8_t ieeeAddress[8];
+    /** Value of useCounter when this entry was last added or found */
+    uint16_t lastUsed;
+};
+
+static struct addressCacheEntry cache[ADDRESS_CACHE_SIZE];
+
+/** Entries 0 to cacheEntries-1 are valid */
+static uint8_t cacheEntries = 0;
+
+/** Incremented each time an entry is used, to find the least recently used one */
+static uint16_t useCounter = 0;
+
+static uint32_t cacheHits = 0;
+static uint32_t cacheMisses = 0;
+
+/** Removes entry i by moving the last entry into its place */
+static void removeEntry(uint8_t i)
+{
+    cacheEntries--;
+    if (i != cacheEntries)
+        cache[i] = cache[cacheEntries];
+}
+
+/** Marks the entry for this short address as recently used, if there is one */
+static void touch(uint16_t shortAddress)
+{
+    uint8_t i;
+    for (i = 0; i < cacheEntries; i++)
+    {
+        if (cache[i].shortAddress == shortAddress)
+        {
+            cache[i].lastUsed = ++useCounter;
+            return;
+        }
+    }
+}
+
+/**
+Adds or updates a device. Any old entry with the same short address or the same IEEE address is 
+replaced, e.g. when a device rejoins with a new short address.
+@param shortAddress the device's short address
+@param ieeeAddress the device's 8 byte IEEE address, LSB first
+*/
+void addressCacheAdd(uint16_t shortAddress, const uint8_t* ieeeAddress)
+{
+    addressCacheRemove(shortAddress, ieeeAddress);
+    uint8_t slot;
+    if (cacheEntries < ADDRESS_CACHE_SIZE)
+    {
+        slot = cacheEntries++;
+    } else {                                    // Full; replace the least recently used entry
+        slot = 0;
+        uint8_t i;
+        for (i = 1; i < cacheEntries; i++)
+            if ((uint16_t)(useCounter - cache[i].lastUsed) > (uint16_t)(useCounter - cache[slot].lastUsed))
+                slot = i;
+    }
+    cache[slot].shortAddress = shortAddress;
+    memcpy(cache[slot].ieeeAddress, ieeeAddress, 8);
+    cache[slot].lastUsed = ++useCounter;
+}
+
+/**
+Looks up the short address of a device.
+@param ieeeAddress the device's 8 byte IEEE address, LSB first
+@param shortAddress where to put the short address if found
+@return 1 if found, 0 if not
+*/
+uint8_t addressCacheFindShortAddress(const uint8_t* ieeeAddress, uint16_t* shortAddress)
+{
+    uint8_t i;
+    for (i = 0; i < cacheEntries; i++)
+    {
+        if (memcmp(cache[i].ieeeAddress, ieeeAddress, 8) == 0)
+        {
+            cache[i].lastUsed = ++useCounter;
+            *shortAddress = cache[i].shortAddress;
+            cacheHits++;
+            return 1;
+        }
+    }
+    cacheMisses++;
+    return 0;
+}
+
+/**
+Looks up the IEEE address of a device.
+@param shortAddress the device's short address
+@param ieeeAddress where to put the 8 byte IEEE address, LSB first, if found
+@return 1 if found, 0 if not
+*/
+uint8_t addressCacheFindIeeeAddress(uint16_t shortAddress, uint8_t* ieeeAddress)
+{
+    uint8_t i;
+    for (i = 0; i < cacheEntries; i++)
+    {
+        if (cache[i].shortAddress == shortAddress)
+        {
+            cache[i].lastUsed = ++useCounter;
+            memcpy(ieeeAddress, cache[i].ieeeAddress, 8);
+            cacheHits++;
+            return 1;
+        }
+    }
+    cacheMisses++;
+    return 0;
+}
+
+/**
+Forgets a device.
+@param shortAddress entries with this short address are removed
+@param ieeeAddress entries with this IEEE address (LSB first) are removed. May be NULL.
+*/
+void addressCacheRemove(uint16_t shortAddress, const uint8_t* ieeeAddress)
+{
+    uint8_t i = 0;
+    while (i < cacheEntries)
+    {
+        if ((cache[i].shortAddress == shortAddress) || 
+            ((ieeeAddress != 0) && (memcmp(cache[i].ieeeAddress, ieeeAddress, 8) == 0)))
+            removeEntry(i);
+        else
+            i++;
+    }
+}
+
+/**
+Updates the cache from a message received from the Module. Call this with every message received;
+messages that don't contain address information are ignored.
+@param message the message, formatted like zmBuf
+*/
+void addressCacheLearn(const uint8_t* message)
+{
+    if (message[SRSP_LENGTH_FIELD] == 0)
+        return;
+    switch (CONVERT_TO_INT(message[SRSP_CMD_LSB_FIELD], message[SRSP_CMD_MSB_FIELD]))
+    {
+    case ZDO_END_DEVICE_ANNCE_IND:
+        addressCacheAdd(CONVERT_TO_INT(message[SRC_ADDRESS_LSB], message[SRC_ADDRESS_MSB]), 
+                        message + ZDO_END_DEVICE_ANNCE_IND_MAC_START_FIELD);
+        break;
+    case ZDO_IEEE_ADDR_RSP:
+    case ZDO_NWK_ADDR_RSP:
+        if (message[ZDO_IEEE_ADDR_RSP_STATUS_FIELD] == 0)
+            addressCacheAdd(CONVERT_TO_INT(message[SRSP_PAYLOAD_START + ZDO_IEEE_ADDR_RSP_SHORT_ADDRESS_FIELD_START], 
+                                           message[SRSP_PAYLOAD_START + ZDO_IEEE_ADDR_RSP_SHORT_ADDRESS_FIELD_START + 1]),
+                            message + ZDO_ADDR_RSP_IEEE_ADDRESS_START_FIELD);
+        break;
+    case ZDO_LEAVE_IND:
+        addressCacheRemove(CONVERT_TO_INT(message[ZDO_LEAVE_IND_SRC_ADDRESS_LSB_FIELD], message[ZDO_LEAVE_IND_SRC_ADDRESS_MSB_FIELD]), 
+                           message + ZDO_LEAVE_IND_IEEE_ADDRESS_START_FIELD);
+        break;
+    case AF_INCOMING_MSG:                       // Only has the short address, but shows the device is active
+        touch(CONVERT_TO_INT(message[AF_INCOMING_MESSAGE_SHORT_ADDRESS_LSB_FIELD], message[AF_INCOMING_MESSAGE_SHORT_ADDRESS_MSB_FIELD]));
+        break;
+    case AF_INCOMING_MSG_EXT:
+        if (message[AF_INCOMING_MESSAGE_EXT_ADDRESSING_MODE_FIELD] == DESTINATION_ADDRESS_MODE_SHORT)
+            touch(CONVERT_TO_INT(message[AF_INCOMING_MESSAGE_EXT_SHORT_ADDRESS_LSB_FIELD], message[AF_INCOMING_MESSAGE_EXT_SHORT_ADDRESS_MSB_FIELD]));
+        break;
+    }
+}
+
+/** Forgets all devices, e.g. when joining a different network. The hit/miss counters are kept. */
+void addressCacheClear()
+{
+    cacheEntries = 0;
+}
+
+/** @return how many devices are in the cache */
+uint8_t addressCacheCount()
+{
+    return cacheEntries;
+}
+
+/** @return how many lookups were answered from the cache */
+uint32_t addressCacheHits()
+{
+    return cacheHits;
+}
+
+/** @return how many lookups were not in the cache */
+uint32_t addressCacheMisses()
+{
+    return cacheMisses;
+}
+
+#endif
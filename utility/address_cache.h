@@ -0,0 +1,38 @@
+/**
+*  @file address_cache.h
+*
+*  @brief  public methods for address_cache.c
+*
+* A small least-recently-used table of IEEE (MAC) address <-> short (network) address pairs, so that
+* address lookups don't have to go over the air every time.
+*/
+
+#ifndef ADDRESS_CACHE_H
+#define ADDRESS_CACHE_H
+
+#include <stdint.h>
+
+#ifndef __MSP430G2553
+
+/** How many devices to remember. Each entry uses 12 bytes; fewer on the FR5969, which has 2KB of RAM. */
+#ifndef ADDRESS_CACHE_SIZE
+#if defined(__MSP430FR5969)
+#define ADDRESS_CACHE_SIZE      8
+#else
+#define ADDRESS_CACHE_SIZE      16
+#endif
+#endif
+
+void addressCacheAdd(uint16_t shortAddress, const uint8_t* ieeeAddress);
+uint8_t addressCacheFindShortAddress(const uint8_t* ieeeAddress, uint16_t* shortAddress);
+uint8_t addressCacheFindIeeeAddress(uint16_t shortAddress, uint8_t* ieeeAddress);
+void addressCacheRemove(uint16_t shortAddress, const uint8_t* ieeeAddress);
+void addressCacheLearn(const uint8_t* message);
+void addressCacheClear();
+uint8_t addressCacheCount();
+uint32_t addressCacheHits();
+uint32_t addressCacheMisses();
+
+#endif
+
+#endif
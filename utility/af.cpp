@@ -48,6 +48,7 @@ the Module physical interface. Module interface could be either SPI or UART.
 #include "utilities.h"
 #include "application_configuration.h"
 #include "zm_phy_spi.h"
+#include "timer_wheel.h"
 #include <string.h>                 //for memcpy()
 #include <stdint.h>
 
@@ -61,6 +62,8 @@ destination. Using APS ACK results in more traffic on the network. Most of the t
 */
 static uint8_t acknowledgmentMode = AF_MAC_ACK;
 //#define AF_VERBOSE
+/** Bytes of an AF_REGISTER frame that aren't cluster lists: length, command, 7 bytes of settings and 2 list lengths */
+#define AF_REGISTER_HEADER_LEN                            12
 #define METHOD_AF_REGISTER_APPLICATION                    0x2100
 /** 
  Configures the Module for our application.
@@ -78,9 +81,13 @@ moduleResult_t afRegisterApplication(const struct applicationConfiguration* ac)
 #ifdef AF_VERBOSE
     printf("Register Application Configuration with AF/ZDO\r\n");
 #endif
-    RETURN_INVALID_PARAMETER_IF_TRUE( (ac->endPoint == 0), METHOD_AF_REGISTER_APPLICATION);
     RETURN_NULL_PARAMETER_IF_TRUE( (ac == 0), METHOD_AF_REGISTER_APPLICATION);    
+    RETURN_INVALID_PARAMETER_IF_TRUE( (ac->endPoint == 0), METHOD_AF_REGISTER_APPLICATION);
     RETURN_INVALID_CLUSTER_IF_TRUE( ((ac->numberOfBindingInputClusters > MAX_BINDING_CLUSTERS) || (ac->numberOfBindingOutputClusters > MAX_BINDING_CLUSTERS)), METHOD_AF_REGISTER_APPLICATION);
+    RETURN_NULL_PARAMETER_IF_TRUE( ((ac->numberOfBindingInputClusters > 0) && (ac->bindingInputClusters == NULL)) ||
+                                   ((ac->numberOfBindingOutputClusters > 0) && (ac->bindingOutputClusters == NULL)), METHOD_AF_REGISTER_APPLICATION);
+    /* Both lists go straight into zmBuf, so they must fit in it */
+    RETURN_INVALID_CLUSTER_IF_TRUE( (AF_REGISTER_HEADER_LEN + 2 * (ac->numberOfBindingInputClusters + ac->numberOfBindingOutputClusters) > ZIGBEE_MODULE_BUFFER_SIZE), METHOD_AF_REGISTER_APPLICATION);
     
     //zmBuf[0] (length) will be set later
     zmBuf[1] = MSB(AF_REGISTER);
@@ -110,7 +117,7 @@ moduleResult_t afRegisterApplication(const struct applicationConfiguration* ac)
         zmBuf[bufferIndex++] = ac->bindingOutputClusters[cluster] & 0xFF;
         zmBuf[bufferIndex++] = ac->bindingOutputClusters[cluster] >> 8;
     }
-    zmBuf[0] = bufferIndex;
+    zmBuf[0] = bufferIndex - SRSP_PAYLOAD_START;
     RETURN_RESULT(sendMessage(), METHOD_AF_REGISTER_APPLICATION); 
 }
 
@@ -174,6 +181,95 @@ uint8_t getAckMode()
 	return acknowledgmentMode;
 }
 
+#define AF_DATA_REQUEST_PAYLOAD_LEN 10
+#define AF_DATA_REQUEST_SRSP_STATUS_FIELD   SRSP_PAYLOAD_START
+/** Private helper: builds an AF_DATA_REQUEST in zmBuf using the next transactionSequenceNumber.
+@see afSendData for description of these fields. Parameters are not checked.
+*/
+static void buildDataRequest(uint8_t destinationEndpoint, uint8_t sourceEndpoint, 
+                             uint16_t destinationShortAddress, uint16_t clusterId, 
+                             uint8_t* data, uint8_t dataLength)
+{
+    zmBuf[0] = AF_DATA_REQUEST_PAYLOAD_LEN + dataLength;
+    zmBuf[1] = MSB(AF_DATA_REQUEST);
+    zmBuf[2] = LSB(AF_DATA_REQUEST);      
+    
+    zmBuf[3] = LSB(destinationShortAddress); 
+    zmBuf[4] = MSB(destinationShortAddress);
+    zmBuf[5] = destinationEndpoint;
+    zmBuf[6] = sourceEndpoint;
+    zmBuf[7] = LSB(clusterId); 
+    zmBuf[8] = MSB(clusterId); 
+    zmBuf[9] = transactionSequenceNumber;  //Improperly read on Stellaris when post-increment operation here
+    zmBuf[10] = acknowledgmentMode;
+    zmBuf[11] = DEFAULT_RADIUS;
+    zmBuf[12] = dataLength; 
+    transactionSequenceNumber++;
+    
+    memcpy(zmBuf+AF_DATA_REQUEST_PAYLOAD_LEN+3, data, dataLength);
+}
+
+#ifndef __MSP430G2553
+/** One afSendDataAsync() message. A slot is free when status is AF_SEND_UNKNOWN. */
+struct afPendingSend
+{
+    uint8_t transactionId;
+    /** AF_SEND_PENDING until the AF_DATA_CONFIRM arrives, then the status from the AF_DATA_CONFIRM */
+    uint8_t status;
+    /** millis() when the message was sent, to reuse the oldest result first */
+    uint32_t sentAt;
+    /** Times out a missing AF_DATA_CONFIRM */
+    struct timer timeout;
+};
+
+static struct afPendingSend pendingSends[AF_MAX_PENDING_SENDS];
+
+/** How many pendingSends slots have been used since startup; slots above this have never been used */
+static uint8_t pendingSendSlotsUsed = 0;
+
+/** How many messages may be waiting for their AF_DATA_CONFIRM at once. @see afSetMaxPendingSends() */
+static uint8_t maxPendingSends = AF_MAX_PENDING_SENDS;
+
+/** Called when an afSendDataAsync() message completes. @see afSetDataConfirmCallback() */
+static void (*dataConfirmCallback)(uint8_t transactionId, uint8_t status) = 0;
+
+/** Records the result of an afSendDataAsync() message and lets the application know. */
+static void completePendingSend(struct afPendingSend* ps, uint8_t status)
+{
+    timerStop(&ps->timeout);
+    ps->status = status;
+    if (dataConfirmCallback)
+        dataConfirmCallback(ps->transactionId, status);
+}
+
+/** The AF_DATA_CONFIRM for an afSendDataAsync() message didn't arrive within AF_DATA_CONFIRM_TIMEOUT */
+static void pendingSendTimeout(void* context)
+{
+    completePendingSend((struct afPendingSend*) context, TIMEOUT);
+}
+#endif
+
+/** Private helper: waits for the AF_DATA_CONFIRM of the message with the given transactionId. 
+Confirms for other messages, i.e. those sent with afSendDataAsync(), are recorded along the way.
+@post zmBuf contains the AF_DATA_CONFIRM
+*/
+static moduleResult_t waitForDataConfirm(uint8_t transactionId)
+{
+    while (1)
+    {
+        moduleResult_t confirmResult = waitForMessage(AF_DATA_CONFIRM, AF_DATA_CONFIRM_TIMEOUT);
+        if (confirmResult != MODULE_SUCCESS)
+            return confirmResult;
+#ifndef __MSP430G2553
+        if (AF_DATA_CONFIRM_TRANS_ID == transactionId)
+            return MODULE_SUCCESS;
+        afHandleDataConfirm();
+#else
+        return MODULE_SUCCESS;
+#endif
+    }
+}
+
 #define METHOD_AF_SEND_DATA                    0x2300
 /** Sends a message to another device over the Zigbee network using the AF command AF_DATA_REQUEST.
 @param  destinationEndpoint which endpoint to send this to.
@@ -201,6 +297,7 @@ AF_APS_ACK at the expense of increased network traffic.
 @note   The <code>radius</code> is the maximum number of hops that this packet can travel through 
 before it will be dropped and should be set to the maximum number of hops expected in the network.
 @note   adjust AF_DATA_CONFIRM_TIMEOUT  based on network size, number of hops, etc.
+@note   To keep sending while earlier messages are still being delivered, use afSendDataAsync().
 @pre    the application was started successfully
 @pre    there is another device on the network with short address of <code>destinationShortAddress</code> 
 and that device has successfully started its application.
@@ -219,27 +316,11 @@ moduleResult_t afSendData(uint8_t destinationEndpoint, uint8_t sourceEndpoint,
            dataLength, destinationEndpoint, sourceEndpoint, clusterId, clusterId, destinationShortAddress, destinationShortAddress);
 #endif  
     
-#define AF_DATA_REQUEST_PAYLOAD_LEN 10
-    
-    zmBuf[0] = AF_DATA_REQUEST_PAYLOAD_LEN + dataLength;
-    zmBuf[1] = MSB(AF_DATA_REQUEST);
-    zmBuf[2] = LSB(AF_DATA_REQUEST);      
-    
-    zmBuf[3] = LSB(destinationShortAddress); 
-    zmBuf[4] = MSB(destinationShortAddress);
-    zmBuf[5] = destinationEndpoint;
-    zmBuf[6] = sourceEndpoint;
-    zmBuf[7] = LSB(clusterId); 
-    zmBuf[8] = MSB(clusterId); 
-    zmBuf[9] = transactionSequenceNumber;  //Improperly read on Stellaris when post-increment operation here
-    zmBuf[10] = acknowledgmentMode;
-    zmBuf[11] = DEFAULT_RADIUS;
-    zmBuf[12] = dataLength; 
-    transactionSequenceNumber++;
-    
-    memcpy(zmBuf+AF_DATA_REQUEST_PAYLOAD_LEN+3, data, dataLength);
+#ifndef AF_DATA_CONFIRM_HANDLED_BY_APPLICATION
+    uint8_t transactionId = transactionSequenceNumber;
+#endif
+    buildDataRequest(destinationEndpoint, sourceEndpoint, destinationShortAddress, clusterId, data, dataLength);
     RETURN_RESULT_IF_FAIL(sendMessage(), METHOD_AF_SEND_DATA); 
-#define AF_DATA_REQUEST_SRSP_STATUS_FIELD   SRSP_PAYLOAD_START
     //Now check the status returned in the SRSP:
     
 #ifdef AF_DATA_CONFIRM_HANDLED_BY_APPLICATION           //Return control to main application
@@ -247,29 +328,215 @@ moduleResult_t afSendData(uint8_t destinationEndpoint, uint8_t sourceEndpoint,
 #else
     RETURN_RESULT_IF_FAIL(zmBuf[AF_DATA_REQUEST_SRSP_STATUS_FIELD], METHOD_AF_SEND_DATA); 
     
-#define AF_DATA_CONFIRM_TIMEOUT 2
-    RETURN_RESULT_IF_FAIL(waitForMessage(AF_DATA_CONFIRM, AF_DATA_CONFIRM_TIMEOUT), METHOD_AF_SEND_DATA);
+    RETURN_RESULT_IF_FAIL(waitForDataConfirm(transactionId), METHOD_AF_SEND_DATA);
     RETURN_RESULT(zmBuf[AF_DATA_CONFIRM_STATUS_FIELD], METHOD_AF_SEND_DATA);  
 #endif
 }
 
+#ifndef __MSP430G2553
+#define METHOD_AF_SEND_DATA_ASYNC                    0x2A00
+/** Sends a message like afSendData() but does not wait for the AF_DATA_CONFIRM, so several messages
+can be in flight at once. The result arrives later, matched up by transactionId: either poll 
+afGetSendStatus() or set a callback with afSetDataConfirmCallback().
+@param  transactionId if not NULL, gets the transaction sequence number assigned to this message
+@see afSendData for description of the remaining fields.
+@return MODULE_SUCCESS if the Module accepted the message, else an error code. The delivery status
+comes from the AF_DATA_CONFIRM.
+@note If afSetMaxPendingSends() messages are already waiting for their AF_DATA_CONFIRM then this 
+waits until one of them completes or times out.
+@note Confirms are processed by afServiceDataConfirms(), afGetSendStatus(), any blocking afSendData() 
+and ZigBee.receive().
+*/
+moduleResult_t afSendDataAsync(uint8_t destinationEndpoint, uint8_t sourceEndpoint, 
+                               uint16_t destinationShortAddress, uint16_t clusterId, 
+                               uint8_t* data, uint8_t dataLength, uint8_t* transactionId)
+{
+    RETURN_INVALID_LENGTH_IF_TRUE( ((dataLength > MAXIMUM_PAYLOAD_LENGTH) || (dataLength == 0)), METHOD_AF_SEND_DATA_ASYNC);
+    RETURN_INVALID_CLUSTER_IF_TRUE( (clusterId == 0), METHOD_AF_SEND_DATA_ASYNC);
+    
+    afServiceDataConfirms();
+    while (afPendingSends() >= maxPendingSends)          // Pipeline is full; wait for a slot
+    {
+        delayMs(1);
+        afServiceDataConfirms();
+    }
+    
+    /* Use a free slot, else the slot holding the oldest result nobody has read */
+    struct afPendingSend* ps = 0;
+    uint8_t i;
+    for (i = 0; i < AF_MAX_PENDING_SENDS; i++)
+    {
+        if ((i == pendingSendSlotsUsed) || (pendingSends[i].status == AF_SEND_UNKNOWN))
+        {
+            ps = &pendingSends[i];
+            break;
+        }
+        if ((pendingSends[i].status != AF_SEND_PENDING) && ((ps == 0) || ((int32_t)(pendingSends[i].sentAt - ps->sentAt) < 0)))
+            ps = &pendingSends[i];
+    }
+    if (ps == &pendingSends[pendingSendSlotsUsed])
+        pendingSendSlotsUsed++;
+    
+    uint8_t id = transactionSequenceNumber;
+    buildDataRequest(destinationEndpoint, sourceEndpoint, destinationShortAddress, clusterId, data, dataLength);
+    ps->status = AF_SEND_UNKNOWN;
+    RETURN_RESULT_IF_FAIL(sendMessage(), METHOD_AF_SEND_DATA_ASYNC);
+    RETURN_RESULT_IF_FAIL(zmBuf[AF_DATA_REQUEST_SRSP_STATUS_FIELD], METHOD_AF_SEND_DATA_ASYNC);
+    
+    ps->transactionId = id;
+    ps->status = AF_SEND_PENDING;
+    ps->sentAt = millis();
+    timerStart(&ps->timeout, AF_DATA_CONFIRM_TIMEOUT * 1000UL, pendingSendTimeout, ps);
+    if (transactionId)
+        *transactionId = id;
+    return MODULE_SUCCESS;
+}
+
+/** Matches the AF_DATA_CONFIRM in zmBuf to the afSendDataAsync() message it belongs to.
+@pre zmBuf contains an AF_DATA_CONFIRM
+*/
+void afHandleDataConfirm()
+{
+    uint8_t id = AF_DATA_CONFIRM_TRANS_ID;
+    uint8_t i;
+    for (i = 0; i < pendingSendSlotsUsed; i++)
+    {
+        if ((pendingSends[i].status == AF_SEND_PENDING) && (pendingSends[i].transactionId == id))
+        {
+            completePendingSend(&pendingSends[i], AF_DATA_CONFIRM_STATUS);
+            return;
+        }
+    }
+}
+
+/** Processes any AF_DATA_CONFIRM messages that have arrived, and times out afSendDataAsync() messages
+that have waited longer than AF_DATA_CONFIRM_TIMEOUT. Other messages are left for ZigBee.receive().
+@note uses zmBuf
+*/
+void afServiceDataConfirms()
+{
+    if (afPendingSends() == 0)
+        return;
+    while (moduleTakeMessage(AF_DATA_CONFIRM))         // Fetched already by the SRDY interrupt or waitForMessage()
+        afHandleDataConfirm();
+    while (MODULE_HAS_MESSAGE_WAITING())
+    {
+        fetchMessage();
+        if (zmBuf[SRSP_LENGTH_FIELD] == 0)
+            continue;
+        if (IS_AF_DATA_CONFIRM())
+            afHandleDataConfirm();
+        else
+            moduleStashMessage();
+    }
+    timerService(millis());                             // time out the ones that have waited too long
+}
+
+/** Gets the result of a message sent with afSendDataAsync(). Once a result has been read, the 
+transactionId is forgotten.
+@param transactionId the transaction sequence number from afSendDataAsync()
+@return AF_SEND_PENDING if the AF_DATA_CONFIRM hasn't arrived yet, TIMEOUT if it never did, 
+AF_SEND_UNKNOWN if there is no record of this transactionId, else the status from the AF_DATA_CONFIRM 
+(MODULE_SUCCESS if delivered).
+*/
+uint8_t afGetSendStatus(uint8_t transactionId)
+{
+    afServiceDataConfirms();
+    uint8_t i;
+    for (i = 0; i < pendingSendSlotsUsed; i++)
+    {
+        if ((pendingSends[i].status != AF_SEND_UNKNOWN) && (pendingSends[i].transactionId == transactionId))
+        {
+            uint8_t status = pendingSends[i].status;
+            if (status != AF_SEND_PENDING)
+                pendingSends[i].status = AF_SEND_UNKNOWN;
+            return status;
+        }
+    }
+    return AF_SEND_UNKNOWN;
+}
+
+/** @return how many afSendDataAsync() messages are still waiting for their AF_DATA_CONFIRM */
+uint8_t afPendingSends()
+{
+    uint8_t count = 0;
+    uint8_t i;
+    for (i = 0; i < pendingSendSlotsUsed; i++)
+        if (pendingSends[i].status == AF_SEND_PENDING)
+            count++;
+    return count;
+}
+
+#define METHOD_AF_SET_MAX_PENDING_SENDS                    0x2B00
+/** Sets how many afSendDataAsync() messages may wait for their AF_DATA_CONFIRM at once.
+@param count 1 to AF_MAX_PENDING_SENDS
+*/
+moduleResult_t afSetMaxPendingSends(uint8_t count)
+{
+    RETURN_INVALID_PARAMETER_IF_TRUE( ((count == 0) || (count > AF_MAX_PENDING_SENDS)), METHOD_AF_SET_MAX_PENDING_SENDS);
+    maxPendingSends = count;
+    return MODULE_SUCCESS;
+}
+
+/** Sets a method to be called when an afSendDataAsync() message completes, with its transactionId 
+and status (the status from the AF_DATA_CONFIRM, or TIMEOUT). Set to NULL to poll afGetSendStatus() 
+instead. The result is also kept for afGetSendStatus() until its slot is reused.
+*/
+void afSetDataConfirmCallback(void (*callback)(uint8_t transactionId, uint8_t status))
+{
+    dataConfirmCallback = callback;
+}
+#endif
+
+
+/** Largest AF_DATA_STORE chunk the Module accepts, and the largest that fits in zmBuf */
+#define MAXIMUM_DATA_STORE_PAYLOAD_LENGTH 247
+#define AF_DATA_STORE_HEADER_LEN           3
+#if (ZIGBEE_MODULE_BUFFER_SIZE - AF_DATA_STORE_HEADER_LEN - 3) < MAXIMUM_DATA_STORE_PAYLOAD_LENGTH
+#define AF_DATA_STORE_CHUNK_LENGTH        (ZIGBEE_MODULE_BUFFER_SIZE - AF_DATA_STORE_HEADER_LEN - 3)
+#else
+#define AF_DATA_STORE_CHUNK_LENGTH        MAXIMUM_DATA_STORE_PAYLOAD_LENGTH
+#endif
+
+/** Pulls dataLength bytes from a data source, asking again until it has supplied them all.
+@return MODULE_SUCCESS, or AF_DATA_SOURCE_EMPTY if the source returned 0
+*/
+static moduleResult_t afPullData(afDataSource source, void* context, uint16_t index, uint8_t* destination, uint8_t dataLength)
+{
+    while (dataLength > 0)
+    {
+        uint8_t supplied = source(context, index, destination, dataLength);
+        if ((supplied == 0) || (supplied > dataLength))
+            return AF_DATA_SOURCE_EMPTY;
+        index += supplied;
+        destination += supplied;
+        dataLength -= supplied;
+    }
+    return MODULE_SUCCESS;
+}
+
+/** An afDataSource for a message that is already in RAM; context points to the whole message */
+static uint8_t afMemorySource(void* context, uint16_t index, uint8_t* destination, uint8_t length)
+{
+    memcpy(destination, (uint8_t*) context + index, length);
+    return length;
+}
 
 #define METHOD_AF_DATA_STORE                    0x2400
-/** Upload a chunk of data to the Module. Private helper method for afSendDataExtended().
+/** Upload a chunk of data to the Module. Private helper method for afSendDataStream(). The bytes are
+ * pulled from the source straight into zmBuf.
  * @param index where in the whole message this chunk of bytes should start
- * @param data the bytes to store
  * @param dataLength how many bytes to store. A length of zero is special and triggers the actually
  * sending of the data request over the air.
+ * @param source where the bytes come from; not used if dataLength is zero
 */
-static moduleResult_t afDataStore(uint16_t index, uint8_t* data, uint8_t dataLength)
+static moduleResult_t afDataStore(uint16_t index, uint8_t dataLength, afDataSource source, void* context)
 {
-#define MAXIMUM_DATA_STORE_PAYLOAD_LENGTH 247    
-    RETURN_INVALID_LENGTH_IF_TRUE( (dataLength > MAXIMUM_DATA_STORE_PAYLOAD_LENGTH), METHOD_AF_DATA_STORE);
+    RETURN_INVALID_LENGTH_IF_TRUE( (dataLength > AF_DATA_STORE_CHUNK_LENGTH), METHOD_AF_DATA_STORE);
     
 #ifdef AF_VERBOSE     
     printf("Storing %u bytes starting at index %u\r\n", dataLength, index);
 #endif 
-#define AF_DATA_STORE_HEADER_LEN           3
     zmBuf[0] = AF_DATA_STORE_HEADER_LEN + dataLength;
     zmBuf[1] = MSB(AF_DATA_STORE);
     zmBuf[2] = LSB(AF_DATA_STORE);  
@@ -277,8 +544,9 @@ static moduleResult_t afDataStore(uint16_t index, uint8_t* data, uint8_t dataLen
     zmBuf[3] = LSB(index); 
     zmBuf[4] = MSB(index);
     zmBuf[5] = dataLength;
-    memcpy(zmBuf+AF_DATA_STORE_HEADER_LEN + 3, data, dataLength);
-    RETURN_RESULT(sendMessage(), METHOD_AF_DATA_STORE);
+    RETURN_RESULT_IF_FAIL(afPullData(source, context, index, zmBuf+AF_DATA_STORE_HEADER_LEN + 3, dataLength), METHOD_AF_DATA_STORE);
+    RETURN_RESULT_IF_FAIL(sendMessage(), METHOD_AF_DATA_STORE);
+    RETURN_RESULT(zmBuf[SRSP_PAYLOAD_START], METHOD_AF_DATA_STORE);
 }
 
 //Note: no method ID since this is a simple wrapper method, and wrapped method does all error checking
@@ -301,20 +569,49 @@ moduleResult_t afSendDataExtendedShort(uint8_t _destinationEndpoint, uint8_t _so
                               _clusterId, _data, _dataLength);
 }
 
-#define METHOD_AF_DATA_REQUEST_EXT                    0x2600
+//Note: no method ID since this is a simple wrapper method, and wrapped method does all error checking
 /** Sends a message using extended messaging. This is more flexible and allows for long addressing.
 @param destinationLongAddress If using short addressing then the first two bytes are the short address, 
 LSB first. Remaining 6 bytes are don't care. If using long addressing then this is the 8 byte MAC, and LSB first.
 @param destinationAddressMode Either DESTINATION_ADDRESS_MODE_LONG or DESTINATION_ADDRESS_MODE_SHORT
 @see afSendData for description of remaining fields.
+@see afSendDataStream to send a message that isn't all in RAM.
 */
 moduleResult_t afSendDataExtended(uint8_t destinationEndpoint, uint8_t sourceEndpoint,
                                   uint8_t* destinationAddress, uint8_t destinationAddressMode,
                                   uint16_t clusterId, uint8_t* data, uint16_t dataLength)
+{
+    return afSendDataStream(destinationEndpoint, sourceEndpoint, destinationAddress, destinationAddressMode,
+                            clusterId, dataLength, afMemorySource, data, NULL);
+}
+
+#define METHOD_AF_DATA_REQUEST_EXT                    0x2600
+/** Sends a message using extended messaging, pulling the payload from a data source as it goes
+instead of needing all of it in RAM. Payloads up to AF_DATA_REQUEST_EXT_MAX_PAYLOAD_LENGTH go in the
+AF_DATA_REQUEST_EXT itself; longer ones are uploaded with AF_DATA_STORE in chunks as large as zmBuf
+allows. Either way the source writes straight into zmBuf, so the caller only needs whatever buffer
+its source uses, if any.
+@param dataLength total length of the message; the source must be able to supply all of it
+@param source called with the index of the next byte needed, where to put the bytes, and how many
+to put there. Returns how many it supplied; it is called again for the rest. Returning 0 aborts the
+send with AF_DATA_SOURCE_EMPTY.
+@param progress if not NULL, called with the bytes uploaded so far and dataLength after each chunk
+the Module accepts
+@param context passed to source and progress
+@see afSendDataExtended for description of remaining fields.
+@note if the source gives up after the AF_DATA_REQUEST_EXT was sent, the Module drops the partial
+message when it gets the next one.
+*/
+moduleResult_t afSendDataStream(uint8_t destinationEndpoint, uint8_t sourceEndpoint,
+                                uint8_t* destinationAddress, uint8_t destinationAddressMode,
+                                uint16_t clusterId, uint16_t dataLength,
+                                afDataSource source, void* context, afSendProgress progress)
 {
     RETURN_INVALID_LENGTH_IF_TRUE( ((dataLength > AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH) || (dataLength == 0)), METHOD_AF_DATA_REQUEST_EXT);
     RETURN_INVALID_CLUSTER_IF_TRUE( (clusterId == 0), METHOD_AF_DATA_REQUEST_EXT);
 	RETURN_INVALID_PARAMETER_IF_TRUE( (destinationAddressMode > DESTINATION_ADDRESS_MODE_LONG) && (destinationAddressMode !=DESTINATION_ADDRESS_MODE_BROADCAST), METHOD_AF_DATA_REQUEST_EXT);
+    RETURN_NULL_PARAMETER_IF_TRUE( ((destinationAddress == NULL) && (destinationAddressMode != DESTINATION_ADDRESS_MODE_NONE)), METHOD_AF_DATA_REQUEST_EXT);
+    RETURN_NULL_PARAMETER_IF_TRUE( ((source == NULL) || ((source == afMemorySource) && (context == NULL))), METHOD_AF_DATA_REQUEST_EXT);
     
 #ifdef AF_VERBOSE     
     /*char* destinationAddressModeName = (destinationAddressMode == DESTINATION_ADDRESS_MODE_LONG) ? "LONG" : "SHORT";
@@ -323,12 +620,17 @@ moduleResult_t afSendDataExtended(uint8_t destinationEndpoint, uint8_t sourceEnd
     printHexBytes(destinationAddress, 8);*/
 #endif  
 #define AF_DATA_REQUEST_EXT_HEADER_LEN  20
+    /* A payload short enough to go inline must fit in zmBuf along with the header */
+    RETURN_INVALID_LENGTH_IF_TRUE( ((dataLength <= AF_DATA_REQUEST_EXT_MAX_PAYLOAD_LENGTH) && (dataLength > ZIGBEE_MODULE_BUFFER_SIZE - AF_DATA_REQUEST_EXT_HEADER_LEN - 3)), METHOD_AF_DATA_REQUEST_EXT);
     //zmBuf[0] = AF_DATA_REQUEST_EXT_HEADER_LEN + dataLength;
     // Note: zmBuf[0] (length of this message) will be set below, based on whether the payload will fit in one message.
     zmBuf[1] = MSB(AF_DATA_REQUEST_EXT);
     zmBuf[2] = LSB(AF_DATA_REQUEST_EXT);      
     zmBuf[3] = destinationAddressMode;
-    if (destinationAddressMode == DESTINATION_ADDRESS_MODE_LONG) 
+    if (destinationAddress == NULL)                 // DESTINATION_ADDRESS_MODE_NONE: the Module uses its binding table
+    {
+        memset(zmBuf+4, 0, 8);
+    } else if (destinationAddressMode == DESTINATION_ADDRESS_MODE_LONG) 
     {
         memcpy(zmBuf+4, destinationAddress, 8);
     } else {  // short addressing
@@ -345,6 +647,9 @@ moduleResult_t afSendDataExtended(uint8_t destinationEndpoint, uint8_t sourceEnd
     zmBuf[20] = DEFAULT_RADIUS;
     zmBuf[21] = LSB(dataLength); 
     zmBuf[22] = MSB(dataLength); 
+#ifndef AF_DATA_CONFIRM_HANDLED_BY_APPLICATION
+    uint8_t transactionId = transactionSequenceNumber;
+#endif
     transactionSequenceNumber++;
 
 #define AF_DATA_REQUEST_EXT_SRSP_STATUS_FIELD   SRSP_PAYLOAD_START
@@ -356,17 +661,20 @@ moduleResult_t afSendDataExtended(uint8_t destinationEndpoint, uint8_t sourceEnd
 #ifdef AF_VERBOSE
         printf("Sending all in one message since dataLength %u < AF_DATA_REQUEST_EXT_MAX_PAYLOAD_LENGTH %u\r\n", dataLength, AF_DATA_REQUEST_EXT_MAX_PAYLOAD_LENGTH);
 #endif
-        memcpy(zmBuf+AF_DATA_REQUEST_EXT_HEADER_LEN+3, data, dataLength);
+        RETURN_RESULT_IF_FAIL(afPullData(source, context, 0, zmBuf+AF_DATA_REQUEST_EXT_HEADER_LEN+3, dataLength), METHOD_AF_DATA_REQUEST_EXT);
         
 #ifdef AF_DATA_CONFIRM_HANDLED_BY_APPLICATION           //Return control to main application
         RETURN_RESULT_IF_FAIL(sendMessage(), METHOD_AF_DATA_REQUEST_EXT);         
+        if (progress != NULL)
+            progress(context, dataLength, dataLength);
         RETURN_RESULT(zmBuf[AF_DATA_REQUEST_EXT_SRSP_STATUS_FIELD], METHOD_AF_DATA_REQUEST_EXT);          
 #else
         RETURN_RESULT_IF_FAIL(sendMessage(), METHOD_AF_DATA_REQUEST_EXT); 
         RETURN_RESULT_IF_FAIL(zmBuf[AF_DATA_REQUEST_EXT_SRSP_STATUS_FIELD], METHOD_AF_DATA_REQUEST_EXT);       
+        if (progress != NULL)
+            progress(context, dataLength, dataLength);
         
-#define AF_DATA_CONFIRM_TIMEOUT 2
-        RETURN_RESULT_IF_FAIL(waitForMessage(AF_DATA_CONFIRM, AF_DATA_CONFIRM_TIMEOUT), METHOD_AF_DATA_REQUEST_EXT);
+        RETURN_RESULT_IF_FAIL(waitForDataConfirm(transactionId), METHOD_AF_DATA_REQUEST_EXT);
         RETURN_RESULT(zmBuf[AF_DATA_CONFIRM_STATUS_FIELD], METHOD_AF_DATA_REQUEST_EXT);              
         
 #endif
@@ -380,33 +688,34 @@ moduleResult_t afSendDataExtended(uint8_t destinationEndpoint, uint8_t sourceEnd
         /** Index in the Module data buffer. This will be sent to the Module */
         uint16_t totalMessageIndex = 0;                          
         
-        while (dataLength > 0)                                   //while there is still more data to be stored...
+        while (totalMessageIndex < dataLength)                   //while there is still more data to be stored...
         {
             /** How many bytes to send in this afDataStore message */
             uint8_t bytesToSend = 0;
             
-            if (dataLength > MAXIMUM_DATA_STORE_PAYLOAD_LENGTH)  //if more bytes than what will fit in one message
+            if ((dataLength - totalMessageIndex) > AF_DATA_STORE_CHUNK_LENGTH)  //if more bytes than what will fit in one message
             {
-                bytesToSend = MAXIMUM_DATA_STORE_PAYLOAD_LENGTH; // then only send MAXIMUM_DATA_STORE_PAYLOAD_LENGTH bytes
+                bytesToSend = AF_DATA_STORE_CHUNK_LENGTH;        // then only send AF_DATA_STORE_CHUNK_LENGTH bytes
             } else {
-                bytesToSend = dataLength;                        // otherwise it will all fit in one afDataStore message
+                bytesToSend = dataLength - totalMessageIndex;    // otherwise it will all fit in one afDataStore message
             }
 
-            RETURN_RESULT_IF_FAIL(afDataStore(totalMessageIndex, data, bytesToSend), METHOD_AF_DATA_REQUEST_EXT);  //store each chunk of the total message
+            RETURN_RESULT_IF_FAIL(afDataStore(totalMessageIndex, bytesToSend, source, context), METHOD_AF_DATA_REQUEST_EXT);  //store each chunk of the total message
             
-            dataLength -= bytesToSend;                           // decrement our byte counter
             totalMessageIndex += bytesToSend;       
+            if (progress != NULL)
+                progress(context, totalMessageIndex, dataLength);
 #ifdef AF_VERBOSE  
-            printf("Sent %u Bytes, %u remaining\r\n", bytesToSend, dataLength);
+            printf("Sent %u Bytes, %u remaining\r\n", bytesToSend, dataLength - totalMessageIndex);
 #endif
         }
         
 #ifdef AF_DATA_CONFIRM_HANDLED_BY_APPLICATION
-        RETURN_RESULT(afDataStore(0, data, 0), METHOD_AF_DATA_REQUEST_EXT);  
+        RETURN_RESULT(afDataStore(0, 0, source, context), METHOD_AF_DATA_REQUEST_EXT);  
 #else
         /* Now we send a final afDataStore with length of 0 to indicate that we're done sending data */
-        RETURN_RESULT_IF_FAIL(afDataStore(0, data, 0), METHOD_AF_DATA_REQUEST_EXT);
-        RETURN_RESULT(waitForMessage(AF_DATA_CONFIRM, AF_DATA_CONFIRM_TIMEOUT), METHOD_AF_DATA_REQUEST_EXT);
+        RETURN_RESULT_IF_FAIL(afDataStore(0, 0, source, context), METHOD_AF_DATA_REQUEST_EXT);
+        RETURN_RESULT(waitForDataConfirm(transactionId), METHOD_AF_DATA_REQUEST_EXT);
 #endif
     }
 }
@@ -441,52 +750,89 @@ static moduleResult_t afDataRetrieve(uint8_t* timestamp, uint16_t index, uint8_t
     RETURN_RESULT(zmBuf[AF_DATA_RETRIEVE_SRSP_STATUS_FIELD], METHOD_AF_DATA_RETRIEVE);
 }
 
+/** Largest AF_DATA_RETRIEVE chunk the Module returns that also fits in zmBuf with the SRSP header */
+#if (ZIGBEE_MODULE_BUFFER_SIZE - AF_DATA_RETRIEVE_SRSP_PAYLOAD_START_FIELD) < MAXIMUM_AF_DATA_RETRIEVE_PAYLOAD_LENGTH
+#define AF_DATA_RETRIEVE_CHUNK_LENGTH     (ZIGBEE_MODULE_BUFFER_SIZE - AF_DATA_RETRIEVE_SRSP_PAYLOAD_START_FIELD)
+#else
+#define AF_DATA_RETRIEVE_CHUNK_LENGTH     MAXIMUM_AF_DATA_RETRIEVE_PAYLOAD_LENGTH
+#endif
+
+/** An afDataSink for retrieveExtendedMessage(); context points to where the whole message goes */
+static void afMemorySink(void* context, uint16_t index, uint8_t* data, uint8_t length)
+{
+    memcpy((uint8_t*) context + index, data, length);
+}
+
 #define METHOD_AF_RETRIEVE_EXTENDED_MESSAGE                    0x2800
-/** Retrieves all bytes of an AF_INCOMING_MESSAGE_EXT using multiple calls to AF_DATA_RETRIEVE as necessary.
-@pre destinationPtr points to memory large enough to contain the entire message (500B?)
+/** Retrieves the first length bytes of an AF_INCOMING_MESSAGE_EXT that the Module kept in its message
+store, using as many AF_DATA_RETRIEVE as necessary, and hands each chunk to sink as it arrives. Then 
+frees the message in the Module, whether or not the retrieval worked, so that a failed or partial 
+retrieval doesn't leave the Module short of memory.
 @param ts the timestamp of the message to retrieve.
-@param destinationPtr where to copy the bytes
-@param length of message payload to retrieve. Must be less than AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH.
-@post message will be copied into destinationPtr.
+@param length how many bytes of the payload to retrieve, from the start. May be less than the message
+length, e.g. if the rest doesn't fit anywhere; the rest is discarded. Zero just frees the message.
+@param sink called with the index in the message, the bytes and how many. The bytes are in zmBuf, so
+sink must not talk to the Module.
+@param context passed to sink
+@return MODULE_SUCCESS, or the first error
 */
-moduleResult_t retrieveExtendedMessage(uint8_t* ts, uint16_t length, uint8_t* destinationPtr)
+moduleResult_t retrieveExtendedMessageStream(uint8_t* ts, uint16_t length, afDataSink sink, void* context)
 {
-    RETURN_INVALID_LENGTH_IF_TRUE( ((length > AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH) ||
-                                    (length == 0)), METHOD_AF_RETRIEVE_EXTENDED_MESSAGE);    
+    RETURN_INVALID_LENGTH_IF_TRUE( (length > AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH), METHOD_AF_RETRIEVE_EXTENDED_MESSAGE);    
+    RETURN_NULL_PARAMETER_IF_TRUE( ((ts == NULL) || ((sink == NULL) && (length > 0))), METHOD_AF_RETRIEVE_EXTENDED_MESSAGE);
     
 #ifdef AF_VERBOSE    
     printf("Getting Extended Message, L%u, timestamp = ", length);
     printHexBytes(ts, 4);
 #endif
     
-    /* Index in the destinationPtr buffer containing the bytes we're writing. Will be sent to the Module */
+    /* Index in the message of the bytes we're getting. Will be sent to the Module */
     uint16_t totalMessageIndex = 0;
     
     /* This identifies which message we are retrieving. Basically a unique ID of the message */
     uint8_t timestamp[4];
     memcpy(timestamp, ts, 4);    
     
-    while (length > 0)  //while there are remaining bytes to be retrieved
+    moduleResult_t retrieveResult = MODULE_SUCCESS;
+    while (totalMessageIndex < length)  //while there are remaining bytes to be retrieved
     {
         uint8_t bytesToGet = 0;
-        if (length > MAXIMUM_AF_DATA_RETRIEVE_PAYLOAD_LENGTH)       // If the number of remaining bytes is more than what will fit in a message
+        if ((length - totalMessageIndex) > AF_DATA_RETRIEVE_CHUNK_LENGTH)   // If the number of remaining bytes is more than what will fit in a message
         {
-            bytesToGet = MAXIMUM_AF_DATA_RETRIEVE_PAYLOAD_LENGTH;   // then only get as many as will fit
+            bytesToGet = AF_DATA_RETRIEVE_CHUNK_LENGTH;             // then only get as many as will fit
         } else {
-            bytesToGet = length;                                    // otherwise get all that are remaining
+            bytesToGet = length - totalMessageIndex;                // otherwise get all that are remaining
         }
 #ifdef AF_VERBOSE          
         printf("bytesToGet=%u, totalMessageIndex=%u\r\n", bytesToGet, totalMessageIndex);
 #endif 
         
-        RETURN_RESULT_IF_FAIL(afDataRetrieve(timestamp, totalMessageIndex, bytesToGet), METHOD_AF_RETRIEVE_EXTENDED_MESSAGE);
-        memcpy(destinationPtr + totalMessageIndex, zmBuf+AF_DATA_RETRIEVE_SRSP_PAYLOAD_START_FIELD, bytesToGet); //copy this message's payload to the destination
+        retrieveResult = afDataRetrieve(timestamp, totalMessageIndex, bytesToGet);
+        if (retrieveResult != MODULE_SUCCESS)
+            break;                                                  // still free the message below
+        sink(context, totalMessageIndex, zmBuf+AF_DATA_RETRIEVE_SRSP_PAYLOAD_START_FIELD, bytesToGet);
         totalMessageIndex += bytesToGet;
-        length -= bytesToGet;
     }
     
     // Now send a final afDataRetrieve with index=0 and length=0 to free the message
-    RETURN_RESULT(afDataRetrieve(timestamp, 0, 0), METHOD_AF_RETRIEVE_EXTENDED_MESSAGE);
+    moduleResult_t freeResult = afDataRetrieve(timestamp, 0, 0);
+    RETURN_RESULT_IF_FAIL(retrieveResult, METHOD_AF_RETRIEVE_EXTENDED_MESSAGE);
+    RETURN_RESULT(freeResult, METHOD_AF_RETRIEVE_EXTENDED_MESSAGE);
+}
+
+/** Retrieves all bytes of an AF_INCOMING_MESSAGE_EXT using multiple calls to AF_DATA_RETRIEVE as necessary.
+@pre destinationPtr points to memory large enough to contain the entire message (500B?)
+@param ts the timestamp of the message to retrieve.
+@param destinationPtr where to copy the bytes
+@param length of message payload to retrieve. Must be less than AF_DATA_REQUEST_EXT_MAX_TOTAL_PAYLOAD_LENGTH.
+@post message will be copied into destinationPtr, and freed in the Module.
+@see retrieveExtendedMessageStream to retrieve a message without room for all of it
+*/
+moduleResult_t retrieveExtendedMessage(uint8_t* ts, uint16_t length, uint8_t* destinationPtr)
+{
+    RETURN_INVALID_LENGTH_IF_TRUE( (length == 0), METHOD_AF_RETRIEVE_EXTENDED_MESSAGE);
+    RETURN_NULL_PARAMETER_IF_TRUE( (destinationPtr == NULL), METHOD_AF_RETRIEVE_EXTENDED_MESSAGE);
+    return retrieveExtendedMessageStream(ts, length, afMemorySink, destinationPtr);
 }
 
 /** Displays the header information in an AF_INCOMING_MSG.
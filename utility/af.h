@@ -38,6 +38,15 @@
 #include "module_errors.h"
 #include <stdint.h>
 
+/** Supplies bytes of a message sent with afSendDataStream(): copies up to length bytes, starting at
+index in the whole message, to destination. Returns how many it copied; 0 aborts the send. */
+typedef uint8_t (*afDataSource)(void* context, uint16_t index, uint8_t* destination, uint8_t length);
+/** Told how many bytes of a message sent with afSendDataStream() the Module has so far */
+typedef void (*afSendProgress)(void* context, uint16_t sent, uint16_t total);
+/** Given each chunk of a message retrieved with retrieveExtendedMessageStream(): the index of the
+chunk in the whole message, the bytes and how many */
+typedef void (*afDataSink)(void* context, uint16_t index, uint8_t* data, uint8_t length);
+
 uint8_t getTransactionSequenceNumber();
 moduleResult_t afRegisterApplication(const struct applicationConfiguration* ac);
 moduleResult_t afRegisterGenericApplication();
@@ -50,7 +59,24 @@ moduleResult_t afSendDataExtended(uint8_t destinationEndpoint, uint8_t sourceEnd
 moduleResult_t afSendDataExtendedShort(uint8_t _destinationEndpoint, uint8_t _sourceEndpoint,
                                        uint16_t _destinationShortAddress, 
                                        uint16_t _clusterId, uint8_t* _data, uint16_t _dataLength);
+moduleResult_t afSendDataStream(uint8_t destinationEndpoint, uint8_t sourceEndpoint,
+                        uint8_t* destinationAddress, uint8_t destinationAddressMode,
+                        uint16_t clusterId, uint16_t dataLength,
+                        afDataSource source, void* context, afSendProgress progress);
 moduleResult_t retrieveExtendedMessage(uint8_t* ts, uint16_t length, uint8_t* destinationPtr);
+moduleResult_t retrieveExtendedMessageStream(uint8_t* ts, uint16_t length, afDataSink sink, void* context);
+
+#ifndef __MSP430G2553
+moduleResult_t afSendDataAsync(uint8_t destinationEndpoint, uint8_t sourceEndpoint,
+                      uint16_t destinationShortAddress, uint16_t clusterId, 
+                      uint8_t* data, uint8_t dataLength, uint8_t* transactionId);
+void afHandleDataConfirm();
+void afServiceDataConfirms();
+uint8_t afGetSendStatus(uint8_t transactionId);
+uint8_t afPendingSends();
+moduleResult_t afSetMaxPendingSends(uint8_t count);
+void afSetDataConfirmCallback(void (*callback)(uint8_t transactionId, uint8_t status));
+#endif
 
 int16_t printAfIncomingMsgHeader(uint8_t* srsp);
 void printAfIncomingMsgHeaderNames();
@@ -58,6 +84,21 @@ void printAfIncomingMsgHeaderNames();
 moduleResult_t afSetAckMode(uint8_t ackMode);
 inline uint8_t getAckMode();
 
+/** How many seconds to wait for the AF_DATA_CONFIRM after sending a message. Adjust based on network
+size, number of hops, etc. */
+#ifndef AF_DATA_CONFIRM_TIMEOUT
+#define AF_DATA_CONFIRM_TIMEOUT 2
+#endif
+
+/** How many afSendDataAsync() messages can be waiting for their AF_DATA_CONFIRM at once; fewer on the FR5969, which has 2KB of RAM */
+#ifndef AF_MAX_PENDING_SENDS
+#if defined(__MSP430FR5969)
+#define AF_MAX_PENDING_SENDS    4
+#else
+#define AF_MAX_PENDING_SENDS    8
+#endif
+#endif
+
 //For options field of afSendData()
 #define AF_MAC_ACK                         0x00    //Require Acknowledgement from next device on route
 #define AF_APS_ACK                      0x10    //Require Acknowledgement from final destination (if using AFZDO)
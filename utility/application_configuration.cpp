@@ -13,14 +13,16 @@
 * @note if using AF, the method afRegisterGenericApplication() does most of what you need.
 * @note binding is unsupported.
 * @note to configure a Coordinator with one binding input cluster 0x0001, then configure the ac with:
+ -  static const uint16_t clusters[] = { 0x0001 };
  -  ac.numberOfBindingInputClusters =   1; 
- -  ac.bindingInputClusters[0] =        0x0001;    
+ -  ac.bindingInputClusters =           clusters;    
  -  ac.numberOfBindingOutputClusters =  0;   
+* or simply ac = makeApplicationConfiguration(endPoint, clusters);
 *
 * @note to configure a Router with one binding output cluster 0x0001, then configure the ac with:
  -  ac.numberOfBindingInputClusters =   0;   
  -  ac.numberOfBindingOutputClusters =  1;
- -  ac.bindingOutputClusters[0] =       0x0001;
+ -  ac.bindingOutputClusters =          clusters;
 *
 *
 * @see sapiRegisterApplication() and sapiRegisterGenericApplication()
@@ -34,6 +34,7 @@
 #ifndef APPLICATION_CONFIGURATION_H
 #define APPLICATION_CONFIGURATION_H
 #include <stdint.h>
+#include <stddef.h>
 
 //default values used when creating applicationConfigurations in Simple API or AFZDO
 #define DEFAULT_ENDPOINT        0xD7 
@@ -74,19 +75,19 @@ struct applicationConfiguration
   When using AFZDO API must be LATENCY_NORMAL, LATENCY_FAST_BEACONS, or LATENCY_SLOW_BEACONS.*/
   uint8_t latencyRequested;
 
-#ifndef __MSP430G2553
-	#define MAX_BINDING_CLUSTERS 4  /** Maximum number of clusters available for binding is actually higher (32) but we use a lower number to conserve memory*/
-#else
-	#define MAX_BINDING_CLUSTERS 1
-#endif
+  /** Maximum number of clusters in each list, as allowed by the module. The lists aren't kept in this 
+  struct, so each endpoint only uses as much memory as its lists need. */
+  #define MAX_BINDING_CLUSTERS 32
+  
   /** Number of Input Clusters for Binding. If not using binding then set to zero.*/
   uint8_t numberOfBindingInputClusters;
 
   /** List of Input Clusters for Binding. If not using binding then this does not apply. 
   To allow another device to bind to this device, must use ZB_ALLOW_BIND on this device and must also
-  use ZB_BIND_DEVICE on the other device. */  
+  use ZB_BIND_DEVICE on the other device. 
+  The list is not copied; it must stay around (e.g. a static const array) while the endpoint may be registered. */  
 
-  uint16_t bindingInputClusters[MAX_BINDING_CLUSTERS];
+  const uint16_t* bindingInputClusters;
 
   
   /** Number of Output Clusters for Binding. If not using binding then set to zero.*/  
@@ -96,7 +97,7 @@ struct applicationConfiguration
   To bind to another device, that device must use ZB_ALLOW_BIND and this device must use 
   ZB_BIND_DEVICE to create a binding. */    
 
-  uint16_t bindingOutputClusters[MAX_BINDING_CLUSTERS];
+  const uint16_t* bindingOutputClusters;
 
 
   
@@ -109,4 +110,40 @@ struct applicationConfiguration
 void displayApplicationConfiguration(const struct applicationConfiguration* ac);
 
 extern const struct applicationConfiguration DEFAULT_APPLICATION_CONFIGURATION;
+
+/** 
+Makes a copy of DEFAULT_APPLICATION_CONFIGURATION for endPoint with the given binding clusters. The number of
+clusters in each list comes from the size of the array, and too many clusters won't compile.
+@param endPoint the Zigbee endpoint
+@param inputClusters array of input clusters; must stay around (e.g. static const) while the endpoint may be registered
+@param outputClusters array of output clusters; likewise
+@return the applicationConfiguration, e.g. for ZigBee.appAdd()
+*/
+template <size_t INPUTS, size_t OUTPUTS>
+struct applicationConfiguration makeApplicationConfiguration(uint8_t endPoint, const uint16_t (&inputClusters)[INPUTS], 
+                                                             const uint16_t (&outputClusters)[OUTPUTS])
+{
+    typedef char tooManyBindingClusters[(INPUTS <= MAX_BINDING_CLUSTERS && OUTPUTS <= MAX_BINDING_CLUSTERS) ? 1 : -1];
+    (void) sizeof(tooManyBindingClusters);
+    struct applicationConfiguration ac = DEFAULT_APPLICATION_CONFIGURATION;
+    ac.endPoint = endPoint;
+    ac.numberOfBindingInputClusters = INPUTS;
+    ac.bindingInputClusters = inputClusters;
+    ac.numberOfBindingOutputClusters = OUTPUTS;
+    ac.bindingOutputClusters = outputClusters;
+    return ac;
+}
+
+/** As above, with input clusters only */
+template <size_t INPUTS>
+struct applicationConfiguration makeApplicationConfiguration(uint8_t endPoint, const uint16_t (&inputClusters)[INPUTS])
+{
+    typedef char tooManyBindingClusters[(INPUTS <= MAX_BINDING_CLUSTERS) ? 1 : -1];
+    (void) sizeof(tooManyBindingClusters);
+    struct applicationConfiguration ac = DEFAULT_APPLICATION_CONFIGURATION;
+    ac.endPoint = endPoint;
+    ac.numberOfBindingInputClusters = INPUTS;
+    ac.bindingInputClusters = inputClusters;
+    return ac;
+}
 #endif
@@ -2,15 +2,24 @@
 #include <stdint.h>
 #include <stdbool.h>  //Required for driverlib compatibility
 #include "Energia.h"
-#include "HAL.h"
+#include "hal.h"
 #include "../../SPI/SPI.h"
 #include "hal_version.h"
+#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM__) || defined(__TM4C1294NCPDT__) || defined(__TM4C129XNCZAD__) 
+#include "inc/hw_memmap.h"
+#include "driverlib/ssi.h"
+#endif
 
 halConfiguration hal;
 
 /** Initializes Ports/Pins: sets direction, interrupts, pullup/pulldown resistors etc. */
 void halInit()
 {
+#ifdef HAL_PIN_TRAITS
+	hal.mrstPin=halMrst::pin;	// the handshake only uses the built in pins
+	hal.mrdyPin=halMrdy::pin;
+	hal.srdyPin=halSrdy::pin;
+#endif
 	pinMode(hal.mrdyPin,OUTPUT);	//SS & MRDY
 	pinMode(hal.srdyPin,INPUT);	// SRDY
 	pinMode(hal.mrstPin,OUTPUT);	//MRST
@@ -33,42 +42,138 @@ void displayVersion()
     printf("%s", MODULE_VERSION_STRING);
 }
 
+/* The SPI clock divider each board starts with, known to work with the Module */
+#if defined(__TM4C1294NCPDT__) || defined(__TM4C129XNCZAD__)
+#define SPI_DEFAULT_CLOCK_DIVIDER   SPI_CLOCK_DIV2 //1 MHz SPI Clock  
+#else
+#define SPI_DEFAULT_CLOCK_DIVIDER   SPI_CLOCK_DIV8 //1 MHz SPI Clock  
+#endif
+
+/* The smallest divider the SPI port takes */
+#ifdef SPI_CLOCK_DIV1
+#define SPI_FASTEST_CLOCK_DIVIDER   SPI_CLOCK_DIV1
+#else
+#define SPI_FASTEST_CLOCK_DIVIDER   SPI_CLOCK_DIV2
+#endif
+
+/* What the dividers divide, if known: SMCLK on the MSP430, the shim's base clock on the host */
+#if defined(ZIGBEE_HOST)
+#define SPI_SOURCE_CLOCK            HOST_SPI_BASE_CLOCK
+#elif defined(__MSP430__) && defined(F_CPU)
+#define SPI_SOURCE_CLOCK            F_CPU
+#endif
+
+/** The divider set with halSpiSetClockDivider(), e.g. by calibration; 0 if none */
+static uint8_t spiClockDivider = 0;
+
 /* Setup for standard launchpads */
 void halSpiInitModule()
 {
 
-#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM____) || defined(__TM4C1294NCPDT__) || defined(__TM4C129XNCZAD__) 
+#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM__) || defined(__TM4C1294NCPDT__) || defined(__TM4C129XNCZAD__) 
 	SPI.setModule(hal.spiModule);
 #else
 	SPI.begin();
 #endif
 	SPI.setDataMode(SPI_MODE0);
-	
-#if defined(__TM4C1294NCPDT__) || defined(__TM4C129XNCZAD__)
-	SPI.setClockDivider(SPI_CLOCK_DIV2); //1 MHz SPI Clock  
-#elseif defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM____)
-	SPI.setClockDivider(SPI_CLOCK_DIV8); //1 MHz SPI Clock  
-#else
-	SPI.setClockDivider(SPI_CLOCK_DIV8); //1 MHz SPI Clock  
-#endif
+	SPI.setClockDivider(halSpiGetClockDivider());
     // Don't select the module
     SPI_SS_CLEAR();
 }
 
+/**
+Changes the SPI clock; it is kept over halSpiReset().
+@param divider one of the SPI_CLOCK_DIVn values, or 0 to go back to hal.spiClockDivider if the application 
+set one, else the board's default
+*/
+void halSpiSetClockDivider(uint8_t divider)
+{
+	spiClockDivider = divider;
+	SPI.setClockDivider(halSpiGetClockDivider());
+}
+
+/**
+Forgets the divider set with halSpiSetClockDivider() without touching the SPI port, which may not have
+been set up yet; halSpiInitModule() applies halSpiGetClockDivider() when it runs.
+*/
+void halSpiClearClockDivider()
+{
+	spiClockDivider = 0;
+}
+
+/** @return the SPI clock divider in use */
+uint8_t halSpiGetClockDivider()
+{
+	if (spiClockDivider != 0)
+		return spiClockDivider;
+	return (hal.spiClockDivider != 0) ? hal.spiClockDivider : SPI_DEFAULT_CLOCK_DIVIDER;
+}
+
+/** @return the next faster divider than this one, or 0 if the SPI port can't go any faster */
+uint8_t halSpiFasterClockDivider(uint8_t divider)
+{
+	return (divider > SPI_FASTEST_CLOCK_DIVIDER) ? (divider / 2) : 0;
+}
+
+/** @return the SPI clock in Hz, or 0 if it isn't known on this board */
+uint32_t halSpiClockHz()
+{
+#ifdef SPI_SOURCE_CLOCK
+	return SPI_SOURCE_CLOCK / halSpiGetClockDivider();
+#else
+	return 0;
+#endif
+}
+
 void halSpiReset(){
 	SPI.end();
 	halSpiInitModule();
 }
 
-/* Uses Energia SPI Functions */
+#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM__) || defined(__TM4C1294NCPDT__) || defined(__TM4C129XNCZAD__) 
+/** The SSI peripheral behind each of Energia's SPI modules */
+static const uint32_t ssiBase[] = { SSI0_BASE, SSI1_BASE, SSI2_BASE, SSI3_BASE };
+/** How many frames the SSI transmit and receive FIFOs each hold */
+#define SSI_FIFO_DEPTH  8
+#endif
+
+/**
+Clocks a block of bytes out to the Module, replacing each with the byte clocked in (write-to-read).
+On the Stellaris/Tiva LaunchPads the SSI FIFOs are kept full, so the bytes go back to back instead of 
+waiting for each one to come back before sending the next; elsewhere it uses Energia's SPI.transfer().
+@pre the Module is selected (MRDY low)
+*/
+void halSpiTransfer(uint8_t *bytes, uint16_t numBytes)
+{
+#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM__) || defined(__TM4C1294NCPDT__) || defined(__TM4C129XNCZAD__) 
+	uint32_t base = ssiBase[hal.spiModule & 0x03];
+	uint32_t data;
+	uint16_t sent = 0;
+	uint16_t received = 0;
+	while (SSIDataGetNonBlocking(base, &data))	// nothing left over from before
+		;
+	while (received < numBytes)
+	{
+		while ((sent < numBytes) && ((sent - received) < SSI_FIFO_DEPTH))	// never more in flight than the receive FIFO holds
+			SSIDataPut(base, bytes[sent++]);
+		SSIDataGet(base, &data);
+		bytes[received++] = (uint8_t) data;
+	}
+#elif defined(ZIGBEE_HOST)
+	SPI.transfer(bytes, numBytes);	// one burst for the backend, e.g. a single spidev transfer
+#else
+	while (numBytes--)
+	{
+		*bytes = SPI.transfer(*bytes);
+		bytes++;
+	}
+#endif
+}
+
+/* For compatibility */
 void spiWrite(unsigned char *bytes, unsigned char numBytes)
 {
-	uint8_t ulReadData;
-	while(numBytes--)    // Loop while there are more bytes left to be transferred.
-    {
-		ulReadData=SPI.transfer(*bytes);
-        *bytes++ = (unsigned char)ulReadData;       // ...and then convert it to a char
-    }
+	halSpiTransfer(bytes, numBytes);
 }
 
 
@@ -8,10 +8,17 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include "printf.h"
+#include "hal_gpio.h"
 
 void halInit();
 void halSpiInitModule();
 void halSpiReset();
+void halSpiSetClockDivider(uint8_t divider);
+void halSpiClearClockDivider();
+uint8_t halSpiGetClockDivider();
+uint8_t halSpiFasterClockDivider(uint8_t divider);
+uint32_t halSpiClockHz();
+void halSpiTransfer(uint8_t *bytes, uint16_t numBytes);
 void spiWrite(uint8_t *bytes, uint8_t numBytes);
 void displayVersion();
 void delayMs(uint16_t ms);
@@ -21,6 +28,7 @@ struct halConfiguration{
 	uint8_t mrdyPin;
 	uint8_t srdyPin;
 	uint8_t spiModule;
+	uint8_t spiClockDivider;	// SPI_CLOCK_DIVn to always use; 0 to start at the board's default and let begin() calibrate it
 };
 
 extern halConfiguration hal;
@@ -42,8 +50,6 @@ extern uint8_t SPImodule;
 
 /** Get the processor clock frequency */
 #define GET_MCLK_FREQ() (SysCtlClockGet())
-#define TICKS_PER_MS	25000			// used in FAST_PROCESSOR option of zm_phy
-#define TICKS_PER_US (TICKS_PER_MS / 1000)
 //#define WAIT_WHILE_SPI_BUSY()  while ((HWREG(SSI0_BASE + SSI_O_SR)) & SSI_SR_BSY)   //wait while busy
 
 // SysTick
@@ -68,12 +74,21 @@ since the one on the LaunchPad is controlled by hardware PWM.
 //Module MRDY = CS = PA5
 //Module SRDY = PA7
 //PRECONDITIONS: GPIO PORTS HAVE BEEN ENABLED & PINS WERE CONFIGURED: RST, MRDY as outputs; SRDY as input
+#ifdef HAL_PIN_TRAITS	// HAL_FIXED_PINS: the board's pins are built in, see hal_gpio.h
+#define RADIO_ON()                  ( halMrst::high() )
+#define RADIO_OFF()                 ( halMrst::low() )
+#define SPI_SS_SET()                ( halMrdy::low() )
+#define SPI_SS_CLEAR()              ( halMrdy::high() )
+#define SRDY_IS_HIGH()              ( halSrdy::isHigh() )
+#define SRDY_IS_LOW()               ( !halSrdy::isHigh() )
+#else
 #define RADIO_ON()                  ( digitalWrite(hal.mrstPin,HIGH) )
 #define RADIO_OFF()                 ( digitalWrite(hal.mrstPin,LOW) )
 #define SPI_SS_SET()                ( digitalWrite(hal.mrdyPin,LOW) ) 	//MRDY tied to CS in hardware?
 #define SPI_SS_CLEAR()              ( digitalWrite(hal.mrdyPin,HIGH) )
 #define SRDY_IS_HIGH()              ( digitalRead(hal.srdyPin)==HIGH )
 #define SRDY_IS_LOW()               ( digitalRead(hal.srdyPin)==LOW )
+#endif
 
 
 #endif
@@ -0,0 +1,113 @@
+/**
+*  @file hal_gpio.h
+*
+*  @brief  MRST, MRDY and SRDY as compile-time pins, for the handshake macros in hal.h
+*
+* By default the handshake macros call digitalWrite() and digitalRead() with the pins in hal, which
+* looks up the port and bit of the pin on every call. SPI_SS_SET(), SPI_SS_CLEAR() and SRDY_IS_HIGH()
+* run in the tightest loops of every SREQ, so with HAL_FIXED_PINS defined (in _SETTINGS_.h or on the
+* command line) the board's default pins are built in instead: each of halMrst, halMrdy and halSrdy
+* names its port registers as template arguments, and the macros compile to a single register access.
+*
+* The pins are those the ZigBeeClass constructor sets for the board; halInit() puts them back in hal,
+* so mrstPin(), mrdyPin() and srdyPin() have no effect. Boards without pins here (e.g. the CC3200)
+* use the pins in hal as before, and HAL_PIN_TRAITS is left undefined.
+*/
+
+#ifndef HAL_GPIO_H
+#define HAL_GPIO_H
+
+#include "Energia.h"
+#include <stdint.h>
+#include "_SETTINGS_.h"
+
+#ifdef HAL_FIXED_PINS
+
+#if defined(__MSP430G2553) || defined(__MSP430FR5969) || defined(__MSP430F5529)
+/**
+A pin on an MSP430 port.
+@param Pin the Energia pin number, e.g. P2_0
+@param In the address of PxIN
+@param Out the address of PxOUT
+@param Mask the pin's bit, e.g. BIT0
+*/
+template <uint8_t Pin, uint16_t In, uint16_t Out, uint8_t Mask>
+struct halMsp430Pin
+{
+    enum { pin = Pin };
+    static inline void high() { *(volatile uint8_t*) Out |= Mask; }
+    static inline void low() { *(volatile uint8_t*) Out &= (uint8_t) ~Mask; }
+    static inline bool isHigh() { return ((*(volatile uint8_t*) In) & Mask) != 0; }
+};
+#endif
+
+#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM__) || defined(__TM4C1294NCPDT__) || defined(__TM4C129XNCZAD__)
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_gpio.h"
+/**
+A pin on a Tiva GPIO port, through the masked data register: bits 9:2 of the address select which
+pins a read or write touches, so a write needs no read-modify-write.
+@param Pin the Energia pin number, e.g. PA_5
+@param Base the port, e.g. GPIO_PORTA_BASE
+@param Mask the pin's bit, e.g. GPIO_PIN_5
+*/
+template <uint8_t Pin, uint32_t Base, uint8_t Mask>
+struct halTivaPin
+{
+    enum { pin = Pin };
+    static inline void high() { HWREG(Base + GPIO_O_DATA + (Mask << 2)) = Mask; }
+    static inline void low() { HWREG(Base + GPIO_O_DATA + (Mask << 2)) = 0; }
+    static inline bool isHigh() { return HWREG(Base + GPIO_O_DATA + (Mask << 2)) != 0; }
+};
+#endif
+
+#if defined(ZIGBEE_HOST)
+#include "host_backend.h"
+/** A pin on the host, going straight to the backend at the cost of a port access. @see hostPortWrite() */
+template <uint8_t Pin>
+struct halHostPin
+{
+    enum { pin = Pin };
+    static inline void high() { hostPortWrite(Pin, HIGH); }
+    static inline void low() { hostPortWrite(Pin, LOW); }
+    static inline bool isHigh() { return hostPortRead(Pin) == HIGH; }
+};
+#endif
+
+/* The default pins of each board, as set in the ZigBeeClass constructor */
+#if defined(__MSP430G2553)
+typedef halMsp430Pin<P2_7, 0x0028, 0x0029, BIT7> halMrst;   // P2IN, P2OUT
+typedef halMsp430Pin<P2_0, 0x0028, 0x0029, BIT0> halMrdy;
+typedef halMsp430Pin<P2_2, 0x0028, 0x0029, BIT2> halSrdy;
+#define HAL_PIN_TRAITS
+#elif defined(__MSP430FR5969)
+typedef halMsp430Pin<P3_0, 0x0220, 0x0222, BIT0> halMrst;   // P3IN, P3OUT
+typedef halMsp430Pin<P3_4, 0x0220, 0x0222, BIT4> halMrdy;
+typedef halMsp430Pin<P3_6, 0x0220, 0x0222, BIT6> halSrdy;
+#define HAL_PIN_TRAITS
+#elif defined(__MSP430F5529)
+typedef halMsp430Pin<P2_2, 0x0201, 0x0203, BIT2> halMrst;   // P2IN, P2OUT
+typedef halMsp430Pin<P2_7, 0x0201, 0x0203, BIT7> halMrdy;
+typedef halMsp430Pin<P4_1, 0x0221, 0x0223, BIT1> halSrdy;   // P4IN, P4OUT
+#define HAL_PIN_TRAITS
+#elif defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM__)
+typedef halTivaPin<PE_0, GPIO_PORTE_BASE, 0x01> halMrst;
+typedef halTivaPin<PA_5, GPIO_PORTA_BASE, 0x20> halMrdy;
+typedef halTivaPin<PA_7, GPIO_PORTA_BASE, 0x80> halSrdy;
+#define HAL_PIN_TRAITS
+#elif defined(__TM4C1294NCPDT__) || defined(__TM4C129XNCZAD__)
+typedef halTivaPin<PH_2, GPIO_PORTH_AHB_BASE, 0x04> halMrst;
+typedef halTivaPin<PC_7, GPIO_PORTC_AHB_BASE, 0x80> halMrdy;
+typedef halTivaPin<PB_3, GPIO_PORTB_AHB_BASE, 0x08> halSrdy;
+#define HAL_PIN_TRAITS
+#elif defined(ZIGBEE_HOST)
+typedef halHostPin<HOST_MRST_PIN> halMrst;
+typedef halHostPin<HOST_MRDY_PIN> halMrdy;
+typedef halHostPin<HOST_SRDY_PIN> halSrdy;
+#define HAL_PIN_TRAITS
+#endif
+
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+/**
+* @file message_queue.c
+*
+* @brief Holds frames received from the Module until the application asks for them.
+*
+* Frames are packed back to back in queueBuffer; the oldest frame always starts at index 0. Removing
+* a frame moves the remaining bytes down, which is cheap for a few hundred bytes and means a frame is
+* never split across the end of the buffer.
+*
+* @note None of these methods disable interrupts. The physical interface layer (zm_phy_spi.c) makes
+* sure the SRDY interrupt never runs while the main program is inside one of these methods.
+*/
+
+#include "message_queue.h"
+#include <string.h>                     //for memcpy, memmove
+
+#ifndef __MSP430G2553
+
+static uint8_t queueBuffer[MESSAGE_QUEUE_SIZE];
+
+/** How many bytes of queueBuffer are in use */
+static uint16_t queueUsed = 0;
+
+/** How many frames are in queueBuffer */
+static uint8_t queueFrames = 0;
+
+/** How many frames were discarded because the queue was full */
+static uint16_t queueDropped = 0;
+
+/** Total size of the frame starting at frame, including the 3 header bytes */
+#define FRAME_SIZE(frame)       ((uint16_t)(frame)[0] + 3)
+
+/**
+Adds a copy of a frame to the end of the queue.
+@param frame the frame to add, formatted like zmBuf
+@return 1 if the frame was queued, 0 if there was no room (the frame is counted as dropped)
+*/
+uint8_t messageQueuePush(const uint8_t* frame)
+{
+    uint16_t size = FRAME_SIZE(frame);
+    if ((queueUsed + size > MESSAGE_QUEUE_SIZE) || (queueFrames == 0xFF))
+    {
+        queueDropped++;
+        return 0;
+    }
+    memcpy(queueBuffer + queueUsed, frame, size);
+    queueUsed += size;
+    queueFrames++;
+    return 1;
+}
+
+/**
+@return where the next frame goes, so that one can be read straight into the queue rather than copied
+in; messageQueueFree() bytes are free there. Call messageQueueCommit() once the frame is in place.
+*/
+uint8_t* messageQueueTail()
+{
+    return queueBuffer + queueUsed;
+}
+
+/**
+Adds the frame written at messageQueueTail() to the end of the queue.
+@return 1 if the frame was queued, 0 if it ran past the end of the queue (it is counted as dropped)
+*/
+uint8_t messageQueueCommit()
+{
+    uint16_t size = FRAME_SIZE(queueBuffer + queueUsed);
+    if ((queueUsed + size > MESSAGE_QUEUE_SIZE) || (queueFrames == 0xFF))
+    {
+        queueDropped++;
+        return 0;
+    }
+    queueUsed += size;
+    queueFrames++;
+    return 1;
+}
+
+/**
+Removes the oldest frame from the queue.
+@param frame where to copy the frame, e.g. zmBuf
+@param frameSize size of the destination buffer. Longer frames are truncated.
+@return 1 if a frame was copied, 0 if the queue was empty
+*/
+uint8_t messageQueuePop(uint8_t* frame, uint16_t frameSize)
+{
+    if (queueFrames == 0)
+        return 0;
+    uint16_t size = FRAME_SIZE(queueBuffer);
+    memcpy(frame, queueBuffer, (size < frameSize) ? size : frameSize);
+    queueUsed -= size;
+    queueFrames--;
+    memmove(queueBuffer, queueBuffer + size, queueUsed);
+    return 1;
+}
+
+/**
+Removes the oldest frame of the given type from the queue, leaving frames of other types in order.
+@param messageType the command of the frame to look for, e.g. AF_DATA_CONFIRM
+@param frame where to copy the frame, e.g. zmBuf
+@param frameSize size of the destination buffer. Longer frames are truncated.
+@return 1 if a frame was copied, 0 if no frame of that type was queued
+*/
+uint8_t messageQueueTake(uint16_t messageType, uint8_t* frame, uint16_t frameSize)
+{
+    uint16_t offset = 0;
+    while (offset < queueUsed)
+    {
+        uint8_t* candidate = queueBuffer + offset;
+        uint16_t size = FRAME_SIZE(candidate);
+        if ((((uint16_t)candidate[1] << 8) | candidate[2]) == messageType)
+        {
+            memcpy(frame, candidate, (size < frameSize) ? size : frameSize);
+            queueUsed -= size;
+            queueFrames--;
+            memmove(candidate, candidate + size, queueUsed - offset);
+            return 1;
+        }
+        offset += size;
+    }
+    return 0;
+}
+
+/** @return how many frames are waiting in the queue */
+uint8_t messageQueueCount()
+{
+    return queueFrames;
+}
+
+/** @return how many bytes are left for frames, including their 3 header bytes */
+uint16_t messageQueueFree()
+{
+    return (uint16_t) (MESSAGE_QUEUE_SIZE - queueUsed);
+}
+
+/** Discards every queued frame. */
+void messageQueueFlush()
+{
+    queueUsed = 0;
+    queueFrames = 0;
+}
+
+/** @return how many frames were discarded because the queue was full */
+uint16_t messageQueueDropped()
+{
+    return queueDropped;
+}
+
+#endif
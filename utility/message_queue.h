@@ -0,0 +1,42 @@
+/**
+*  @file message_queue.h
+*
+*  @brief  public methods for message_queue.c
+*
+* A fixed-capacity FIFO of complete module frames, stored back to back in the same format as zmBuf:
+* length, command MSB, command LSB, then payload.
+*/
+
+#ifndef MESSAGE_QUEUE_H
+#define MESSAGE_QUEUE_H
+
+#include <stdint.h>
+
+#ifndef __MSP430G2553
+
+/** 
+Number of bytes reserved for queued frames. Each frame uses its length field + 3 bytes. The SRDY 
+interrupt only fetches a frame while there's room for the longest one, so it must be at least 
+ZIGBEE_MODULE_BUFFER_SIZE; the FR5969's 2KB of RAM gets less than the other boards.
+*/
+#ifndef MESSAGE_QUEUE_SIZE
+#if defined(__MSP430FR5969)
+#define MESSAGE_QUEUE_SIZE      320
+#else
+#define MESSAGE_QUEUE_SIZE      512
+#endif
+#endif
+
+uint8_t messageQueuePush(const uint8_t* frame);
+uint8_t* messageQueueTail();
+uint8_t messageQueueCommit();
+uint8_t messageQueuePop(uint8_t* frame, uint16_t frameSize);
+uint8_t messageQueueTake(uint16_t messageType, uint8_t* frame, uint16_t frameSize);
+uint8_t messageQueueCount();
+uint16_t messageQueueFree();
+void messageQueueFlush();
+uint16_t messageQueueDropped();
+
+#endif
+
+#endif
@@ -63,42 +63,111 @@ void moduleInit()
   zm_phy_init();  //this is phy dependent.  
 }
 
-#define METHOD_MODULE_RESET        0x0100
+/** Set by the SRDY interrupt when the Module signals it's ready after a reset */
+static volatile uint8_t resetReady = 0;
+/** micros() when the Module was released from reset, and when it was ready */
+static uint32_t resetStartUs = 0;
+static volatile uint32_t resetReadyUs = 0;
+/** How long the last successful moduleReset() took, in microseconds */
+static uint32_t resetTimeUs = 0;
+
+/** SRDY falling edge while waiting for the Module to boot */
+static void resetReadyInterrupt()
+{
+    if (!resetReady)
+    {
+        resetReadyUs = micros();
+        resetReady = 1;
+    }
+}
+
+#define MODULE_RESET_TIMEOUT_MS         2400      // give up if SRDY hasn't gone low after this long
+#define TEST_SRDY_INTERVAL_MS           1         // check SRDY every 1 mSec, in case there is no interrupt
+#define TEST_SRDY_MINIMUM_TIMEOUT_MS    100       // when polling, SRDY low sooner than this is left over from before the reset
+
 /** 
-Resets the Module using hardware and retrieves the SYS_RESET_IND message. This method is used to 
-restart the Module's internal state machine and apply changes to startup options, zigbee device type, etc.
-@post zmBuf contains the version structure, starting at MODULE_RESET_RESULT_START_FIELD
-@see Interface Specification for order of fields
+Starts a hardware reset of the Module without waiting for it to finish; call moduleResetPoll() until
+it stops returning OPERATION_PENDING. moduleReset() does both.
+@post the SRDY interrupt is attached to catch the Module becoming ready, if the transport uses SRDY.
+Transports that can reset the Module themselves (e.g. UART, with SYS_RESET_REQ) do so as well, so MRST
+needn't be wired for them.
 */
-moduleResult_t moduleReset()
+void moduleResetStart()
 {
+    const struct moduleTransport* transport = moduleGetTransport();
     RADIO_OFF();
+    resetTimeUs = 0;
+    resetReady = 0;
+    if (transport->srdy)
+        attachInterrupt(hal.srdyPin, resetReadyInterrupt, FALLING);
     delayMs(1);
+    resetStartUs = micros();
     RADIO_ON(); 
-#define MODULE_RESET_INITIAL_DELAY_MS   400
-    delayMs(MODULE_RESET_INITIAL_DELAY_MS);                        //Necessary to allow proper module startup
-
-#define TEST_SRDY_INTERVAL_MS           10        // check SRDY every 10 mSec
-#define TEST_SRDY_TIMEOUT_MS            2000      // ...and timeout after 1500mSec
-#define TEST_SRDY_MINIMUM_TIMEOUT_MS    100       // If SRDY transitions less then this than an error.
-    unsigned int elapsedTime = 0;       //now, poll for SRDY going low...
+#ifndef __MSP430G2553
+    moduleFlushMessages();                                         //Anything queued before the reset is stale
+#endif
+    if (transport->resetModule != NULL)
+        transport->resetModule();
+}
 
-    do
+#define METHOD_MODULE_RESET_POLL        0x0101
+/** 
+Checks whether the Module has finished the reset begun by moduleResetStart(), and if so retrieves the 
+SYS_RESET_IND message. Doesn't wait.
+@return OPERATION_PENDING if the Module isn't ready yet, else the same as moduleReset()
+@post if not OPERATION_PENDING, the SRDY interrupt is detached; attach yours again afterwards
+@note without SRDY, the Module is ready when the transport has a frame from it
+*/
+moduleResult_t moduleResetPoll()
+{
+    uint32_t elapsedTime = (micros() - resetStartUs) / 1000;
+    if ((!resetReady) && (elapsedTime >= TEST_SRDY_MINIMUM_TIMEOUT_MS) && (MODULE_HAS_MESSAGE_WAITING()))
     {
-        delayMs(TEST_SRDY_INTERVAL_MS);
-        elapsedTime += TEST_SRDY_INTERVAL_MS;
+        resetReadyUs = micros();
+        resetReady = 1;
     }
-    while ((elapsedTime < TEST_SRDY_TIMEOUT_MS) && (!(MODULE_HAS_MESSAGE_WAITING())));
+    if ((!resetReady) && (elapsedTime < MODULE_RESET_TIMEOUT_MS))
+        return OPERATION_PENDING;
+    if (moduleGetTransport()->srdy)
+        detachInterrupt(hal.srdyPin);
 
-    RETURN_RESULT_IF_EXPRESSION_TRUE(((SRDY_IS_HIGH()) || (elapsedTime < TEST_SRDY_MINIMUM_TIMEOUT_MS)), METHOD_MODULE_RESET, TIMEOUT);
+    RETURN_RESULT_IF_EXPRESSION_TRUE(((!resetReady) || (!MODULE_HAS_MESSAGE_WAITING())), METHOD_MODULE_RESET_POLL, TIMEOUT);
+    resetTimeUs = resetReadyUs - resetStartUs;
 
 #ifdef MODULE_INTERFACE_VERBOSE
-    printf("Module ready in %umS\r\n", elapsedTime + MODULE_RESET_INITIAL_DELAY_MS);
+    printf("Module ready in %luuS\r\n", (unsigned long) resetTimeUs);
 #endif
 
     return (getMessage());
+}
 
+/** 
+Resets the Module using hardware and retrieves the SYS_RESET_IND message. This method is used to 
+restart the Module's internal state machine and apply changes to startup options, zigbee device type, etc.
+The Module is ready when it pulls SRDY low, which is caught by an interrupt; no fixed delay is needed.
+If the SRDY pin can't interrupt, SRDY is also polled every millisecond. Over a transport without 
+SRDY (UART), the Module is ready when its SYS_RESET_IND arrives.
+@post zmBuf contains the version structure, starting at MODULE_RESET_RESULT_START_FIELD
+@post the SRDY interrupt is detached; attach yours again afterwards
+@see Interface Specification for order of fields
+@see moduleResetTime()
+*/
+moduleResult_t moduleReset()
+{
+    moduleResetStart();
+    moduleResult_t resetResult;
+    while ((resetResult = moduleResetPoll()) == OPERATION_PENDING)  //now, wait for SRDY going low...
+        delayMs(TEST_SRDY_INTERVAL_MS);
+    return resetResult;
+}
 
+/** 
+@return how long the Module took from being released from reset until it was ready (SRDY low), in 
+microseconds, for the last moduleReset(); 0 if it failed or there hasn't been one.
+*/
+uint32_t moduleResetTime()
+{
+    return resetTimeUs;
 }
 
 /** 
@@ -219,6 +288,32 @@ moduleResult_t sysSetTxPower(uint8_t txPowerSetting, uint8_t* actualTxPowerSetti
 }
 
 
+/** CONFIGURATION_WRITE_ALWAYS or CONFIGURATION_WRITE_CHANGES */
+static uint8_t configurationWriteMode = CONFIGURATION_WRITE_ALWAYS;
+
+/** How many items zbWriteConfiguration() actually wrote since setConfigurationWriteMode() */
+static uint8_t configurationWrites = 0;
+
+/** 
+Sets whether configuration items are always written, or only when the Module has a different value.
+Reading an item is quicker than writing it (no flash write), and lets startModule() tell whether the 
+Module needs a reset to apply them. Also restarts the getConfigurationWrites() count.
+@param mode CONFIGURATION_WRITE_ALWAYS or CONFIGURATION_WRITE_CHANGES
+*/
+void setConfigurationWriteMode(uint8_t mode)
+{
+    configurationWriteMode = mode;
+    configurationWrites = 0;
+}
+
+/** 
+@return how many configuration items were actually written since setConfigurationWriteMode()
+*/
+uint8_t getConfigurationWrites()
+{
+    return configurationWrites;
+}
+
 //note: no method ID for this one; it should be wrapped by others.
 /** 
 Private utility method to write configuration data to the Module
@@ -227,9 +322,17 @@ Private utility method to write configuration data to the Module
 @param data an array containing the data to write.
 @note All ZB_WRITE_CONFIGURATION commands take approx. 3.5mSec between SREQ & SRSP; presumably to 
 write to flash inside the Module. 
+@note in CONFIGURATION_WRITE_CHANGES mode the item is read first, and not written if it already has this value.
 */
 moduleResult_t zbWriteConfiguration(uint8_t zcd, uint8_t zcdLength, uint8_t* data)
 {
+    if ((configurationWriteMode == CONFIGURATION_WRITE_CHANGES) && 
+        (getConfigurationParameter(zcd) == MODULE_SUCCESS) &&
+        (zmBuf[ZB_READ_CONFIGURATION_START_OF_VALUE_FIELD - 1] == zcdLength) &&
+        (memcmp(zmBuf + ZB_READ_CONFIGURATION_START_OF_VALUE_FIELD, data, zcdLength) == 0))
+        return MODULE_SUCCESS;
+    if (configurationWrites < 0xFF)
+        configurationWrites++;
 #define ZB_WRITE_CONFIGURATION_LEN      2  //excluding payload length
     zmBuf[0] = ZB_WRITE_CONFIGURATION_LEN + zcdLength;
     zmBuf[1] = MSB(ZB_WRITE_CONFIGURATION);
@@ -337,6 +440,71 @@ moduleResult_t zbGetDeviceInfo(uint8_t dip)
 }
 
 
+#define METHOD_UTIL_ADDRMGR_EXT_ADDR_LOOKUP              0x1800
+/** 
+Asks the Module's address manager for the short address of a device, using UTIL_ADDRMGR_EXT_ADDR_LOOKUP.
+Nothing is sent over the air, so this is much faster than zdoNetworkAddressRequest() but only knows
+about devices the Module has already heard from (e.g. children, neighbors, bound devices).
+@param ieeeAddress the 8 byte IEEE address to look up, LSB first
+@param shortAddress where to put the short address if found
+@return MODULE_SUCCESS if found, ADDRESS_NOT_FOUND if the Module doesn't know this device, or an error code
+*/
+moduleResult_t utilAddrMgrExtAddrLookup(const uint8_t* ieeeAddress, uint16_t* shortAddress)
+{
+    RETURN_NULL_PARAMETER_IF_TRUE( ((ieeeAddress == NULL) || (shortAddress == NULL)), METHOD_UTIL_ADDRMGR_EXT_ADDR_LOOKUP);
+    
+#define UTIL_ADDRMGR_EXT_ADDR_LOOKUP_PAYLOAD_LEN 8
+    zmBuf[0] = UTIL_ADDRMGR_EXT_ADDR_LOOKUP_PAYLOAD_LEN;
+    zmBuf[1] = MSB(UTIL_ADDRMGR_EXT_ADDR_LOOKUP);
+    zmBuf[2] = LSB(UTIL_ADDRMGR_EXT_ADDR_LOOKUP);
+    memcpy(zmBuf+3, ieeeAddress, 8);
+    RETURN_RESULT_IF_FAIL(sendMessage(), METHOD_UTIL_ADDRMGR_EXT_ADDR_LOOKUP);
+    
+    uint16_t found = CONVERT_TO_INT(zmBuf[UTIL_ADDRMGR_EXT_ADDR_LOOKUP_SHORT_ADDRESS_FIELD], zmBuf[UTIL_ADDRMGR_EXT_ADDR_LOOKUP_SHORT_ADDRESS_FIELD+1]);
+    if (found >= 0xFFFE)                           // INVALID_NODE_ADDR: not in the address manager
+        return ADDRESS_NOT_FOUND;                   // not an error, so don't call HANDLE_ERROR
+    *shortAddress = found;
+    return MODULE_SUCCESS;
+}
+
+#define METHOD_UTIL_ADDRMGR_NWK_ADDR_LOOKUP              0x1900
+/** 
+Asks the Module's address manager for the IEEE address of a device, using UTIL_ADDRMGR_NWK_ADDR_LOOKUP.
+Nothing is sent over the air, so this is much faster than zdoRequestIeeeAddress() but only knows
+about devices the Module has already heard from.
+@param shortAddress the short address to look up
+@param ieeeAddress where to put the 8 byte IEEE address, LSB first, if found
+@return MODULE_SUCCESS if found, ADDRESS_NOT_FOUND if the Module doesn't know this device, or an error code
+*/
+moduleResult_t utilAddrMgrNwkAddrLookup(uint16_t shortAddress, uint8_t* ieeeAddress)
+{
+    RETURN_NULL_PARAMETER_IF_TRUE( (ieeeAddress == NULL), METHOD_UTIL_ADDRMGR_NWK_ADDR_LOOKUP);
+    
+#define UTIL_ADDRMGR_NWK_ADDR_LOOKUP_PAYLOAD_LEN 2
+    zmBuf[0] = UTIL_ADDRMGR_NWK_ADDR_LOOKUP_PAYLOAD_LEN;
+    zmBuf[1] = MSB(UTIL_ADDRMGR_NWK_ADDR_LOOKUP);
+    zmBuf[2] = LSB(UTIL_ADDRMGR_NWK_ADDR_LOOKUP);
+    zmBuf[3] = LSB(shortAddress);
+    zmBuf[4] = MSB(shortAddress);
+    RETURN_RESULT_IF_FAIL(sendMessage(), METHOD_UTIL_ADDRMGR_NWK_ADDR_LOOKUP);
+    
+    /* An unknown device comes back as all zeros or all ones */
+    uint8_t allZeros = 1;
+    uint8_t allOnes = 1;
+    uint8_t i;
+    for (i = 0; i < 8; i++)
+    {
+        uint8_t b = zmBuf[UTIL_ADDRMGR_NWK_ADDR_LOOKUP_IEEE_ADDRESS_FIELD + i];
+        if (b != 0x00) allZeros = 0;
+        if (b != 0xFF) allOnes = 0;
+    }
+    if (allZeros || allOnes)
+        return ADDRESS_NOT_FOUND;                   // not an error, so don't call HANDLE_ERROR
+    memcpy(ieeeAddress, zmBuf + UTIL_ADDRMGR_NWK_ADDR_LOOKUP_IEEE_ADDRESS_FIELD, 8);
+    return MODULE_SUCCESS;
+}
+
+
 /*
 *               NON-VOLATILE (NV) MEMORY ITEMS
 */
@@ -575,14 +743,16 @@ moduleResult_t setCallbacks(uint8_t cb)
 //
 #define METHOD_WAIT_FOR_MESSAGE                    0x0F00
 /** 
-Waits for the specified type of message. Ignores any other messages received. The received message 
-will be in zmBuf[]. If the specified type of message isn't received by timeout then a TIMEOUT error
-will be returned.
+Waits for the specified type of message. Any other messages received in the meantime are put in the 
+receive queue, so the next getMessage() (e.g. from ZigBee.receive()) gets them in the order they 
+arrived. The received message will be in zmBuf[]. If the specified type of message isn't received by
+timeout then a TIMEOUT error will be returned.
 @param messageType the type of message that you are waiting for. Once this message type is received
 the method will return with a status of SUCCESS.
 @param timeoutSecs how many seconds to wait for the desired message type 
-@note If you need to receive messages in the meantime then return control to application instead.
-This is enabled by compile options in the various files. For example, in afSendData, define 
+@note On the MSP430G2553 there is no receive queue and other messages are ignored. If you need to 
+receive messages in the meantime then return control to application instead. This is enabled by 
+compile options in the various files. For example, in afSendData, define 
 AF_DATA_CONFIRM_HANDLED_BY_APPLICATION.
 */
 moduleResult_t waitForMessage(uint16_t messageType, uint8_t timeoutSecs)
@@ -596,9 +766,17 @@ moduleResult_t waitForMessage(uint16_t messageType, uint8_t timeoutSecs)
     //for (int i=0; i<intervals; i++)
      while (intervals--)
     {
+#ifndef __MSP430G2553
+        if (moduleTakeMessage(messageType))                      // The SRDY interrupt may have queued it already
+            return MODULE_SUCCESS;
+        while (MODULE_HAS_MESSAGE_WAITING())                     // Read directly so queued messages stay queued
+        {
+            fetchMessage();
+#else
         if (moduleHasMessageWaiting())                           // If there's a message waiting for us
         {
           getMessage();
+#endif
           
             if (zmBuf[SRSP_LENGTH_FIELD] > 0)
             {
@@ -609,10 +787,13 @@ moduleResult_t waitForMessage(uint16_t messageType, uint8_t timeoutSecs)
                     printf("Received expected message %04X\r\n", messageType);
 #endif
                     return MODULE_SUCCESS;
-                } else {                                            //not what we wanted; ignore
+                } else {                                            //not what we wanted; keep it for later
 #ifdef ZM_INTERFACE_VERBOSE
                     printf("Received message %04X\r\n", rcvMsgType);
 #endif 
+#ifndef __MSP430G2553
+                    moduleStashMessage();
+#endif
                 }
             }
         }
@@ -46,6 +46,9 @@
 
 // RESET and SYS_RESET_IND
 moduleResult_t moduleReset();
+void moduleResetStart();
+moduleResult_t moduleResetPoll();
+uint32_t moduleResetTime();
 char* getResetReason(uint8_t reason);
 void displaySysResetInd();
 void moduleInit();
@@ -154,6 +157,14 @@ moduleResult_t setPanId(uint16_t panId);
 #define MAX_PANID                       0xFFF7
 #define IS_VALID_PANID(id)              (id<=MAX_PANID)
 
+//
+//  Address Manager: what the Module already knows about other devices
+//
+moduleResult_t utilAddrMgrExtAddrLookup(const uint8_t* ieeeAddress, uint16_t* shortAddress);
+moduleResult_t utilAddrMgrNwkAddrLookup(uint16_t shortAddress, uint8_t* ieeeAddress);
+#define UTIL_ADDRMGR_EXT_ADDR_LOOKUP_SHORT_ADDRESS_FIELD        (SRSP_PAYLOAD_START)
+#define UTIL_ADDRMGR_NWK_ADDR_LOOKUP_IEEE_ADDRESS_FIELD         (SRSP_PAYLOAD_START)
+
 //
 //  Device Information Properties
 //
@@ -204,6 +215,10 @@ char* getDeviceStateName(uint8_t state);
 //
 moduleResult_t getConfigurationParameter(uint8_t configId);
 #define ZB_READ_CONFIGURATION_START_OF_VALUE_FIELD    SRSP_PAYLOAD_START + 3
+void setConfigurationWriteMode(uint8_t mode);
+uint8_t getConfigurationWrites();
+#define CONFIGURATION_WRITE_ALWAYS      0   // every set...() writes its item
+#define CONFIGURATION_WRITE_CHANGES     1   // set...() reads the item first and only writes it if it is different
 moduleResult_t displayNetworkConfigurationParameters();
 //General
 #define ZCD_NV_USERDESC                 0x81
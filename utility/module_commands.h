@@ -55,6 +55,7 @@
 
 #define SYS_NV_READ                     0x2108
 #define SYS_NV_WRITE                    0x2109
+#define SYS_RESET_REQ                   0x4100
 #define SYS_RESET_IND                   0x4180
 #define SYS_STACK_TUNE                  0x210F
 #define SYS_SET_TX_POWER                0x2114
@@ -110,6 +111,7 @@
 #define ZDO_LEAVE_IND        		0x45C9 //will receive this asynchronously
 
 // UTIL commands:
+#define UTIL_ADDRMGR_EXT_ADDR_LOOKUP    0x2740
 #define UTIL_ADDRMGR_NWK_ADDR_LOOKUP    0x2741
 
 // Other commands:
@@ -68,6 +68,16 @@ char* getErrorName(moduleResult_t err)
         return ("ZM_INVALID_MODULE_CONFIGURATION");
     case ZM_PHY_OTHER_ERROR:
         return ("ZM_PHY_OTHER_ERROR");   
+    case AF_SEND_PENDING:
+        return ("AF_SEND_PENDING");
+    case AF_SEND_UNKNOWN:
+        return ("AF_SEND_UNKNOWN");
+    case ADDRESS_NOT_FOUND:
+        return ("ADDRESS_NOT_FOUND");
+    case AF_DATA_SOURCE_EMPTY:
+        return ("AF_DATA_SOURCE_EMPTY");
+    case OPERATION_PENDING:
+        return ("OPERATION_PENDING");
     default:
         return ("Other Error");
     }
@@ -280,6 +280,16 @@ doesn't do anything.
 /** An error occured that doesn't fit into one of the other categories
 @see Module physical interface files (e.g. zm_phy_spi.c) for more information*/
 #define ZM_PHY_OTHER_ERROR              (0x3B)
+/** An asynchronous send is still waiting for its AF_DATA_CONFIRM. @see afSendDataAsync() in af.c */
+#define AF_SEND_PENDING                 (0x3C)
+/** There is no record of that asynchronous send, e.g. its result was already read or overwritten. */
+#define AF_SEND_UNKNOWN                 (0x3D)
+/** The Module's address manager doesn't know that device. @see utilAddrMgrExtAddrLookup() in module.c */
+#define ADDRESS_NOT_FOUND               (0x3E)
+/** A streamed message's data source stopped supplying bytes. @see afSendDataStream() in af.c */
+#define AF_DATA_SOURCE_EMPTY            (0x3F)
+/** A non-blocking operation hasn't finished yet; poll it again. @see moduleResetPoll() in module.c */
+#define OPERATION_PENDING               (0x40)
 
 
 
@@ -40,7 +40,9 @@
 #include "zm_phy_spi.h"
 #include "utilities.h"
 #include "application_configuration.h"
+#include "timer_wheel.h"
 #include <stddef.h>
+#include <string.h>                     //for memcmp
 
 extern unsigned char zmBuf[ZIGBEE_MODULE_BUFFER_SIZE];
 
@@ -80,11 +82,13 @@ SECURITY_MODE_OFF,
 NULL
 };
 
-uint8_t appCount;
+/** How many applicationConfigurations (endpoints) startModule() registers, from the one it is given */
+uint8_t appCount = 1;
 
 /** 
 How often in milliseconds to check whether the module has a state change method. This is just
-reading a GPIO, not actually communicating with the module (unless indeed a message is waiting. */
+reading a GPIO (SPI) or the serial port's receive buffer (UART), not actually communicating with the 
+module (unless indeed a message is waiting). */
 #define WFDS_POLL_INTERVAL_MS   100
 
 #define METHOD_WAIT_FOR_DEVICE_STATE              0x6000
@@ -96,7 +100,7 @@ Else loops until timeout.
 @param expectedState the deviceState we are expecting - DEV_ZB_COORD etc.
 @param timeoutMs the amount of milliseconds to wait before returning an error. Should be an integer
 multiple of WFDS_POLL_INTERVAL_MS.
-@todo modify this if using UART.
+@note works with any transport: moduleHasMessageWaiting() and getMessage() go through it.
 */
 static moduleResult_t waitForDeviceState(unsigned char expectedState, uint16_t timeoutMs)
 {
@@ -249,32 +253,86 @@ static moduleResult_t setModuleRfPower(uint8_t productId, uint16_t moduleRegion)
 }
 
 
-#define METHOD_EXPRESS_START_MODULE              0x6300
+/** 
+Which setConfigurationWriteMode() to start with. STARTOPT_CLEAR_CONFIG sets every item back to its default
+on the reset, so they all need writing; otherwise the Module still has what we wrote last time, and 
+reading an item is quicker than writing it again.
+*/
+#define STARTUP_CONFIGURATION_WRITE_MODE(mc)   (((mc)->startupOptions & STARTOPT_CLEAR_CONFIG) ? CONFIGURATION_WRITE_ALWAYS : CONFIGURATION_WRITE_CHANGES)
+
+/** The applications last registered by registerApplications(), for moduleRecover() */
+static const struct applicationConfiguration* registeredApplications = GENERIC_APPLICATION_CONFIGURATION;
+
+#define METHOD_REGISTER_APPLICATIONS              0x6400
 /**
-Starts module using an operating region as a parameter. This does NOT read the GPIO pin to set the region.
-@param mc the module configuration - what RF channel, which PAN ID, etc. These options are used in
-this expressStartModule function as arguments to the various functions.
-@param ac the Zigbee application configuration - which endpoint to use and other global settings. 
-If not using GENERIC_APPLICATION_CONFIGURATION then you must #define the compilation option 
-SUPPORT_CUSTOM_APPLICATION_CONFIGURATION. Normally this option is NOT defined to reduce code size.
-@param moduleRegion - which region of the world to use to ensure FCC/ETSI compliance.
+Registers our endpoints with the module: the generic one, or appCount applicationConfigurations.
+@param ac the first of appCount application configurations, or GENERIC_APPLICATION_CONFIGURATION
+@return MODULE_SUCCESS, or an error code if any endpoint couldn't be registered
 */
-moduleResult_t expressStartModule(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac)
+static moduleResult_t registerApplications(const struct applicationConfiguration* ac)
+{
+    registeredApplications = ac;
+    if (ac == GENERIC_APPLICATION_CONFIGURATION)
+    {
+        RETURN_RESULT(afRegisterGenericApplication(), METHOD_REGISTER_APPLICATIONS);
+    }
+#ifdef __MSP430G2553
+    RETURN_RESULT(afRegisterApplication(ac), METHOD_REGISTER_APPLICATIONS);
+#else
+    uint8_t i;
+    for (i = 0; i < appCount || i == 0; i++)    // always at least one
+    {
+        RETURN_RESULT_IF_FAIL(afRegisterApplication(ac+i), METHOD_REGISTER_APPLICATIONS);
+    }
+    return MODULE_SUCCESS;
+#endif
+}
+
+/**
+Gets the Module going again after it stopped answering: resets it, registers the applications from
+the last startup again and restarts the ZigBee application, which rejoins the network from the state
+the Module kept. startModule() sets this as the recovery handler for sendMessage(); call it from 
+your own handler if you set one.
+@return the last step of the recovery ladder tried: RECOVERY_MODULE_RESET if the reset failed, else 
+RECOVERY_APPLICATIONS
+@post the SRDY interrupt is detached; attach yours again afterwards
+*/
+uint8_t moduleRecover()
+{
+    printf("Recovering Module\r\n");
+    if (moduleReset() != MODULE_SUCCESS)
+        return RECOVERY_MODULE_RESET;
+    if (registerApplications(registeredApplications) == MODULE_SUCCESS)
+        zdoStartApplication();
+    return RECOVERY_APPLICATIONS;
+}
+
+#define METHOD_EXPRESS_START_MODULE              0x6300
+/** Private method that does the work of expressStartModule(), which puts the configuration write mode back */
+static moduleResult_t expressStartModuleSteps(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac)
 {
     printf("Express Startup ");
+    moduleSetRecoveryHandler(NULL);                 // nothing to recover until we've started
     
     /* Initialize the Module */
     RETURN_RESULT_IF_FAIL(moduleReset(), METHOD_EXPRESS_START_MODULE);
     
+    /* Read the productId - this indicates the model of module used. */
+    uint8_t productId = zmBuf[SYS_RESET_IND_PRODUCTID_FIELD]; 
+    
+    /* Unless the configuration is being cleared, only write the items that are different */
+    setConfigurationWriteMode(STARTUP_CONFIGURATION_WRITE_MODE(mc));
+    
     /* Clear out any old network or state information (if requested) */
     printf("Startup Options 0x%02X\r\n", mc->startupOptions);
     RETURN_RESULT_IF_FAIL(setStartupOptions(mc->startupOptions), METHOD_EXPRESS_START_MODULE);
 
-    /* Reset the Module to apply the changes we just set */
-    RETURN_RESULT_IF_FAIL(moduleReset(), METHOD_EXPRESS_START_MODULE);
-    
-    /* Read the productId - this indicates the model of module used. */
-    uint8_t productId = zmBuf[SYS_RESET_IND_PRODUCTID_FIELD]; 
+    /* Reset the Module to apply the changes we just set, if there were any */
+    if (getConfigurationWrites() > 0)
+    {
+        RETURN_RESULT_IF_FAIL(moduleReset(), METHOD_EXPRESS_START_MODULE);
+        productId = zmBuf[SYS_RESET_IND_PRODUCTID_FIELD];
+    }
     
     /* If this is not valid (bad firmware) then stop */
     RETURN_RESULT_IF_EXPRESSION_TRUE((productId < MINIMUM_BUILD_ID), METHOD_EXPRESS_START_MODULE, ZM_INVALID_MODULE_CONFIGURATION); 
@@ -304,28 +362,12 @@ moduleResult_t expressStartModule(const struct moduleConfiguration* mc, const st
     	RETURN_RESULT_IF_FAIL(setSecurityKey(mc->securityKey), METHOD_EXPRESS_START_MODULE);
     }
 
-#ifdef SUPPORT_CUSTOM_APPLICATION_CONFIGURATION    
-    if (ac == GENERIC_APPLICATION_CONFIGURATION)
-    {
-    RETURN_RESULT_IF_FAIL(afRegisterGenericApplication(), METHOD_EXPRESS_START_MODULE);    // Configure the Module for our application
-    } else {
-    RETURN_RESULT_IF_FAIL(afRegisterApplication(ac), METHOD_EXPRESS_START_MODULE);
-    }
-#else    
-    if (ac == GENERIC_APPLICATION_CONFIGURATION)
-    {
-    RETURN_RESULT_IF_FAIL(afRegisterGenericApplication(), METHOD_EXPRESS_START_MODULE);    // Configure the Module for our application
-    } else {
-        /* Note: to use a custom application configuration, you must #define SUPPORT_CUSTOM_APPLICATION_CONFIGURATION. */
-    return INVALID_PARAMETER;
-    }    
-#endif
-    
-    /* Note: you can register more than one Zigbee endpoint; just call afRegisterApplication() here
-    for the next endpoint */
+    /* Register each Zigbee endpoint */
+    RETURN_RESULT_IF_FAIL(registerApplications(ac), METHOD_EXPRESS_START_MODULE);
     
     /* Start the module with the registered application configuration */
     RETURN_RESULT_IF_FAIL(zdoStartApplication(), METHOD_EXPRESS_START_MODULE);
+    moduleSetRecoveryHandler(moduleRecover);
 
 	  /* Wait until this device has joined a network. Device State will change to DEV_ROUTER,
       DEV_END_DEVICE, or DEV_COORD to indicate that the device has correctly joined a network. */
@@ -339,20 +381,33 @@ moduleResult_t expressStartModule(const struct moduleConfiguration* mc, const st
 	#endif
 }
 
-#define METHOD_START_MODULE              0x6100
 /**
-Start the Module and join a network, using the AF/ZDO interface. Reads RF Operating Region (US/EU) from GPIO.
-@param moduleConfiguration the settings to use to start the module
-@param applicationConfiguration the settings to use to start the Zigbee Application
-@see struct moduleConfiguration in module_utilities.h for information about each field of the moduleConfiguration
-@see struct applicationConfiguration in application_configuration.h for information about each field of the applicationConfiguration
-@see module.c for more information about each of these steps.
+Starts module using an operating region as a parameter. This does NOT read the GPIO pin to set the region.
+@param mc the module configuration - what RF channel, which PAN ID, etc. These options are used in
+this expressStartModule function as arguments to the various functions.
+@param ac the Zigbee application configuration - which endpoint to use and other global settings; 
+the first of appCount of them, or GENERIC_APPLICATION_CONFIGURATION.
+@param moduleRegion - which region of the world to use to ensure FCC/ETSI compliance.
 */
-moduleResult_t startModule(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac)
+moduleResult_t expressStartModule(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac)
+{
+    moduleResult_t result = expressStartModuleSteps(mc, ac);
+    setConfigurationWriteMode(CONFIGURATION_WRITE_ALWAYS);        // a set...() from the application writes its item
+    return result;
+}
+
+#define METHOD_START_MODULE              0x6100
+/** Private method that does the work of startModule(), which puts the configuration write mode back */
+static moduleResult_t startModuleSteps(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac)
 {
 	printf("Module Startup");
+    moduleSetRecoveryHandler(NULL);                 // nothing to recover until we've started
     /* Initialize the Module */
     RETURN_RESULT_IF_FAIL(moduleReset(), METHOD_START_MODULE);
+    /* Read the productId - this indicates the model of module used. */
+    uint8_t productId = zmBuf[SYS_RESET_IND_PRODUCTID_FIELD]; 
+    /* Unless the configuration is being cleared, only write the items that are different */
+    setConfigurationWriteMode(STARTUP_CONFIGURATION_WRITE_MODE(mc));
     /* Clear out any old network or state information (if requested) */
     RETURN_RESULT_IF_FAIL(setStartupOptions(mc->startupOptions), METHOD_START_MODULE);   
 
@@ -367,10 +422,12 @@ moduleResult_t startModule(const struct moduleConfiguration* mc, const struct ap
  
 /*** Done reading GPIO inputs. If application needs them as outputs then configure accordingly ***/
     
-    /* Reset the Module to apply the changes we just set */
-    RETURN_RESULT_IF_FAIL(moduleReset(), METHOD_START_MODULE);
-    /* Read the productId - this indicates the model of module used. */
-    uint8_t productId = zmBuf[SYS_RESET_IND_PRODUCTID_FIELD]; 
+    /* Reset the Module to apply the changes we just set, if there were any */
+    if (getConfigurationWrites() > 0)
+    {
+        RETURN_RESULT_IF_FAIL(moduleReset(), METHOD_START_MODULE);
+        productId = zmBuf[SYS_RESET_IND_PRODUCTID_FIELD];
+    }
     /* If this is not valid (bad firmware) then stop */
     RETURN_RESULT_IF_EXPRESSION_TRUE((productId < MINIMUM_BUILD_ID), METHOD_START_MODULE,
                                      ZM_INVALID_MODULE_CONFIGURATION);       
@@ -393,18 +450,9 @@ moduleResult_t startModule(const struct moduleConfiguration* mc, const struct ap
 	      RETURN_RESULT_IF_FAIL(setSecurityKey(mc->securityKey), METHOD_START_MODULE);
 	  }
  
-	  if (ac == GENERIC_APPLICATION_CONFIGURATION)	  //TODO: use custom applicationFramework if this isn't null:
-	  {
-	    RETURN_RESULT_IF_FAIL(afRegisterGenericApplication(), METHOD_START_MODULE);    // Configure the Module for our application
-	  } else {
-#ifdef __MSP430G2553
-	    RETURN_RESULT_IF_FAIL(afRegisterApplication(ac), METHOD_START_MODULE);    // Configure the Module for our application
-#else
-		for(int i=0;i<appCount;i++)
-			RETURN_RESULT_IF_FAIL(afRegisterApplication(ac+i), METHOD_START_MODULE);    // Configure the Module for our application
-#endif
-		}
+	  RETURN_RESULT_IF_FAIL(registerApplications(ac), METHOD_START_MODULE);    // Configure the Module for our application(s)
 	  RETURN_RESULT_IF_FAIL(zdoStartApplication(), METHOD_START_MODULE);		// Start your engines
+	  moduleSetRecoveryHandler(moduleRecover);
 
 	  /* Wait until this device has joined a network. Device State will change to DEV_ROUTER,
       DEV_END_DEVICE, or DEV_COORD to indicate that the device has correctly joined a network. */
@@ -420,6 +468,359 @@ moduleResult_t startModule(const struct moduleConfiguration* mc, const struct ap
 
 }
 
+/**
+Start the Module and join a network, using the AF/ZDO interface. Reads RF Operating Region (US/EU) from GPIO.
+@param moduleConfiguration the settings to use to start the module
+@param applicationConfiguration the settings to use to start the Zigbee Application; the first of appCount of them
+@see struct moduleConfiguration in module_utilities.h for information about each field of the moduleConfiguration
+@see struct applicationConfiguration in application_configuration.h for information about each field of the applicationConfiguration
+@see module.c for more information about each of these steps.
+*/
+moduleResult_t startModule(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac)
+{
+    moduleResult_t result = startModuleSteps(mc, ac);
+    setConfigurationWriteMode(CONFIGURATION_WRITE_ALWAYS);        // a set...() from the application writes its item
+    return result;
+}
+
+
+#ifndef __MSP430G2553
+/** How long startModulePoll() waits for the device state before giving up */
+#define START_ASYNC_TIMEOUT_MS          15000
+
+/** How many configuration items startModulePoll() writes, one per call. @see configureItem() */
+#define START_CONFIGURATION_ITEMS       7
+
+/** 
+The startup begun by startModuleAsync(); all zero (START_STEP_IDLE) before that. The configurations 
+are not copied, so they must stay put.
+*/
+static struct
+{
+    const struct moduleConfiguration* mc;
+    const struct applicationConfiguration* ac;
+    uint8_t step;                       // START_STEP_IDLE etc.
+    uint8_t item;                       // which configuration item or application is next
+    uint8_t productId;                  // from the SYS_RESET_IND
+    moduleResult_t result;              // of the whole startup, once it has finished
+    uint8_t timedOut;                   // set when timeout expires
+    struct timer timeout;               // how long to wait for the device state
+} startup;
+
+/** We've waited START_ASYNC_TIMEOUT_MS for the device state */
+static void startupTimeout(void* context)
+{
+    startup.timedOut = 1;
+}
+
+/**
+Private method that writes one of the configuration items that startModule() writes after the reset.
+Items that don't apply to this configuration are skipped.
+@param item 0 to START_CONFIGURATION_ITEMS-1
+*/
+static moduleResult_t configureItem(const struct moduleConfiguration* mc, uint8_t item, uint8_t productId)
+{
+    switch (item)
+    {
+    case 0:
+        setModuleRfPower(productId, mc->operatingRegion);
+        return MODULE_SUCCESS;
+    case 1:
+        return ((mc->deviceType == END_DEVICE) ? setPollRate(mc->endDevicePollRate) : MODULE_SUCCESS);
+    case 2:
+        return setZigbeeDeviceType(mc->deviceType);
+    case 3:
+        return setChannelMask(mc->channelMask);
+    case 4:
+        return setPanId(mc->panId);
+    case 5:
+        return setCallbacks(CALLBACKS_ENABLED);
+    default:
+        if (mc->securityMode == SECURITY_MODE_OFF)
+            return MODULE_SUCCESS;
+        moduleResult = setSecurityMode(mc->securityMode);
+        return ((moduleResult == MODULE_SUCCESS) ? setSecurityKey(mc->securityKey) : moduleResult);
+    }
+}
+
+#define METHOD_START_MODULE_POLL              0x6600
+/**
+Private method that does the next piece of the startup: checks whether the Module is back from a reset,
+writes one configuration item, registers one application, or checks for the device state.
+@return MODULE_SUCCESS if it moved the startup on, OPERATION_PENDING if it's still waiting for the 
+Module, or an error code
+*/
+static moduleResult_t startupStep()
+{
+    uint8_t state;
+    switch (startup.step)
+    {
+    case START_STEP_RESET:
+    case START_STEP_APPLY_RESET:
+        moduleResult = moduleResetPoll();
+        if (moduleResult != MODULE_SUCCESS)                                 // still booting, or the reset failed
+            return moduleResult;
+        startup.productId = zmBuf[SYS_RESET_IND_PRODUCTID_FIELD];
+        if (startup.step == START_STEP_RESET)
+        {
+            /* Unless the configuration is being cleared, only write the items that are different */
+            setConfigurationWriteMode(STARTUP_CONFIGURATION_WRITE_MODE(startup.mc));
+            startup.step = START_STEP_STARTUP_OPTIONS;
+            return MODULE_SUCCESS;
+        }
+        break;
+
+    case START_STEP_STARTUP_OPTIONS:
+        RETURN_RESULT_IF_FAIL(setStartupOptions(startup.mc->startupOptions), METHOD_START_MODULE_POLL);
+        RETURN_RESULT_IF_FAIL(sysGpio(GPIO_SET_DIRECTION , (GPIO_0 | GPIO_1)), METHOD_START_MODULE_POLL);
+        if (getConfigurationWrites() > 0)                                   // reset to apply them
+        {
+            moduleResetStart();
+            startup.step = START_STEP_APPLY_RESET;
+            return MODULE_SUCCESS;
+        }
+        break;
+
+    case START_STEP_CONFIGURE:
+        RETURN_RESULT_IF_FAIL(configureItem(startup.mc, startup.item, startup.productId), METHOD_START_MODULE_POLL);
+        if (++startup.item == START_CONFIGURATION_ITEMS)
+        {
+            startup.step = START_STEP_REGISTER;
+            startup.item = 0;
+        }
+        return MODULE_SUCCESS;
+
+    case START_STEP_REGISTER:
+        registeredApplications = startup.ac;
+        if (startup.ac == GENERIC_APPLICATION_CONFIGURATION)
+        {
+            RETURN_RESULT_IF_FAIL(afRegisterGenericApplication(), METHOD_START_MODULE_POLL);
+            startup.step = START_STEP_START_APPLICATION;
+            return MODULE_SUCCESS;
+        }
+        RETURN_RESULT_IF_FAIL(afRegisterApplication(startup.ac + startup.item), METHOD_START_MODULE_POLL);
+        if (++startup.item >= appCount)                                     // always at least one
+            startup.step = START_STEP_START_APPLICATION;
+        return MODULE_SUCCESS;
+
+    case START_STEP_START_APPLICATION:
+        RETURN_RESULT_IF_FAIL(zdoStartApplication(), METHOD_START_MODULE_POLL);
+        moduleSetRecoveryHandler(moduleRecover);
+#ifdef ZDO_STATE_CHANGE_IND_HANDLED_BY_APPLICATION  //if you're handling this in your application instead...
+        startup.step = START_STEP_DONE;
+#else
+        startup.timedOut = 0;
+        timerStart(&startup.timeout, START_ASYNC_TIMEOUT_MS, startupTimeout, NULL);
+        startup.step = START_STEP_WAIT_FOR_STATE;
+#endif
+        return MODULE_SUCCESS;
+
+    case START_STEP_WAIT_FOR_STATE:
+        /* Like waitForMessage(): the SRDY interrupt may have queued the state change already, and anything 
+        else read directly from the Module is queued again for the application */
+        for (;;)
+        {
+            if (!moduleTakeMessage(ZDO_STATE_CHANGE_IND))
+            {
+                if (!MODULE_HAS_MESSAGE_WAITING())
+                    break;
+                fetchMessage();
+                if (CONVERT_TO_INT(zmBuf[2], zmBuf[1]) != ZDO_STATE_CHANGE_IND)
+                {
+                    if (zmBuf[SRSP_LENGTH_FIELD] > 0)
+                        moduleStashMessage();                               // not what we wanted; keep it for later
+                    continue;
+                }
+            }
+            state = zmBuf[SRSP_PAYLOAD_START];
+            printf("%s, ", getDeviceStateName(state));
+            if (state == getDeviceStateForDeviceType(startup.mc->deviceType))
+            {
+                timerStop(&startup.timeout);
+                startup.step = START_STEP_DONE;
+                return MODULE_SUCCESS;
+            }
+        }
+        RETURN_RESULT_IF_EXPRESSION_TRUE(startup.timedOut, METHOD_START_MODULE_POLL, TIMEOUT);
+        return OPERATION_PENDING;
+
+    default:
+        return startup.result;
+    }
+
+    /* Back from the last reset, so configure the Module - if the firmware is any good */
+    RETURN_RESULT_IF_EXPRESSION_TRUE((startup.productId < MINIMUM_BUILD_ID), METHOD_START_MODULE_POLL,
+                                     ZM_INVALID_MODULE_CONFIGURATION);
+    startup.step = START_STEP_CONFIGURE;
+    startup.item = 0;
+    return MODULE_SUCCESS;
+}
+
+#define METHOD_START_MODULE_ASYNC              0x6500
+/**
+Starts the Module and joins a network like startModule(), but without blocking: this only resets the 
+Module, and each call to startModulePoll() then does the next step. Use startModuleProgress() to see
+how far it has got.
+@param mc the settings to use to start the module
+@param ac the first of appCount application configurations, or GENERIC_APPLICATION_CONFIGURATION
+@note mc and ac are used until the startup has finished, so don't change them or let them go out of scope.
+@return MODULE_SUCCESS if the startup has begun, else an error code
+*/
+moduleResult_t startModuleAsync(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac)
+{
+    RETURN_NULL_PARAMETER_IF_TRUE((mc == NULL), METHOD_START_MODULE_ASYNC);
+    RETURN_INVALID_PARAMETER_IF_TRUE((getDeviceStateForDeviceType(mc->deviceType) == INVALID_DEVICETYPE), METHOD_START_MODULE_ASYNC);
+    printf("Module Startup");
+    moduleSetRecoveryHandler(NULL);                 // nothing to recover until we've started
+    startup.mc = mc;
+    startup.ac = ac;
+    startup.item = 0;
+    startup.result = OPERATION_PENDING;
+    startup.step = START_STEP_RESET;
+    timerStop(&startup.timeout);
+    moduleResetStart();
+    return MODULE_SUCCESS;
+}
+
+/**
+Does the next step of the startup begun by startModuleAsync(). Doesn't wait for the Module, so call it 
+often, e.g. every time through loop().
+@return OPERATION_PENDING until the startup has finished, then MODULE_SUCCESS if the device is on the 
+network or the error that stopped it. Returns that result again until startModuleAsync() is called.
+*/
+moduleResult_t startModulePoll()
+{
+    if ((startup.step == START_STEP_IDLE) || (startup.step >= START_STEP_DONE))
+        return startup.result;
+
+    timerService(millis());
+    moduleResult_t stepResult = startupStep();
+    if (stepResult == OPERATION_PENDING)
+        return OPERATION_PENDING;
+    if (stepResult != MODULE_SUCCESS)
+    {
+        timerStop(&startup.timeout);
+        startup.step = START_STEP_FAILED;
+        startup.result = stepResult;
+    }
+    else if (startup.step == START_STEP_DONE)
+        startup.result = MODULE_SUCCESS;
+    if (startup.step >= START_STEP_DONE)                                    // finished, either way
+        setConfigurationWriteMode(CONFIGURATION_WRITE_ALWAYS);
+    return startup.result;
+}
+
+/**
+@return how far the startup begun by startModuleAsync() has got: START_STEP_RESET to START_STEP_DONE, 
+START_STEP_FAILED, or START_STEP_IDLE if none has been begun.
+*/
+uint8_t startModuleProgress()
+{
+    return startup.step;
+}
+
+/** How many SYS_VERSION/SYS_RANDOM pairs moduleCalibrateSpi() sends at each SPI clock */
+#define SPI_CALIBRATION_ROUND_TRIPS     8
+/** A SPI clock is given up on after this many failed round trips */
+#define SPI_CALIBRATION_MAX_ERRORS      2
+
+/** The SYS_VERSION SRSP at the default SPI clock; every one after it must match */
+static uint8_t spiReferenceVersion[SYS_VERSION_RESULT_FW_BUILD_FIELD + 1];
+
+/** Round trips that failed in the last moduleCalibrateSpi(), and the first divider that failed */
+static uint16_t spiCalibrationErrors = 0;
+static uint8_t spiFailedDivider = 0;
+
+/**
+Private method that checks the SPI clock in use with SYS_VERSION and SYS_RANDOM round trips. A round 
+trip fails if the SREQ fails, the SYS_VERSION differs from spiReferenceVersion, or the SYS_RANDOM 
+isn't two bytes long.
+@return how many round trips failed; stops at SPI_CALIBRATION_MAX_ERRORS
+*/
+static uint8_t spiRoundTrips()
+{
+    uint8_t errors = 0;
+    uint8_t i;
+    for (i = 0; (i < SPI_CALIBRATION_ROUND_TRIPS) && (errors < SPI_CALIBRATION_MAX_ERRORS); i++)
+    {
+        if ((sysVersion() != MODULE_SUCCESS) || (memcmp(zmBuf, spiReferenceVersion, sizeof(spiReferenceVersion)) != 0))
+            errors++;
+        else if ((sysRandom() != MODULE_SUCCESS) || (zmBuf[SRSP_LENGTH_FIELD] != 2))
+            errors++;
+    }
+    return errors;
+}
+
+#define METHOD_MODULE_CALIBRATE_SPI              0x6700
+/**
+Finds how fast the SPI port can run with this Module and board. Starting at the board's default 
+divider, the clock is doubled for as long as every round trip at it succeeds; then it is set one step 
+slower than the fastest that worked, for margin, but never slower than the default. That rate is 
+checked again, and the default used if it fails. The result is printed and kept over halSpiReset().
+@pre the Module is started, e.g. by startModule(), and no recovery handler is set: a round trip failing 
+at too fast a clock isn't a reason to reset the Module
+@return MODULE_SUCCESS, or the error from the SYS_VERSION at the default clock. Does nothing if the 
+Module isn't on SPI or hal.spiClockDivider is set.
+@see moduleSpiCalibrationErrors(), halSpiClockHz()
+*/
+moduleResult_t moduleCalibrateSpi()
+{
+    spiCalibrationErrors = 0;
+    spiFailedDivider = 0;
+    if ((moduleGetTransport() != &spiTransport) || (hal.spiClockDivider != 0))
+        return MODULE_SUCCESS;
+    halSpiSetClockDivider(0);
+    uint8_t defaultDivider = halSpiGetClockDivider();
+    RETURN_RESULT_IF_FAIL(sysVersion(), METHOD_MODULE_CALIBRATE_SPI);
+    memcpy(spiReferenceVersion, zmBuf, sizeof(spiReferenceVersion));
+    
+    uint8_t fastest = defaultDivider;
+    uint8_t divider;
+    while ((divider = halSpiFasterClockDivider(fastest)) != 0)
+    {
+        halSpiSetClockDivider(divider);
+        uint8_t errors = spiRoundTrips();
+        if (errors > 0)
+        {
+            spiCalibrationErrors += errors;
+            spiFailedDivider = divider;
+            break;
+        }
+        fastest = divider;
+    }
+    divider = (fastest < defaultDivider) ? (fastest * 2) : defaultDivider;
+    halSpiSetClockDivider(divider);
+    if (divider != defaultDivider)
+    {
+        uint8_t errors = spiRoundTrips();
+        if (errors > 0)
+        {
+            spiCalibrationErrors += errors;
+            halSpiSetClockDivider(0);
+        }
+    }
+    if (halSpiClockHz() != 0)
+        printf("SPI clock %lu Hz, ", (unsigned long) halSpiClockHz());
+    printf("SPI divider %u, %u errors calibrating", halSpiGetClockDivider(), spiCalibrationErrors);
+    if (spiFailedDivider != 0)
+        printf(", first at divider %u", spiFailedDivider);
+    printf("\r\n");
+    return MODULE_SUCCESS;
+}
+
+/** @return how many round trips failed in the last moduleCalibrateSpi() */
+uint16_t moduleSpiCalibrationErrors()
+{
+    return spiCalibrationErrors;
+}
+
+/** @return the fastest divider moduleCalibrateSpi() tried that failed, or 0 if none did */
+uint8_t moduleSpiFailedDivider()
+{
+    return spiFailedDivider;
+}
+#endif
+
 
 /** 
 Displays the type of message in zmBuf.
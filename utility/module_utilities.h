@@ -82,6 +82,27 @@ struct moduleConfiguration
 moduleResult_t startModule(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac);
 moduleResult_t expressStartModule(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac);
 uint8_t getDeviceStateForDeviceType(uint8_t deviceType);
+uint8_t moduleRecover();
+#ifndef __MSP430G2553
+moduleResult_t startModuleAsync(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac);
+moduleResult_t startModulePoll();
+uint8_t startModuleProgress();
+moduleResult_t moduleCalibrateSpi();
+uint16_t moduleSpiCalibrationErrors();
+uint8_t moduleSpiFailedDivider();
+
+/* Steps of startModuleAsync(), in the order they're done; returned by startModuleProgress() */
+#define START_STEP_IDLE                 0   // not started
+#define START_STEP_RESET                1   // waiting for the Module to boot
+#define START_STEP_STARTUP_OPTIONS      2   // writing the startup options
+#define START_STEP_APPLY_RESET          3   // waiting for the Module to boot with them
+#define START_STEP_CONFIGURE            4   // writing the device type, channels, PAN ID, security...
+#define START_STEP_REGISTER             5   // registering the applications (endpoints)
+#define START_STEP_START_APPLICATION    6   // ZDO_STARTUP_FROM_APP
+#define START_STEP_WAIT_FOR_STATE       7   // waiting to join or form the network
+#define START_STEP_DONE                 8   // on the network
+#define START_STEP_FAILED               9   // see the result from startModulePoll()
+#endif
 //moduleResult_t expressStartModule(const struct moduleConfiguration* mc, const struct applicationConfiguration* ac);
 
 #define DEFAULT_CHANNEL_MASK		(CHANNEL_MASK_11 | CHANNEL_MASK_14 | CHANNEL_MASK_17 | CHANNEL_MASK_20 | CHANNEL_MASK_23)
@@ -0,0 +1,160 @@
+/**
+* @file timer_wheel.c
+*
+* @brief A hierarchical timer wheel for the library's timeouts.
+*
+* Level 0 has a slot for each of the next TIMER_WHEEL_SLOTS milliseconds. Each slot of level 1 covers
+* TIMER_WHEEL_SLOTS milliseconds, each slot of level 2 covers TIMER_WHEEL_SLOTS level 1 slots, and so on.
+* A timer goes in the lowest level that reaches its expiry time. When the wheel turns to the start of
+* a higher level slot, the timers in it are moved down, until they reach level 0 and expire.
+*/
+
+#include "timer_wheel.h"
+#include "hal.h"
+#include <stddef.h>
+
+#ifndef __MSP430G2553
+
+#define SLOT_MASK       (TIMER_WHEEL_SLOTS - 1)
+/** Which slot of this level holds time */
+#define SLOT(level, time)   (((time) >> ((level) * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK)
+
+static struct timer* wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+/** The last millisecond that timerService() has dealt with */
+static uint32_t wheelTime = 0;
+
+/** How many timers are running */
+static uint8_t timers = 0;
+
+/** Adds a timer to the front of a slot's list */
+static void linkTimer(struct timer* t, struct timer** head)
+{
+    t->next = *head;
+    if (t->next)
+        t->next->link = &t->next;
+    t->link = head;
+    *head = t;
+}
+
+/** Removes a timer from whichever list it is in */
+static void unlinkTimer(struct timer* t)
+{
+    *t->link = t->next;
+    if (t->next)
+        t->next->link = t->link;
+    t->next = NULL;
+    t->link = NULL;
+}
+
+/** 
+Puts a timer in the lowest level that reaches its expiry time, counting from the next tick that 
+timerService() will deal with. Timers that are already due go in that tick.
+*/
+static void insertTimer(struct timer* t)
+{
+    uint32_t next = wheelTime + 1;
+    uint32_t expires = t->expires;
+    if ((int32_t)(expires - next) < 0)
+        expires = next;
+    uint8_t level;
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        uint8_t shift = level * TIMER_WHEEL_SLOT_BITS;
+        /* Shifted times wrap at 2^(32-shift), so the slots between them are counted modulo that */
+        if ((((expires >> shift) - (next >> shift)) & (0xFFFFFFFFUL >> shift)) < TIMER_WHEEL_SLOTS)
+        {
+            linkTimer(t, &wheel[level][SLOT(level, expires)]);
+            return;
+        }
+    }
+    /* Further off than the wheel reaches: park it in the last slot of the top level, and look again then */
+    level = TIMER_WHEEL_LEVELS - 1;
+    linkTimer(t, &wheel[level][(SLOT(level, next) + SLOT_MASK) & SLOT_MASK]);
+}
+
+/**
+Starts a timer, or restarts it if it is already running.
+@param t the timer; must stay put until it expires or is stopped
+@param delayMs how long from now it expires, in milliseconds
+@param callback called from timerService() when it expires, with context. It may start timers,
+including this one again.
+*/
+void timerStart(struct timer* t, uint32_t delayMs, void (*callback)(void* context), void* context)
+{
+    uint32_t now = millis();
+    if (t->link)
+        timerStop(t);
+    if (timers == 0)                    // nothing to catch up on
+        wheelTime = now;
+    t->expires = now + delayMs;
+    t->callback = callback;
+    t->context = context;
+    t->next = NULL;
+    insertTimer(t);
+    timers++;
+}
+
+/** Stops a timer without calling its callback. Does nothing if it isn't running. */
+void timerStop(struct timer* t)
+{
+    if (t->link == NULL)
+        return;
+    unlinkTimer(t);
+    timers--;
+}
+
+/** @return 1 if the timer is running, else 0 */
+uint8_t timerActive(const struct timer* t)
+{
+    return (t->link != NULL);
+}
+
+/**
+Turns the wheel up to now, calling the callback of each timer that has expired.
+@param now the current time, from millis()
+*/
+void timerService(uint32_t now)
+{
+    while ((timers > 0) && ((int32_t)(now - wheelTime) > 0))
+    {
+        uint32_t tick = wheelTime + 1;
+        uint8_t level;
+        for (level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)      // move timers down from the slots starting now
+        {
+            if ((tick & ((1UL << (level * TIMER_WHEEL_SLOT_BITS)) - 1)) != 0)
+                continue;
+            struct timer* cascade = wheel[level][SLOT(level, tick)];
+            wheel[level][SLOT(level, tick)] = NULL;
+            while (cascade)
+            {
+                struct timer* t = cascade;
+                cascade = t->next;
+                insertTimer(t);
+            }
+        }
+
+        struct timer* expired = wheel[0][SLOT(0, tick)];             // take the list, so callbacks can start timers
+        wheel[0][SLOT(0, tick)] = NULL;
+        if (expired)
+            expired->link = &expired;
+        wheelTime = tick;
+        while (expired)
+        {
+            struct timer* t = expired;
+            unlinkTimer(t);
+            timers--;
+            t->callback(t->context);
+        }
+    }
+    if (timers == 0)
+        wheelTime = now;
+}
+
+/** @return how many timers are running */
+uint8_t timerCount()
+{
+    return timers;
+}
+
+#endif
@@ -0,0 +1,48 @@
+/**
+*  @file timer_wheel.h
+*
+*  @brief  public methods for timer_wheel.c
+*
+* Deadlines for the library's outstanding requests - async sends waiting for their AF_DATA_CONFIRM, a
+* startup waiting to join - kept in a hierarchical timer wheel, so that starting, stopping and expiring
+* a timer takes the same time however many are running. Nothing happens until timerService() is called;
+* ZigBee.poll() does that.
+*/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+#ifndef __MSP430G2553
+
+/** Each level of the wheel has 2^TIMER_WHEEL_SLOT_BITS slots, each covering that many of the slots below */
+#define TIMER_WHEEL_SLOT_BITS   4
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_SLOT_BITS)
+/** Four levels of 1 mSec ticks reach 65 seconds; longer timers wait in the top level and are moved down later */
+#define TIMER_WHEEL_LEVELS      4
+
+/**
+A timer. The caller owns it (usually as part of whatever is waiting), so starting one never runs out
+of memory. It must be zeroed (e.g. static) before it is first started. Don't change its fields directly.
+*/
+struct timer
+{
+    struct timer* next;
+    /** The pointer that points to this timer, so that it can be removed without searching; NULL when stopped */
+    struct timer** link;
+    /** millis() when it expires */
+    uint32_t expires;
+    void (*callback)(void* context);
+    void* context;
+};
+
+void timerStart(struct timer* t, uint32_t delayMs, void (*callback)(void* context), void* context);
+void timerStop(struct timer* t);
+uint8_t timerActive(const struct timer* t);
+void timerService(uint32_t now);
+uint8_t timerCount();
+
+#endif
+
+#endif
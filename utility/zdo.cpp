@@ -48,6 +48,7 @@
 #include "utilities.h"
 #include "module_errors.h"
 #include "zm_phy_spi.h"
+#include "address_cache.h"
 #include <string.h>                 //for memcpy()
 #include <stdint.h>
 
@@ -118,6 +119,9 @@ moduleResult_t zdoRequestIeeeAddress(uint16_t shortAddress, uint8_t requestType,
     
 #define ZDO_IEEE_ADDR_RSP_TIMEOUT 10
     RETURN_RESULT_IF_FAIL(waitForMessage(ZDO_IEEE_ADDR_RSP, ZDO_IEEE_ADDR_RSP_TIMEOUT), METHOD_ZDO_IEEE_ADDR_RSP);
+#ifndef __MSP430G2553
+    addressCacheLearn(zmBuf);
+#endif
     RETURN_RESULT(zmBuf[ZDO_IEEE_ADDR_RSP_STATUS_FIELD], METHOD_ZDO_IEEE_ADDR_RSP);
 #endif
 }
@@ -161,6 +165,9 @@ moduleResult_t zdoNetworkAddressRequest(uint8_t* ieeeAddress, uint8_t requestTyp
     
 #define ZDO_NWK_ADDR_RSP_TIMEOUT 10
     RETURN_RESULT_IF_FAIL(waitForMessage(ZDO_NWK_ADDR_RSP, ZDO_NWK_ADDR_RSP_TIMEOUT), METHOD_ZDO_NWK_ADDR_RSP);
+#ifndef __MSP430G2553
+    addressCacheLearn(zmBuf);
+#endif
     RETURN_RESULT(zmBuf[ZDO_NWK_ADDR_RSP_STATUS_FIELD], METHOD_ZDO_NWK_ADDR_RSP);
 #endif
 }
@@ -79,6 +79,12 @@ moduleResult_t zdoRequestBind(uint16_t dstAddr, uint8_t* srcAddress, uint8_t src
 #define ZDO_END_DEVICE_ANNCE_IND_MAC_START_FIELD        (SRSP_PAYLOAD_START+4)
 #define ZDO_END_DEVICE_ANNCE_IND_CAPABILITIES_FIELD                  (SRSP_PAYLOAD_START + 12)
 
+//for ZDO_LEAVE_IND
+#define IS_ZDO_LEAVE_IND()                              (CONVERT_TO_INT(zmBuf[SRSP_CMD_LSB_FIELD], zmBuf[SRSP_CMD_MSB_FIELD]) == ZDO_LEAVE_IND)
+#define ZDO_LEAVE_IND_SRC_ADDRESS_LSB_FIELD             (SRSP_PAYLOAD_START)
+#define ZDO_LEAVE_IND_SRC_ADDRESS_MSB_FIELD             (SRSP_PAYLOAD_START+1)
+#define ZDO_LEAVE_IND_IEEE_ADDRESS_START_FIELD          (SRSP_PAYLOAD_START+2)
+
 #define ZDO_END_DEVICE_ANNCE_IND_CAPABILITIES_FLAG_DEVICETYPE_ROUTER     0x02
 #define ZDO_END_DEVICE_ANNCE_IND_CAPABILITIES_FLAG_MAINS_POWERED         0x04
 #define ZDO_END_DEVICE_ANNCE_IND_CAPABILITIES_FLAG_RX_ON_WHEN_IDLE       0x08
@@ -99,6 +105,8 @@ moduleResult_t zdoRequestBind(uint16_t dstAddr, uint8_t* srcAddress, uint8_t src
 #define ZDO_IEEE_ADDR_RSP_START_INDEX_FIELD                     11
 #define ZDO_IEEE_ADDR_RSP_NUMBER_OF_ASSOCIATED_DEVICES_FIELD    12
 #define ZDO_IEEE_ADDR_RSP_ASSOCIATED_DEVICE_FIELD_START         13
+// ZDO_IEEE_ADDR_RSP and ZDO_NWK_ADDR_RSP have the same format
+#define ZDO_ADDR_RSP_IEEE_ADDRESS_START_FIELD                   (SRSP_PAYLOAD_START+1)
 
 // For ZDO_BIND_RSP && ZDO_UNBIND_RSP
 #define ZDO_BIND_SOURCE_ADDRESS_LSB                             (SRSP_PAYLOAD_START)
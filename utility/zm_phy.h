@@ -0,0 +1,39 @@
+/**
+*  @file zm_phy.h
+*
+*  @brief  the transport between the library and the Module
+*
+* Everything above the physical interface builds MT frames in zmBuf and calls sendMessage() and
+* getMessage(); a transport moves those frames to and from the Module. SPI (zm_phy_spi.c) is used
+* unless another is selected with moduleSetTransport() before moduleInit(), e.g. the UART transport in
+* zm_phy_uart.c. Frames are handed to a transport as they are in zmBuf - length, cmd0, cmd1, data -
+* whatever framing the port itself needs is added and removed by the transport.
+*/
+
+#ifndef ZM_PHY_H
+#define ZM_PHY_H
+
+#include <stdint.h>
+#include "module_errors.h"
+
+struct moduleTransport
+{
+    /** Sets up the port */
+    void (*init)(void);
+    /** Sends the SREQ in buf and reads its SRSP back into buf. Given a poll (0,0,0) instead, reads the
+    next frame from the Module into buf, leaving the length 0 if there isn't one. */
+    moduleResult_t (*transaction)(uint8_t* buf);
+    /** @return 1 if the Module has a frame for us */
+    uint8_t (*messageWaiting)(void);
+    /** Gets the port going again after a SREQ failed */
+    void (*resetPort)(void);
+    /** Called once MRST has been released, for transports that can reset the Module themselves; may be NULL */
+    void (*resetModule)(void);
+    /** 1 if the Module signals a waiting frame by pulling SRDY low, so SRDY interrupts can be used */
+    uint8_t srdy;
+};
+
+void moduleSetTransport(const struct moduleTransport* transport);
+const struct moduleTransport* moduleGetTransport();
+
+#endif
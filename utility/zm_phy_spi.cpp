@@ -10,12 +10,15 @@
 * In the defined symbols box, add:
 * ZM_PHY_SPI_VERBOSE
 *
-* Normally the module is quite fast in responding to a SREQ and there is not sufficient time on a 
-* slower processor (e.g. < 25MHz) to configure a timeout to detect a missing response. If using a 
-* fast processor then define FAST_PROCESSOR. This does several things:
+* Each wait for the Module in a SPI transaction has a deadline measured with micros(), so it's the 
+* same on every processor:
 *   1. sendSreq() will timeout if a response was not received in time. 
 *   2. the amount of time spent in each part of the SREQ process is available in variables 
-*       timeFromChipSelectToSrdyLow and timeWaitingForSrsp.
+*       timeFromChipSelectToSrdyLow and timeWaitingForSrsp, in microseconds.
+* When a SREQ times out, sendMessage() tries to get the Module going again. @see moduleRecoveries()
+*
+* SPI is the default transport. The methods here that don't depend on the port - sendMessage(),
+* getMessage(), the receive queue - go through whichever transport is selected. @see zm_phy.h
 *
 * $Rev: 1796 $
 * $Author: dsmith $
@@ -47,124 +50,324 @@
 
 #include "hal.h"
 #include "zm_phy_spi.h"
-#include "../../SPI/spi.h"
+#include "../../SPI/SPI.h"
 #include "module_errors.h"
+#include "message_queue.h"
+#include "module_commands.h"
+#include "utilities.h"
 #include <stdint.h>
+#include <stddef.h>                     //for NULL
 
 //#define ZM_PHY_SPI_VERBOSE_ERRORS
 /** This buffer will hold the transmitted messages and received SRSP Payload after sendMessage() was 
 called. If fragmentation support is not required then this can be smaller, e.g. 100B.*/
 uint8_t zmBuf[ZIGBEE_MODULE_BUFFER_SIZE];
-#if defined(__LM4F120H5QR__) || defined(__TM4C123GH6PM____) || defined(__TM4C1294NCPDT__) || defined(__TM4C129XNCZAD__) || defined(TARGET_IS_CC3101)
-#define FAST_PROCESSOR
+
+/** Set while a SPI transaction or a receive queue operation is in progress, so that the SRDY 
+interrupt does not start another transaction in the middle of it. */
+static volatile uint8_t zmBusy = 0;
+
+#ifndef __MSP430G2553
+/** Set by the SRDY interrupt if it fired while zmBusy was set */
+static volatile uint8_t receivePending = 0;
+
+#if MESSAGE_QUEUE_SIZE < ZIGBEE_MODULE_BUFFER_SIZE
+#error MESSAGE_QUEUE_SIZE must hold at least one frame of ZIGBEE_MODULE_BUFFER_SIZE
+#endif
+
+/** Set when a ZDO_STATE_CHANGE_IND or SYS_RESET_IND comes in, whoever reads it; @see moduleNetworkStateChanged() */
+static volatile uint8_t networkStateChanged = 0;
+
+/** Private method that notes a frame coming in from the Module that changes the network state */
+static void noteNetworkState(const uint8_t* frame)
+{
+  uint16_t type = CONVERT_TO_INT(frame[SRSP_CMD_LSB_FIELD], frame[SRSP_CMD_MSB_FIELD]);
+  if ((type == ZDO_STATE_CHANGE_IND) || (type == SYS_RESET_IND))
+    networkStateChanged = 1;
+}
 #endif
-#ifdef FAST_PROCESSOR           //used to report the amount of time it takes for the Module to respond over SPI
+
+//used to report the amount of time it takes for the Module to respond over SPI, in microseconds
 uint32_t timeFromChipSelectToSrdyLow = 0;
 uint32_t timeWaitingForSrsp = 0;
-//these will be used in sendSreq() for the timeouts:
-#define CHIP_SELECT_TO_SRDY_LOW_TIMEOUT (TICKS_PER_MS * 125)    
-#define WAIT_FOR_SRSP_TIMEOUT (TICKS_PER_MS * 125)              //typically takes less than 100mSec
+//these are the deadlines in spiTransaction(), in microseconds:
+#define CHIP_SELECT_TO_SRDY_LOW_TIMEOUT 125000UL
+#define WAIT_FOR_SRSP_TIMEOUT 125000UL                          //typically takes less than 100mSec
 
-#endif
+/** How many times sendMessage() has tried each step of the recovery ladder. @see moduleRecoveries() */
+static uint16_t recoveries[RECOVERY_STEPS];
+
+/** Resets the Module and restores its applications; set with moduleSetRecoveryHandler() */
+static uint8_t (*recoveryHandler)(void) = 0;
+
+/** Set while the recovery handler runs, so that a SREQ failing in it doesn't start another recovery */
+static uint8_t recovering = 0;
+
+static moduleResult_t spiTransaction(uint8_t* buf);
+static uint8_t spiMessageWaiting();
+
+/** The Module on the SPI port, with MRDY and SRDY */
+const struct moduleTransport spiTransport = { halSpiInitModule, spiTransaction, spiMessageWaiting, halSpiReset, NULL, 1 };
+
+/** Where frames go; @see moduleSetTransport() */
+static const struct moduleTransport* transport = &spiTransport;
 
 /* Initializes the module PHY interface.
 */
 void zm_phy_init()
 {
-  halSpiInitModule();
+  transport->init();
+}
+
+/**
+Selects how to talk to the Module. Call before moduleInit(); SPI is used until then.
+@param t the transport, e.g. &spiTransport or moduleUartTransport(). NULL selects SPI.
+*/
+void moduleSetTransport(const struct moduleTransport* t)
+{
+  transport = (t != NULL) ? t : &spiTransport;
+}
+
+/** @return the transport in use */
+const struct moduleTransport* moduleGetTransport()
+{
+  return transport;
+}
+
+/** @return 1 if the Module has pulled SRDY low to say it has a frame for us */
+static uint8_t spiMessageWaiting()
+{
+  return (SRDY_IS_LOW());
 }
 
-/** Whether the module has a message waiting to be retrieved.
+/** Whether the module has a message waiting to be retrieved, either in the receive queue or in the Module.
  @return true (1) if there is a complete message ready for processing, or 0 otherwise.
 */
 uint8_t moduleHasMessageWaiting()
 {
-  return (SRDY_IS_LOW());
+#ifndef __MSP430G2553
+  if (messageQueueCount() > 0)
+    return 1;
+#endif
+  return (transport->messageWaiting());
 }
 
 /**
-Sends a Module Synchronous Request (SREQ) message and retrieves the response. A SREQ is a message to 
-the Module that is immediately followed by a Synchronous Response (SRSP) message from the Module. As 
-opposed to an Asynchronous Request (AREQ) message, which does not have a SRSP. This is a private 
-method that gets wrapped by sendMessage() and spiPoll().
+Runs one SPI transaction with the Module using the given buffer: sends the frame in buf and reads the
+Module's response back into buf. This is the handshake used by both sendSreq() and the SRDY interrupt.
 @pre Module has been initialized
-@pre zmBuf contains a properly formatted message. No validation is done.
-@post received data is written to zmBuf
-@return if FAST_PROCESSOR is defined then MODULE_SUCCESS, else an error code. If FAST_PROCESSOR is not defined, then MODULE_SUCCESS.
-@note if running on a fast processor then you may need to modify the code to ensure that the module keeps up. See below
+@pre buf contains a properly formatted message. No validation is done.
+@post received data is written to buf
+@return MODULE_SUCCESS, ZM_PHY_CHIP_SELECT_TIMEOUT if the Module didn't answer (buf is untouched), or
+ZM_PHY_SRSP_TIMEOUT if it took the frame but didn't respond
+@note in the SRDY interrupt, micros() may not advance on some cores; the waits are then only as 
+bounded as the Module is, which is no worse than without a deadline
 */
-moduleResult_t sendSreq()
+static moduleResult_t spiTransaction(uint8_t* buf)
 {
-#ifdef FAST_PROCESSOR                           //NOTE: only enable if using a processor with sufficient speed (25MHz+)
-  uint32_t timeLeft1 = CHIP_SELECT_TO_SRDY_LOW_TIMEOUT;
-  uint32_t timeLeft2 = WAIT_FOR_SRSP_TIMEOUT;
-  
+  uint32_t start = micros();
   SPI_SS_SET();                               // Assert SS
-  while (SRDY_IS_HIGH() && (timeLeft1 != 0))  //wait until SRDY goes low
-    timeLeft1--;
-  if (timeLeft1 == 0)                         //SRDY did not go low in time, so return an error
-    return ZM_PHY_CHIP_SELECT_TIMEOUT;
-  timeFromChipSelectToSrdyLow = (CHIP_SELECT_TO_SRDY_LOW_TIMEOUT - timeLeft1);
-  spiWrite(zmBuf, (*zmBuf + 3));              // *bytes (first byte) is length after the first 3 bytes, all frames have at least the first 3 bytes
-  *zmBuf = 0; *(zmBuf+1) = 0; *(zmBuf+2) = 0; //poll message is 0,0,0
+  while (SRDY_IS_HIGH())                      //wait until SRDY goes low
+  {
+    if ((micros() - start) >= CHIP_SELECT_TO_SRDY_LOW_TIMEOUT)
+    {
+      SPI_SS_CLEAR();                         //SRDY did not go low in time, so return an error
+      return ZM_PHY_CHIP_SELECT_TIMEOUT;
+    }
+  }
+  timeFromChipSelectToSrdyLow = micros() - start;
+  halSpiTransfer(buf, (*buf + 3));            // *bytes (first byte) is length after the first 3 bytes, all frames have at least the first 3 bytes
+  *buf = 0; *(buf+1) = 0; *(buf+2) = 0;       //poll message is 0,0,0
   //NOTE: MRDY must remain asserted here, but can de-assert SS if the two signals are separate
   
   /* Now: Data was sent, so we wait for Synchronous Response (SRSP) to be received.
   This will be indicated by SRDY transitioning to high */
-  
-  while (SRDY_IS_LOW() && (timeLeft2 != 0))    //wait for data
-    timeLeft2--;
-  if (timeLeft2 == 0)
-    return ZM_PHY_SRSP_TIMEOUT;
-  
-  timeWaitingForSrsp = (WAIT_FOR_SRSP_TIMEOUT - timeLeft2);
+  start = micros();
+  while (SRDY_IS_LOW())                       //wait for data
+  {
+    if ((micros() - start) >= WAIT_FOR_SRSP_TIMEOUT)
+    {
+      SPI_SS_CLEAR();
+      return ZM_PHY_SRSP_TIMEOUT;
+    }
+  }
+  timeWaitingForSrsp = micros() - start;
   //NOTE: if SS & MRDY are separate signals then can re-assert SS here.
-/*
-    spiWrite(zmBuf, 1);
-    if (*zmBuf > 0)                                 // *bytes (first byte) contains number of bytes to receive
-        spiWrite(zmBuf+1, *zmBuf+2);                //write-to-read: read data into buffer                                  
-    else
-        spiWrite(zmBuf+1,2);
-  */
-  spiWrite(zmBuf, 3);
-  //delay(5);
-  /* NOTE: if on a fast processor, may need a little delay here */
-  if (*zmBuf > 0)                             // *bytes (first byte) contains number of bytes to receive
-    spiWrite(zmBuf+3, *zmBuf);              //write-to-read: read data into buffer
+  /* The length is in the header, so the header is one burst and the payload another. Both bursts are
+  in the same transaction, so the Module sees them as one frame. */
+  halSpiTransfer(buf, 3);
+  if (*buf > (ZIGBEE_MODULE_BUFFER_SIZE - SRSP_HEADER_SIZE))  // a garbled length, e.g. from too fast a clock; don't overrun buf
+  {
+    SPI_SS_CLEAR();
+    return ZM_PHY_OTHER_ERROR;
+  }
+  if (*buf > 0)                               // *bytes (first byte) contains number of bytes to receive
+    halSpiTransfer(buf+3, *buf);              //write-to-read: read data into buffer
   SPI_SS_CLEAR();
-  return 0;
-#else                                       // In a slow processor there's not enough time to set up the timeout so there will be errors
-  SPI_SS_SET();   
-  while (SRDY_IS_HIGH()) ;   //wait until SRDY goes low
+  return MODULE_SUCCESS;
+}
 
-  spiWrite(zmBuf, (*zmBuf + 3));              // *bytes (first byte) is length after the first 3 bytes, all frames have at least the first 3 bytes
-  *zmBuf = 0; *(zmBuf+1) = 0; *(zmBuf+2) = 0; //poll message is 0,0,0
-  //NOTE: MRDY must remain asserted here, but can de-assert SS if the two signals are separate
-  //Now: Data was sent, wait for Synchronous Response (SRSP)
+/**
+Sends a Module Synchronous Request (SREQ) message and retrieves the response. A SREQ is a message to 
+the Module that is immediately followed by a Synchronous Response (SRSP) message from the Module. As 
+opposed to an Asynchronous Request (AREQ) message, which does not have a SRSP. This is a private 
+method that gets wrapped by sendMessage() and spiPoll().
+@pre zmBuf contains a properly formatted message. No validation is done.
+@post received data is written to zmBuf
+@see spiTransaction()
+*/
+moduleResult_t sendSreq()
+{
+  zmBusy = 1;                                 // Keep the SRDY interrupt off the bus until we're done
+  moduleResult_t result = transport->transaction(zmBuf);
+  zmBusy = 0;
+#ifndef __MSP430G2553
+  if (receivePending)                         // SRDY fell while we had the bus; fetch that message now
+    moduleServiceReceive();
+#endif
+  return result;
+}
 
-  while (SRDY_IS_LOW()) ;                     //wait for data
-  //NOTE: if SS & MRDY are separate signals then can re-assert SS here.
+#ifndef __MSP430G2553
+/**
+Moves the messages the Module has waiting into the receive queue. Attach this to the SRDY falling 
+edge interrupt to receive messages as soon as they arrive. If the bus is in use (we are in the middle of a SREQ) 
+then the fetch is deferred until sendSreq() releases the bus.
+Stops once the queue might not have room for the next message, so that a burst is never fetched 
+only to be dropped: the rest stay in the Module with SRDY low, and getMessage() fetches them directly 
+once the queue is empty, since SRDY won't fall again for them. This also leaves room for 
+moduleStashMessage().
+@note frames are read straight into the free end of the queue, so an interrupt never disturbs a 
+message being built in zmBuf, and needs no buffer of its own.
+*/
+void moduleServiceReceive()
+{
+  if (zmBusy)
+  {
+    receivePending = 1;
+    return;
+  }
+  receivePending = 0;
+  zmBusy = 1;
+  while ((messageQueueFree() >= ZIGBEE_MODULE_BUFFER_SIZE) && transport->messageWaiting())
+  {
+    uint8_t* frame = messageQueueTail();
+    frame[0] = 0; frame[1] = 0; frame[2] = 0;  //poll message is 0,0,0
+    if (transport->transaction(frame) != MODULE_SUCCESS)
+      break;
+    if (frame[SRSP_LENGTH_FIELD] > 0)
+    {
+      noteNetworkState(frame);
+      messageQueueCommit();
+    }
+  }
+  zmBusy = 0;
+}
+
+/** @return how many received messages are waiting in the receive queue */
+uint8_t moduleQueuedMessages()
+{
+  return messageQueueCount();
+}
+
+/** Discards all queued messages, e.g. after the Module was reset. */
+void moduleFlushMessages()
+{
+  zmBusy = 1;
+  messageQueueFlush();
+  zmBusy = 0;
+}
+
+/**
+Moves the oldest queued message of the given type into zmBuf. Other queued messages keep their order.
+@param messageType the message to look for, e.g. AF_DATA_CONFIRM
+@return 1 if a message was moved into zmBuf, 0 if none of that type was queued
+*/
+uint8_t moduleTakeMessage(uint16_t messageType)
+{
+  zmBusy = 1;
+  uint8_t found = messageQueueTake(messageType, zmBuf, ZIGBEE_MODULE_BUFFER_SIZE);
+  zmBusy = 0;
+  if (receivePending)
+    moduleServiceReceive();
+  return found;
+}
+
+/**
+Puts the message in zmBuf at the end of the receive queue so that the next getMessage() returns it.
+Used by waitForMessage() to keep messages that arrive while it waits for something else.
+@return 1 if the message was queued, 0 if the queue was full (the message is counted as dropped)
+*/
+uint8_t moduleStashMessage()
+{
+  noteNetworkState(zmBuf);
+  zmBusy = 1;
+  uint8_t queued = messageQueuePush(zmBuf);
+  zmBusy = 0;
+  if (receivePending)
+    moduleServiceReceive();
+  return queued;
+}
+
+/**
+Whether the network state may have changed: a ZDO_STATE_CHANGE_IND or SYS_RESET_IND has come in since 
+the last call, whether or not the application ever receives it (e.g. waitForMessage() was waiting for 
+something else, or the receive queue was full).
+@return 1 if one has, else 0
+*/
+uint8_t moduleNetworkStateChanged()
+{
+  if (networkStateChanged == 0)
+    return 0;
+  networkStateChanged = 0;
+  return 1;
+}
+#endif
 
-  spiWrite(zmBuf, 3);
-  if (*zmBuf > 0)                             // *bytes (first byte) contains number of bytes to receive
-    spiWrite(zmBuf+3, *zmBuf);              //write-to-read: read data into buffer    
-  SPI_SS_CLEAR();                             // re-assert MRDY and SS
-  return MODULE_SUCCESS;  
+/**
+Retrieves the next message directly from the Module into zmBuf, skipping the receive queue.
+@post received data is written to zmBuf. The length field is 0 if the Module had nothing for us, e.g.
+because the SRDY interrupt already fetched it.
+*/
+moduleResult_t fetchMessage()
+{
+  moduleResult_t result = MODULE_SUCCESS;
+  zmBusy = 1;
+  *zmBuf = 0; *(zmBuf+1) = 0; *(zmBuf+2) = 0;  //poll message is 0,0,0 
+  if (transport->messageWaiting())
+    result = transport->transaction(zmBuf);
+  zmBusy = 0;
+#ifndef __MSP430G2553
+  if (zmBuf[SRSP_LENGTH_FIELD] > 0)
+    noteNetworkState(zmBuf);
+  if (receivePending)
+    moduleServiceReceive();
 #endif
+  return result;
 }
 
 /**
-Polls the Module for data. This is used to receive data from the Module, for example when a message 
-has arrived. This will be initiated by detecting SRDY going low. 
+Retrieves the next message from the Module into zmBuf. Messages already fetched by the SRDY interrupt
+are returned first, oldest first; once they're gone, any the interrupt left in the Module are fetched
+directly.
 @pre Module has been initialized.
-@pre SRDY has gone low
+@pre moduleHasMessageWaiting() is true
 @post received data is written to zmBuf
-@note this method not required to be implemented when using UART interface.
 */
 moduleResult_t getMessage()
 {
-  *zmBuf = 0; *(zmBuf+1) = 0; *(zmBuf+2) = 0;  //poll message is 0,0,0 
-  return(sendSreq());
+#ifndef __MSP430G2553
+  if (messageQueueCount() > 0)
+  {
+    zmBusy = 1;
+    messageQueuePop(zmBuf, ZIGBEE_MODULE_BUFFER_SIZE);
+    zmBusy = 0;
+    if (receivePending)
+      moduleServiceReceive();
+    return MODULE_SUCCESS;
+  }
+#endif
+  return(fetchMessage());
 }
 
 /** Public method to send messages to the Module. This will send one message and then receive the 
@@ -190,8 +393,22 @@ moduleResult_t sendMessage()
 #ifdef ZM_PHY_SPI_VERBOSE_ERRORS    
     printf("ERROR - sreq() timeout %02X\r\n", result);
 #endif 
-	halSpiReset();
-    return result;
+    /* Recovery ladder: reset the port, and if the Module never took the frame then try it again */
+    transport->resetPort();
+    recoveries[RECOVERY_SPI_RESET]++;
+    if (result == ZM_PHY_CHIP_SELECT_TIMEOUT)
+      result = sendSreq();
+    /* Still nothing, so reset the Module and restore its applications */
+    if ((result != MODULE_SUCCESS) && (recoveryHandler != 0) && (!recovering))
+    {
+      recovering = 1;
+      uint8_t step = recoveryHandler();
+      recovering = 0;
+      for (; step > RECOVERY_SPI_RESET; step--)
+        recoveries[step]++;
+    }
+    if (result != MODULE_SUCCESS)
+      return result;
   }
   
   /* The correct SRSP will always be 0x4000 + cmd, or simpler 0x4000 | cmd
@@ -203,8 +420,27 @@ moduleResult_t sendMessage()
 #ifdef ZM_PHY_SPI_VERBOSE_ERRORS    
     printf("ERROR - Wrong SRSP - received %02X-%02X, expected %02X-%02X\r\n", zmBuf[1], zmBuf[2],expectedSrspCmdMsb,expectedSrspCmdLsb);
 #endif          
-	halSpiReset();
+	transport->resetPort();
     return ZM_PHY_INCORRECT_SRSP;   //Wrong SRSP received
   }
 }
 
+/**
+Sets the method sendMessage() calls when a SREQ times out even after resetting the port. It should
+reset the Module and restore whatever the application had set up, e.g. moduleRecover().
+@param handler returns the last step of the recovery ladder it tried: RECOVERY_MODULE_RESET or 
+RECOVERY_APPLICATIONS. NULL to only reset the port.
+*/
+void moduleSetRecoveryHandler(uint8_t (*handler)(void))
+{
+  recoveryHandler = handler;
+}
+
+/**
+@param step RECOVERY_SPI_RESET, RECOVERY_MODULE_RESET or RECOVERY_APPLICATIONS
+@return how many times sendMessage() has tried that step of the recovery ladder since startup
+*/
+uint16_t moduleRecoveries(uint8_t step)
+{
+  return ((step < RECOVERY_STEPS) ? recoveries[step] : 0);
+}
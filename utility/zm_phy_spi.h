@@ -39,12 +39,31 @@
 
 #include <stdint.h>
 #include "module_errors.h"
+#include "zm_phy.h"
 
 moduleResult_t sendMessage();
 moduleResult_t getMessage();
-#define MODULE_HAS_MESSAGE_WAITING()  (SRDY_IS_LOW())
+moduleResult_t fetchMessage();
+void moduleSetRecoveryHandler(uint8_t (*handler)(void));
+uint16_t moduleRecoveries(uint8_t step);
+
+/* Steps of the recovery ladder sendMessage() climbs when a SREQ times out. @see moduleRecoveries() */
+#define RECOVERY_SPI_RESET          0   // the transport's resetPort(), and the SREQ sent again if the Module never took it
+#define RECOVERY_MODULE_RESET       1   // moduleReset()
+#define RECOVERY_APPLICATIONS       2   // applications registered again and ZDO_STARTUP_FROM_APP
+#define RECOVERY_STEPS              3
+#define MODULE_HAS_MESSAGE_WAITING()  (moduleGetTransport()->messageWaiting())
 uint8_t moduleHasMessageWaiting();
 void zm_phy_init();
+extern const struct moduleTransport spiTransport;
+#ifndef __MSP430G2553
+void moduleServiceReceive();
+uint8_t moduleQueuedMessages();
+void moduleFlushMessages();
+uint8_t moduleTakeMessage(uint16_t messageType);
+uint8_t moduleStashMessage();
+uint8_t moduleNetworkStateChanged();
+#endif
 
 #ifdef __MSP430G2553
 #define ZIGBEE_MODULE_BUFFER_SIZE  128       // AF_INCOMING_MSG_EXT is largest: 30B for header + 130B for 
@@ -59,7 +78,7 @@ extern uint8_t zmBuf[ZIGBEE_MODULE_BUFFER_SIZE];
 
 //SRSP MSB is 0x40 greater than SREQ MSB
 #define SRSP_OFFSET             0x40
-//Note: these may be different for a UART phy
+//The same for every transport, since they strip their own framing
 #define SRSP_PAYLOAD_START      3
 #define SRSP_LENGTH_FIELD       0  
 #define SRSP_CMD_LSB_FIELD      2
@@ -0,0 +1,205 @@
+/**
+* @file zm_phy_uart.c
+*
+* @brief Physical Interface Layer to the Module using a UART, e.g. a USB-UART on a Linux gateway.
+*
+* On the UART each MT frame has a start of frame byte in front and a frame check sequence behind:
+*   SOF (0xFE) | length | cmd0 | cmd1 | data (length bytes) | FCS
+* where FCS is the XOR of length through the last data byte. There is no MRDY/SRDY handshake: the
+* Module sends its frames whenever it has them, and they wait in the serial port's receive buffer until
+* we read them. So a SREQ is written and frames are read until its SRSP arrives; any AREQs that arrive
+* first go into the receive queue, where getMessage() finds them.
+*
+* The port must already be begun at the Module's baud rate (115200 unless the Module was built
+* otherwise). On a reset, MRST is pulsed as usual and a SYS_RESET_REQ is sent too, so a Module with only
+* its UART connected is reset as well.
+*
+* @note there is no SRDY, so the SRDY interrupt (RECEIVE_INTERRUPT, onReceive()) doesn't work over UART;
+* call ZigBee.poll() or receive() instead.
+*/
+
+#include "zm_phy_uart.h"
+#include "zm_phy_spi.h"
+#include "message_queue.h"
+#include "module_commands.h"
+#include "hal.h"
+#include <stddef.h>                     //for NULL
+#include <string.h>                     //for memcpy
+
+#ifndef __MSP430G2553
+
+/** How long a SREQ waits for its SRSP, in microseconds. At 115200 baud the longest frame takes 22mSec */
+#define UART_SRSP_TIMEOUT           250000UL
+
+/** The type of a frame is in the top three bits of cmd0 */
+#define MT_CMD_TYPE_MASK            0xE0
+#define MT_CMD_SRSP                 0x60
+
+/** SYS_RESET_REQ type: reset the Module with its watchdog, as MRST would */
+#define SYS_RESET_REQ_HARD          0x00
+
+/* Where the receiver is in a frame */
+#define RX_SOF                      0
+#define RX_LENGTH                   1
+#define RX_FRAME                    2   // cmd0, cmd1 and data
+#define RX_FCS                      3
+
+static Stream* uartPort = NULL;
+
+/** The frame being received, laid out as in zmBuf: length, cmd0, cmd1, data */
+static uint8_t rxFrame[ZIGBEE_MODULE_BUFFER_SIZE];
+static uint8_t rxState = RX_SOF;
+static uint8_t rxIndex = 0;
+static uint8_t rxFcs = 0;
+/** Set when rxFrame holds a complete frame that hasn't been taken yet */
+static uint8_t rxReady = 0;
+
+/** Frames dropped because their FCS was wrong or they wouldn't fit in zmBuf */
+static uint16_t frameErrors = 0;
+
+/**
+Reads what the port has received into rxFrame, stopping at the end of a frame. Anything outside a
+frame is skipped until the next SOF.
+@return 1 if rxFrame holds a complete frame
+*/
+static uint8_t uartReceive()
+{
+    while ((!rxReady) && (uartPort->available() > 0))
+    {
+        uint8_t c = (uint8_t) uartPort->read();
+        switch (rxState)
+        {
+        case RX_SOF:
+            if (c == MT_UART_SOF)
+                rxState = RX_LENGTH;
+            break;
+        case RX_LENGTH:
+            if (c > (ZIGBEE_MODULE_BUFFER_SIZE - SRSP_HEADER_SIZE))
+            {
+                frameErrors++;
+                rxState = RX_SOF;
+                break;
+            }
+            rxFrame[SRSP_LENGTH_FIELD] = c;
+            rxFcs = c;
+            rxIndex = 1;
+            rxState = RX_FRAME;
+            break;
+        case RX_FRAME:
+            rxFrame[rxIndex++] = c;
+            rxFcs ^= c;
+            if (rxIndex == (rxFrame[SRSP_LENGTH_FIELD] + SRSP_HEADER_SIZE))
+                rxState = RX_FCS;
+            break;
+        default:                        // RX_FCS
+            rxState = RX_SOF;
+            if (c == rxFcs)
+                rxReady = 1;
+            else
+                frameErrors++;
+            break;
+        }
+    }
+    return rxReady;
+}
+
+/** Moves the received frame into buf, making room for the next one */
+static void uartTakeFrame(uint8_t* buf)
+{
+    memcpy(buf, rxFrame, rxFrame[SRSP_LENGTH_FIELD] + SRSP_HEADER_SIZE);
+    rxReady = 0;
+}
+
+/** Writes the frame in buf to the port, with its SOF and FCS */
+static void uartSend(const uint8_t* buf)
+{
+    uint8_t length = buf[SRSP_LENGTH_FIELD] + SRSP_HEADER_SIZE;
+    uint8_t fcs = 0;
+    uint8_t i;
+    for (i = 0; i < length; i++)
+        fcs ^= buf[i];
+    uartPort->write((uint8_t) MT_UART_SOF);
+    uartPort->write(buf, length);
+    uartPort->write(fcs);
+}
+
+/**
+Sends the SREQ in buf and reads its SRSP back into buf, queueing any AREQs that arrive first. Given a
+poll (0,0,0), takes the next frame already received instead, if there is one.
+@return MODULE_SUCCESS, or ZM_PHY_SRSP_TIMEOUT if no SRSP arrived in time
+*/
+static moduleResult_t uartTransaction(uint8_t* buf)
+{
+    if ((buf[SRSP_LENGTH_FIELD] == 0) && (buf[SRSP_CMD_MSB_FIELD] == 0) && (buf[SRSP_CMD_LSB_FIELD] == 0))
+    {
+        if (uartReceive())
+            uartTakeFrame(buf);
+        return MODULE_SUCCESS;
+    }
+    uartSend(buf);
+    buf[SRSP_LENGTH_FIELD] = 0; buf[SRSP_CMD_MSB_FIELD] = 0; buf[SRSP_CMD_LSB_FIELD] = 0;
+    uint32_t start = micros();
+    while ((micros() - start) < UART_SRSP_TIMEOUT)
+    {
+        if (!uartReceive())
+            continue;
+        if ((rxFrame[SRSP_CMD_MSB_FIELD] & MT_CMD_TYPE_MASK) == MT_CMD_SRSP)
+        {
+            uartTakeFrame(buf);
+            return MODULE_SUCCESS;
+        }
+        messageQueuePush(rxFrame);      // Counted as dropped if the queue is full
+        rxReady = 0;
+    }
+    return ZM_PHY_SRSP_TIMEOUT;
+}
+
+/** @return 1 if a complete frame from the Module has been received */
+static uint8_t uartMessageWaiting()
+{
+    return uartReceive();
+}
+
+/** Drops any partly received frame, so the receiver starts again at the next SOF */
+static void uartResetPort()
+{
+    rxState = RX_SOF;
+}
+
+/** Discards everything received so far */
+static void uartInit()
+{
+    rxState = RX_SOF;
+    rxReady = 0;
+    while (uartPort->available() > 0)
+        uartPort->read();
+}
+
+/** Asks the Module to reset, after discarding whatever it sent before */
+static void uartResetModule()
+{
+    uint8_t request[] = { 1, (uint8_t) (SYS_RESET_REQ >> 8), (uint8_t) (SYS_RESET_REQ & 0xFF), SYS_RESET_REQ_HARD };
+    uartInit();
+    uartSend(request);
+}
+
+static const struct moduleTransport uartTransport = { uartInit, uartTransaction, uartMessageWaiting, uartResetPort, uartResetModule, 0 };
+
+/**
+The transport for a Module on a UART.
+@param port the serial port, already begun at the Module's baud rate, e.g. &Serial1
+@return the transport, for moduleSetTransport()
+*/
+const struct moduleTransport* moduleUartTransport(Stream* port)
+{
+    uartPort = port;
+    return &uartTransport;
+}
+
+/** @return how many frames from the Module have been dropped for a bad FCS or length since startup */
+uint16_t moduleUartFrameErrors()
+{
+    return frameErrors;
+}
+
+#endif
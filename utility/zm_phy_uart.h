@@ -0,0 +1,27 @@
+/**
+*  @file zm_phy_uart.h
+*
+*  @brief  public methods for zm_phy_uart.c
+*
+* The Module on a UART instead of SPI, e.g. through a USB-UART on a Linux gateway. Select it with
+* moduleSetTransport(moduleUartTransport(&Serial1)) before moduleInit(), or with ZigBee.uart(Serial1).
+*/
+
+#ifndef ZM_PHY_UART_H
+#define ZM_PHY_UART_H
+
+#include "Energia.h"
+#include <stdint.h>
+#include "zm_phy.h"
+
+#ifndef __MSP430G2553
+
+/** Start of frame, in front of every MT frame on the UART */
+#define MT_UART_SOF                 0xFE
+
+const struct moduleTransport* moduleUartTransport(Stream* port);
+uint16_t moduleUartFrameErrors();
+
+#endif
+
+#endif